@@ -0,0 +1,160 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include "nk/log.h"
+#include "strconv.h"
+#include "affinity.h"
+
+extern int gflags_debug;
+
+// Runs are bound to the CPUs they may use in a single NUMA node, which is
+// set in the child before it executes the job.  The node with the fewest
+// running jobs per eligible CPU is picked, and the run is counted against
+// the CPU in that node with the fewest running jobs; ties go round-robin,
+// so a burst of jobs is spread out rather than stacked on the first node.
+
+#define AFFINITY_NODES_MAX 64
+
+static bool g_have_hk;          // housekeeping CPUs were given
+static cpu_set_t g_allowed;     // CPUs that ncron may use at all
+static cpu_set_t g_hk;          // housekeeping CPUs
+static unsigned g_ncpus;        // highest possible CPU + 1
+static unsigned g_load[CPU_SETSIZE];
+static unsigned char g_node[CPU_SETSIZE];
+static unsigned g_nnodes = 1;
+static unsigned g_rr_cpu;
+static unsigned g_rr_node;
+
+static bool cpu_list_parse(char const *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    if (!*s) return false;
+    for (;;) {
+        char const *e = s, *dash = NULL;
+        while (*e && *e != ',') {
+            if (*e == '-' && !dash) dash = e;
+            ++e;
+        }
+        uint32_t lo, hi;
+        if (dash) {
+            if (!strconv_to_u32(s, dash, &lo) || !strconv_to_u32(dash + 1, e, &hi)) return false;
+        } else {
+            if (!strconv_to_u32(s, e, &lo)) return false;
+            hi = lo;
+        }
+        if (lo > hi || hi >= CPU_SETSIZE) return false;
+        for (uint32_t i = lo; i <= hi; ++i) CPU_SET(i, set);
+        if (!*e) return true;
+        s = e + 1;
+    }
+}
+
+bool cpu_list_valid(char const *s)
+{
+    cpu_set_t set;
+    return cpu_list_parse(s, &set);
+}
+
+static void affinity_read_nodes(void)
+{
+    for (unsigned n = 0; n < AFFINITY_NODES_MAX; ++n) {
+        char path[64], buf[1024];
+        snprintf(path, sizeof path, "/sys/devices/system/node/node%u/cpulist", n);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        bool ok = fgets(buf, sizeof buf, f) != NULL;
+        fclose(f);
+        if (!ok) continue;
+        buf[strcspn(buf, "\n")] = 0;
+        cpu_set_t set;
+        if (!cpu_list_parse(buf, &set)) continue;
+        for (unsigned i = 0; i < g_ncpus; ++i) {
+            if (CPU_ISSET(i, &set)) g_node[i] = (unsigned char)n;
+        }
+        if (n >= g_nnodes) g_nnodes = n + 1;
+    }
+}
+
+void affinity_init(char const *housekeeping)
+{
+    if (sched_getaffinity(0, sizeof g_allowed, &g_allowed))
+        suicide("sched_getaffinity failed: %s\n", strerror(errno));
+    for (unsigned i = 0; i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &g_allowed)) g_ncpus = i + 1;
+    }
+    affinity_read_nodes();
+    if (!housekeeping) return;
+    if (!cpu_list_parse(housekeeping, &g_hk))
+        suicide("Invalid CPU list for --cpus: '%s'\n", housekeeping);
+    CPU_AND(&g_hk, &g_hk, &g_allowed);
+    if (!CPU_COUNT(&g_hk))
+        suicide("None of the CPUs given to --cpus are available\n");
+    if (sched_setaffinity(0, sizeof g_hk, &g_hk))
+        suicide("sched_setaffinity failed: %s\n", strerror(errno));
+    g_have_hk = true;
+}
+
+int affinity_pick(char const *cpus, const void **mask, size_t *mask_size)
+{
+    static cpu_set_t g_mask;
+    cpu_set_t set;
+    *mask = NULL;
+    *mask_size = 0;
+    if (cpus) {
+        if (!cpu_list_parse(cpus, &set)) return -1;
+        CPU_AND(&set, &set, &g_allowed);
+        if (!CPU_COUNT(&set)) {
+            log_line("None of the CPUs in '%s' are available; not binding\n", cpus);
+            return -1;
+        }
+    } else if (g_have_hk) {
+        set = g_hk;
+    } else {
+        return -1;
+    }
+
+    unsigned nload[AFFINITY_NODES_MAX] = {0}, ncnt[AFFINITY_NODES_MAX] = {0};
+    for (unsigned i = 0; i < g_ncpus; ++i) {
+        if (!CPU_ISSET(i, &set)) continue;
+        nload[g_node[i]] += g_load[i];
+        ++ncnt[g_node[i]];
+    }
+    unsigned node = AFFINITY_NODES_MAX;
+    for (unsigned k = 0; k < g_nnodes; ++k) {
+        unsigned n = (g_rr_node + k) % g_nnodes;
+        if (!ncnt[n]) continue;
+        if (node == AFFINITY_NODES_MAX
+            || (uint64_t)nload[n] * ncnt[node] < (uint64_t)nload[node] * ncnt[n])
+            node = n;
+    }
+    g_rr_node = node + 1;
+
+    int cpu = -1;
+    for (unsigned k = 1; k <= g_ncpus; ++k) {
+        unsigned i = (g_rr_cpu + k) % g_ncpus;
+        if (!CPU_ISSET(i, &set) || g_node[i] != node) continue;
+        if (cpu < 0 || g_load[i] < g_load[cpu]) cpu = (int)i;
+    }
+    g_rr_cpu = (unsigned)cpu;
+    ++g_load[cpu];
+    CPU_ZERO(&g_mask);
+    for (unsigned i = 0; i < g_ncpus; ++i) {
+        if (CPU_ISSET(i, &set) && g_node[i] == node) CPU_SET(i, &g_mask);
+    }
+    *mask = &g_mask;
+    *mask_size = sizeof g_mask;
+    if (gflags_debug)
+        log_debug("CPU %d (node %u) load %u\n", cpu, node, g_load[cpu]);
+    return cpu;
+}
+
+void affinity_release(int cpu)
+{
+    if (cpu >= 0 && g_load[cpu]) --g_load[cpu];
+}
@@ -0,0 +1,24 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_AFFINITY_H_
+#define NCRON_AFFINITY_H_
+#include <stdbool.h>
+#include <stddef.h>
+
+// Returns true if s is a CPU list such as "0-3,8,10-11".
+bool cpu_list_valid(char const *s);
+
+// Confines ncron to the housekeeping CPUs in the list, if it is not NULL;
+// jobs without a cpus= list are then spread over them.  Must be called
+// before any other threads are started.
+void affinity_init(char const *housekeeping);
+// Chooses the least-loaded CPU for a run of a job that may use the CPUs in
+// the list cpus, or the housekeeping CPUs if it is NULL, and counts the run
+// against it.  The run is to be bound to *mask, of *mask_size bytes, which
+// holds the CPUs it may use in the NUMA node of that CPU; the mask is valid
+// until the next call.  Returns -1, and sets *mask to NULL, if the run is
+// not to be bound.
+int affinity_pick(char const *cpus, const void **mask, size_t *mask_size);
+// Called when a run that was counted against cpu has exited.
+void affinity_release(int cpu);
+#endif
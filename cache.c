@@ -0,0 +1,488 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "nk/log.h"
+#include "nk/io.h"
+#include "hash.h"
+#include "sched.h"
+#include "cache.h"
+#include "affinity.h"
+#include "cgroup.h"
+#include "users.h"
+
+extern int gflags_debug;
+extern size_t g_njobs;
+extern struct Job *g_jobs;
+
+// Image layout: header, job records, constraint blocks, string blob.
+// Everything is in host byte order; the header records enough about the
+// layout that an image from a different build is rejected rather than
+// misread.
+
+#define CACHE_MAGIC "NCRONIMG"
+#define CACHE_VERSION 11
+#define CACHE_NOSTR UINT32_MAX
+
+struct cache_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t hdr_size;
+    uint32_t job_size;
+    uint32_t cst_size;
+    uint64_t src_size;
+    int64_t src_mtime_sec;
+    int64_t src_mtime_nsec;
+    uint64_t src_hash;
+    uint64_t img_size;
+    uint32_t njobs;
+    uint32_t ncst;
+    uint32_t strs_len;
+    uint32_t pad_;
+};
+
+struct cache_job {
+    int32_t id;
+    uint32_t interval;
+    uint32_t maxruns;
+    uint32_t cst;       // index into the constraint blocks
+    uint32_t command;   // offsets into the string blob
+    uint32_t args;      // CACHE_NOSTR if absent
+    uint32_t journal;
+    uint32_t timeout;
+    uint32_t output;    // CACHE_NOSTR if absent
+    uint32_t output_max_kb;
+    uint32_t after;     // offset of nafter int32 ids in the string blob
+    uint32_t nafter;
+    uint32_t fail_interval;
+    uint32_t backoff;
+    uint32_t cpus;      // CACHE_NOSTR if absent
+    uint32_t cgroup;    // CACHE_NOSTR if absent
+    uint32_t cpu_weight;
+    uint32_t io_weight;
+    uint32_t memory_high_kb;
+    uint32_t deadline;
+    uint32_t catchup;
+    uint32_t interval_ms;
+    uint32_t user;      // CACHE_NOSTR if absent
+};
+
+static bool hash_fd(int fd, uint64_t *hash)
+{
+    char buf[65536];
+    uint64_t h = FNV1A64_INIT;
+    for (;;) {
+        ssize_t r = safe_read(fd, buf, sizeof buf);
+        if (r < 0) return false;
+        if (r == 0) break;
+        h = fnv1a64(h, buf, (size_t)r);
+        if ((size_t)r < sizeof buf) break;
+    }
+    *hash = h;
+    return true;
+}
+
+bool cache_src_hash(char const *path, struct stat *st, uint64_t *hash)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = !fstat(fd, st) && hash_fd(fd, hash);
+    close(fd);
+    return ok;
+}
+
+// Maps interned constraint pointers to their index in the image.
+struct cst_map {
+    const struct JobCst **keys;
+    uint32_t *idx;
+    size_t size; // power of two
+};
+
+static uint32_t cst_map_get(struct cst_map *self, const struct JobCst *c, uint32_t *ncst)
+{
+    size_t i = ((uintptr_t)c >> 4) & (self->size - 1);
+    while (self->keys[i] && self->keys[i] != c)
+        i = (i + 1) & (self->size - 1);
+    if (!self->keys[i]) {
+        self->keys[i] = c;
+        self->idx[i] = (*ncst)++;
+    }
+    return self->idx[i];
+}
+
+static bool write_all(FILE *f, const void *p, size_t len)
+{
+    return fwrite(p, 1, len, f) == len;
+}
+
+// Writes the image of jobs, parsed from conf, to f.
+static bool cache_image_write(FILE *f, char const *conf, const struct stat *st,
+                              uint64_t src_hash, const struct Job *jobs, size_t njobs)
+{
+    bool ret = false;
+    struct cache_job *cjobs = calloc(njobs + 1, sizeof *cjobs);
+    const struct JobCst **csts = calloc(njobs + 1, sizeof *csts);
+    struct cst_map cm = { .size = 16 };
+    while (cm.size < njobs * 2) cm.size *= 2;
+    cm.keys = calloc(cm.size, sizeof *cm.keys);
+    cm.idx = calloc(cm.size, sizeof *cm.idx);
+    if (!cjobs || !csts || !cm.keys || !cm.idx) abort();
+
+    uint32_t ncst = 0;
+    size_t strs_len = 0;
+    for (size_t i = 0; i < njobs; ++i) {
+        const struct Job *j = &jobs[i];
+        uint32_t ci = cst_map_get(&cm, j->cst_, &ncst);
+        csts[ci] = j->cst_;
+        cjobs[i] = (struct cache_job){
+            .id = j->id_,
+            .interval = j->interval_,
+            .maxruns = j->maxruns_,
+            .cst = ci,
+            .command = (uint32_t)strs_len,
+            .args = CACHE_NOSTR,
+            .journal = j->journal_,
+            .timeout = j->timeout_,
+            .output = CACHE_NOSTR,
+            .output_max_kb = j->output_max_kb_,
+            .nafter = j->nafter_,
+            .fail_interval = j->fail_interval_,
+            .backoff = j->backoff_,
+            .cpus = CACHE_NOSTR,
+            .cgroup = CACHE_NOSTR,
+            .cpu_weight = j->cpu_weight_,
+            .io_weight = j->io_weight_,
+            .memory_high_kb = j->memory_high_kb_,
+            .deadline = j->deadline_,
+            .catchup = j->catchup_,
+            .interval_ms = j->interval_ms_,
+            .user = CACHE_NOSTR,
+        };
+        strs_len += strlen(j->command_) + 1;
+        if (j->args_) {
+            cjobs[i].args = (uint32_t)strs_len;
+            strs_len += strlen(j->args_) + 1;
+        }
+        if (j->output_) {
+            cjobs[i].output = (uint32_t)strs_len;
+            strs_len += strlen(j->output_) + 1;
+        }
+        if (j->cpus_) {
+            cjobs[i].cpus = (uint32_t)strs_len;
+            strs_len += strlen(j->cpus_) + 1;
+        }
+        if (j->cgroup_) {
+            cjobs[i].cgroup = (uint32_t)strs_len;
+            strs_len += strlen(j->cgroup_) + 1;
+        }
+        if (j->user_) {
+            cjobs[i].user = (uint32_t)strs_len;
+            strs_len += strlen(j->user_->name) + 1;
+        }
+        cjobs[i].after = (uint32_t)strs_len;
+        strs_len += j->nafter_ * sizeof(int32_t);
+        if (strs_len >= CACHE_NOSTR) {
+            log_line("Config file '%s' is too large to compile\n", conf);
+            goto out0;
+        }
+    }
+
+    struct cache_hdr hdr = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .hdr_size = sizeof(struct cache_hdr),
+        .job_size = sizeof(struct cache_job),
+        .cst_size = sizeof(struct JobCst),
+        .src_size = (uint64_t)st->st_size,
+        .src_mtime_sec = st->st_mtim.tv_sec,
+        .src_mtime_nsec = st->st_mtim.tv_nsec,
+        .src_hash = src_hash,
+        .njobs = (uint32_t)njobs,
+        .ncst = ncst,
+        .strs_len = (uint32_t)strs_len,
+    };
+    hdr.img_size = sizeof hdr + njobs * sizeof *cjobs
+                 + ncst * sizeof(struct JobCst) + strs_len;
+
+    bool ok = write_all(f, &hdr, sizeof hdr)
+           && write_all(f, cjobs, njobs * sizeof *cjobs);
+    for (uint32_t i = 0; ok && i < ncst; ++i)
+        ok = write_all(f, csts[i], sizeof *csts[i]);
+    for (size_t i = 0; ok && i < njobs; ++i) {
+        const struct Job *j = &jobs[i];
+        ok = write_all(f, j->command_, strlen(j->command_) + 1)
+          && (!j->args_ || write_all(f, j->args_, strlen(j->args_) + 1))
+          && (!j->output_ || write_all(f, j->output_, strlen(j->output_) + 1))
+          && (!j->cpus_ || write_all(f, j->cpus_, strlen(j->cpus_) + 1))
+          && (!j->cgroup_ || write_all(f, j->cgroup_, strlen(j->cgroup_) + 1))
+          && (!j->user_ || write_all(f, j->user_->name, strlen(j->user_->name) + 1))
+          && (!j->nafter_ || write_all(f, j->after_, j->nafter_ * sizeof *j->after_));
+    }
+    if (gflags_debug && ok)
+        log_debug("Compiled %zu jobs (%u distinct constraints) from %s.\n", njobs, ncst, conf);
+    ret = ok;
+out0:
+    free(cm.idx);
+    free(cm.keys);
+    free(csts);
+    free(cjobs);
+    return ret;
+}
+
+bool cache_write(char const *path, char const *conf, const struct stat *st,
+                 uint64_t src_hash, const struct Job *jobs, size_t njobs)
+{
+    bool ret = false;
+    size_t l = strlen(path);
+    char *tmpf = malloc(l + 2);
+    if (!tmpf) abort();
+    memcpy(tmpf, path, l);
+    tmpf[l] = '~';
+    tmpf[l+1] = 0;
+
+    FILE *f = fopen(tmpf, "w");
+    if (!f) {
+        log_line("Failed to open cache file %s for write\n", tmpf);
+        goto out;
+    }
+    bool ok = cache_image_write(f, conf, st, src_hash, jobs, njobs);
+    if (fclose(f) || !ok) {
+        log_line("Failed to write to cache file %s\n", tmpf);
+        unlink(tmpf);
+        goto out;
+    }
+    if (rename(tmpf, path)) {
+        log_line("Failed to update cache file (%s => %s): %s\n",
+                 tmpf, path, strerror(errno));
+        unlink(tmpf);
+        goto out;
+    }
+    ret = true;
+out:
+    free(tmpf);
+    return ret;
+}
+
+bool cache_send(int fd, const struct Job *jobs, size_t njobs)
+{
+    FILE *f = fdopen(fd, "w");
+    if (!f) {
+        close(fd);
+        return false;
+    }
+    struct stat st = {0};
+    bool ok = cache_image_write(f, "the crontab", &st, 0, jobs, njobs);
+    if (fclose(f) || !ok) {
+        log_line("Failed to send the jobs to the daemon\n");
+        return false;
+    }
+    return true;
+}
+
+bool cache_compile(char const *path, char const *conf)
+{
+    struct stat st;
+    uint64_t src_hash;
+    if (!cache_src_hash(conf, &st, &src_hash)) {
+        log_line("Failed to read config file '%s': %s\n", conf, strerror(errno));
+        return false;
+    }
+    // The hash and stat above are taken before parsing, so a crontab that
+    // changes while we run yields an image that will simply be stale.
+    parse_config_jobs(conf);
+    if (!cache_write(path, conf, &st, src_hash, g_jobs, g_njobs))
+        return false;
+    log_line("Compiled %zu jobs to %s.\n", g_njobs, path);
+    return true;
+}
+
+static bool cache_hdr_valid(const struct cache_hdr *hdr, size_t size)
+{
+    if (size < sizeof *hdr) return false;
+    if (memcmp(hdr->magic, CACHE_MAGIC, sizeof hdr->magic)) return false;
+    if (hdr->version != CACHE_VERSION
+        || hdr->hdr_size != sizeof(struct cache_hdr)
+        || hdr->job_size != sizeof(struct cache_job)
+        || hdr->cst_size != sizeof(struct JobCst))
+        return false;
+    if (hdr->img_size != size) return false;
+    uint64_t want = sizeof *hdr + (uint64_t)hdr->njobs * sizeof(struct cache_job)
+                  + (uint64_t)hdr->ncst * sizeof(struct JobCst) + hdr->strs_len;
+    return want == size;
+}
+
+static bool cache_src_matches(const struct cache_hdr *hdr, char const *conf)
+{
+    struct stat st;
+    if (stat(conf, &st)) return false;
+    if ((uint64_t)st.st_size != hdr->src_size) return false;
+    if (st.st_mtim.tv_sec == hdr->src_mtime_sec
+        && st.st_mtim.tv_nsec == hdr->src_mtime_nsec)
+        return true;
+    // Touched, copied, or restored from backup: compare the contents.
+    uint64_t h;
+    if (!cache_src_hash(conf, &st, &h)) return false;
+    return h == hdr->src_hash;
+}
+
+static char *cache_str(const char *strs, uint32_t len, uint32_t off)
+{
+    if (off == CACHE_NOSTR) return NULL;
+    if (off >= len || !memchr(strs + off, 0, len - off)) return NULL;
+    char *r = strdup(strs + off);
+    if (!r) abort();
+    return r;
+}
+
+// Decodes the jobs of a valid image.  Their constraint blocks are interned,
+// so the image may be freed afterwards.  If users is set, the jobs are
+// given the users named in the image.
+static bool cache_image_load(const void *img, bool users, struct Job **jobs, size_t *njobs)
+{
+    const struct cache_hdr *hdr = img;
+    const struct cache_job *cj = (const struct cache_job *)(hdr + 1);
+    const struct JobCst *csts = (const struct JobCst *)(cj + hdr->njobs);
+    const char *strs = (const char *)(csts + hdr->ncst);
+    const struct JobCst **icst = malloc((hdr->ncst + 1) * sizeof *icst);
+    if (!icst) abort();
+    for (uint32_t i = 0; i < hdr->ncst; ++i) icst[i] = job_cst_intern(&csts[i]);
+
+    size_t n = hdr->njobs;
+    struct Job *js = NULL;
+    if (n) {
+        js = malloc(n * sizeof(struct Job));
+        if (!js) abort();
+    }
+    for (size_t i = 0; i < n; ++i) {
+        struct Job *j = &js[i];
+        job_init(j);
+        j->id_ = cj[i].id;
+        j->interval_ = cj[i].interval;
+        j->interval_ms_ = cj[i].interval_ms;
+        j->maxruns_ = cj[i].maxruns;
+        j->journal_ = cj[i].journal;
+        j->timeout_ = cj[i].timeout;
+        j->deadline_ = cj[i].deadline;
+        j->catchup_ = (unsigned char)cj[i].catchup;
+        j->output_max_kb_ = cj[i].output_max_kb;
+        j->fail_interval_ = cj[i].fail_interval;
+        j->backoff_ = cj[i].backoff ? cj[i].backoff : 1;
+        j->command_ = cache_str(strs, hdr->strs_len, cj[i].command);
+        j->args_ = cache_str(strs, hdr->strs_len, cj[i].args);
+        j->output_ = cache_str(strs, hdr->strs_len, cj[i].output);
+        j->cpus_ = cache_str(strs, hdr->strs_len, cj[i].cpus);
+        j->cgroup_ = cache_str(strs, hdr->strs_len, cj[i].cgroup);
+        j->cpu_weight_ = cj[i].cpu_weight;
+        j->io_weight_ = cj[i].io_weight;
+        j->memory_high_kb_ = cj[i].memory_high_kb;
+        bool after_ok = cj[i].nafter <= JOB_AFTER_MAX && cj[i].after <= hdr->strs_len
+                        && cj[i].nafter * sizeof(int32_t) <= hdr->strs_len - cj[i].after;
+        if (after_ok && cj[i].nafter) {
+            j->nafter_ = cj[i].nafter;
+            j->after_ = malloc(j->nafter_ * sizeof *j->after_);
+            if (!j->after_) abort();
+            memcpy(j->after_, strs + cj[i].after, j->nafter_ * sizeof *j->after_);
+        }
+        bool user_ok = true;
+        if (users && cj[i].user != CACHE_NOSTR) {
+            // The jobs of a user are together, so each is looked up once.
+            char *name = cache_str(strs, hdr->strs_len, cj[i].user);
+            if (i && js[i - 1].user_ && name && !strcmp(js[i - 1].user_->name, name))
+                j->user_ = js[i - 1].user_;
+            else if (name)
+                j->user_ = users_get(name);
+            user_ok = j->user_;
+            free(name);
+        }
+        if (cj[i].cst >= hdr->ncst || !j->command_ || !after_ok || !user_ok
+            || (cj[i].output != CACHE_NOSTR && !j->output_)
+            || (cj[i].cpus != CACHE_NOSTR && (!j->cpus_ || !cpu_list_valid(j->cpus_)))
+            || (cj[i].cgroup != CACHE_NOSTR && (!j->cgroup_ || !cgroup_name_valid(j->cgroup_)))) {
+            for (size_t k = 0; k <= i; ++k) job_destroy(&js[k]);
+            free(js);
+            free(icst);
+            return false;
+        }
+        j->cst_ = icst[cj[i].cst];
+    }
+    free(icst);
+    *jobs = js;
+    *njobs = n;
+    return true;
+}
+
+bool cache_load(char const *path, char const *conf, struct Job **jobs, size_t *njobs)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            log_line("Failed to open cache file '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(struct cache_hdr)) {
+        close(fd);
+        goto stale;
+    }
+    size_t size = (size_t)st.st_size;
+    void *img = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (img == MAP_FAILED) {
+        log_line("Failed to map cache file '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+    const struct cache_hdr *hdr = img;
+    if (!cache_hdr_valid(hdr, size) || !cache_src_matches(hdr, conf)) {
+        munmap(img, size);
+        goto stale;
+    }
+    // Only possible if the image was damaged after being written.
+    bool ok = cache_image_load(img, false, jobs, njobs);
+    munmap(img, size);
+    if (!ok) goto stale;
+    if (gflags_debug)
+        log_debug("Loaded %zu jobs from cache file %s\n", *njobs, path);
+    return true;
+stale:
+    log_line("Cache file '%s' is stale or invalid; parsing '%s'.\n", path, conf);
+    return false;
+}
+
+bool cache_recv(int fd, struct Job **jobs, size_t *njobs)
+{
+    size_t size = 0, cap = 65536;
+    char *img = malloc(cap);
+    if (!img) abort();
+    for (;;) {
+        if (size == cap) {
+            cap *= 2;
+            img = realloc(img, cap);
+            if (!img) abort();
+        }
+        ssize_t r = safe_read(fd, img + size, cap - size);
+        if (r < 0) {
+            log_line("Failed to read the parsed jobs: %s\n", strerror(errno));
+            free(img);
+            return false;
+        }
+        if (r == 0) break;
+        size += (size_t)r;
+    }
+    // Nothing is sent if the crontab could not be parsed.
+    if (!size) {
+        free(img);
+        return false;
+    }
+    bool ok = cache_hdr_valid((const struct cache_hdr *)img, size)
+              && cache_image_load(img, true, jobs, njobs);
+    free(img);
+    if (!ok) log_line("The parsed jobs were damaged in transfer\n");
+    return ok;
+}
@@ -0,0 +1,38 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_CACHE_H_
+#define NCRON_CACHE_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+struct Job;
+
+// Stats the crontab at path and computes the content hash that is
+// recorded in its images.
+bool cache_src_hash(char const *path, struct stat *st, uint64_t *hash);
+
+// Writes an image of jobs, parsed from conf, to path.  st and hash must
+// describe conf as it was before it was parsed.
+bool cache_write(char const *path, char const *conf, const struct stat *st,
+                 uint64_t hash, const struct Job *jobs, size_t njobs);
+
+// Parses the crontab at conf and writes a binary image of the resulting
+// jobs to path.  The image is replaced atomically.
+bool cache_compile(char const *path, char const *conf);
+
+// Loads the jobs from the image at path if it was compiled from the
+// current contents of conf.  Returns false if the image is absent, stale,
+// or unusable, in which case conf should be parsed as text.
+bool cache_load(char const *path, char const *conf, struct Job **jobs, size_t *njobs);
+
+// Writes an image of jobs to fd, which is then closed, so that another
+// process can take them on without parsing the crontab again.  The image
+// names the user of each job.
+bool cache_send(int fd, const struct Job *jobs, size_t njobs);
+
+// Reads an image written by cache_send() from fd until end of file and
+// loads its jobs, looking their users up afresh.
+bool cache_recv(int fd, struct Job **jobs, size_t *njobs);
+#endif
@@ -0,0 +1,166 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include "nk/log.h"
+#include "nk/io.h"
+#include "sched.h"
+#include "cgroup.h"
+#include "users.h"
+
+extern int gflags_debug;
+
+// Each job gets the child group named by its cgroup= key, or "job-ID" by
+// default, so that jobs are isolated from ncron and from each other.  The
+// group is created and its limits are written the first time the job runs.
+// Each process moves itself into the group by writing to cgroup.procs after
+// it is created and before it executes the job.
+// With --users, the name is prefixed by "USER." so that users can't join
+// each other's groups.
+
+static int g_root_fd = -1;
+static char *g_root;
+
+static bool cgroup_write(int dirfd, char const *file, char const *val)
+{
+    int fd = openat(dirfd, file, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    size_t n = strlen(val);
+    ssize_t r = safe_write(fd, val, n);
+    int e = errno;
+    close(fd);
+    errno = e;
+    return r == (ssize_t)n;
+}
+
+void cgroup_init(char const *dir)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        log_line("Failed to open cgroup directory '%s': %s; jobs will run in ncron's cgroup\n",
+                 dir, strerror(errno));
+        return;
+    }
+    struct statfs sfs;
+    if (fstatfs(fd, &sfs) || sfs.f_type != CGROUP2_SUPER_MAGIC) {
+        log_line("'%s' is not a cgroup v2 directory; jobs will run in ncron's cgroup\n", dir);
+        close(fd);
+        return;
+    }
+    if (faccessat(fd, ".", W_OK, AT_EACCESS)) {
+        log_line("cgroup directory '%s' is not writable; jobs will run in ncron's cgroup\n", dir);
+        close(fd);
+        return;
+    }
+    // Controllers that are not delegated to us just leave their settings
+    // unavailable in the job groups.
+    static char const *ctls[] = { "+cpu", "+memory", "+io" };
+    for (size_t i = 0; i < sizeof ctls / sizeof *ctls; ++i) {
+        if (!cgroup_write(fd, "cgroup.subtree_control", ctls[i]) && gflags_debug)
+            log_debug("Failed to enable cgroup controller %s in '%s': %s\n",
+                     ctls[i] + 1, dir, strerror(errno));
+    }
+    g_root = strdup(dir);
+    if (!g_root) abort();
+    g_root_fd = fd;
+}
+
+bool cgroup_name_valid(char const *s)
+{
+    return *s && !strchr(s, '/') && strcmp(s, ".") && strcmp(s, "..")
+        && strncmp(s, "cgroup.", 7);
+}
+
+static void cgroup_set(const struct Job *job, int fd, char const *name,
+                       char const *file, char const *val)
+{
+    if (!cgroup_write(fd, file, val))
+        log_line("Failed to set %s of cgroup %s/%s for job %d: %s\n",
+                 file, g_root, name, job->id_, strerror(errno));
+}
+
+int cgroup_job_fd(struct Job *job)
+{
+    if (g_root_fd < 0 || job->cgroup_fd_ == -2) return -1;
+    if (job->cgroup_fd_ >= 0) return job->cgroup_fd_;
+    char defname[32], uname[NAME_MAX + 1];
+    char const *name = job->cgroup_;
+    if (!name) {
+        snprintf(defname, sizeof defname, "job-%d", job->id_);
+        name = defname;
+    }
+    if (job->user_) {
+        int r = snprintf(uname, sizeof uname, "%s.%s", job->user_->name, name);
+        if (r < 0 || (size_t)r >= sizeof uname) {
+            log_line("cgroup name for job %d of user %s is too long; it will run in ncron's cgroup\n",
+                     job->id_, job->user_->name);
+            job->cgroup_fd_ = -2;
+            return -1;
+        }
+        name = uname;
+    }
+    int fd = -1;
+    if (mkdirat(g_root_fd, name, 0755) && errno != EEXIST) {
+        log_line("Failed to create cgroup %s/%s: %s; job %d will run in ncron's cgroup\n",
+                 g_root, name, strerror(errno), job->id_);
+    } else {
+        fd = openat(g_root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            log_line("Failed to open cgroup %s/%s: %s; job %d will run in ncron's cgroup\n",
+                     g_root, name, strerror(errno), job->id_);
+    }
+    if (fd < 0) {
+        job->cgroup_fd_ = -2;
+        return -1;
+    }
+    char val[32];
+    if (job->cpu_weight_) {
+        snprintf(val, sizeof val, "%u", job->cpu_weight_);
+        cgroup_set(job, fd, name, "cpu.weight", val);
+    }
+    if (job->memory_high_kb_) {
+        snprintf(val, sizeof val, "%llu", job->memory_high_kb_ * 1024ULL);
+        cgroup_set(job, fd, name, "memory.high", val);
+    }
+    if (job->io_weight_) {
+        snprintf(val, sizeof val, "default %u", job->io_weight_);
+        cgroup_set(job, fd, name, "io.weight", val);
+    }
+    job->cgroup_fd_ = fd;
+    return fd;
+}
+
+void cgroup_spawn_failed(struct Job *job, int err)
+{
+    // Moves out of ncron's own group are not allowed, or the delegated
+    // groups are threaded while ncron's is not: no job can be placed.
+    if (err == EACCES || err == EOPNOTSUPP) {
+        log_line("Processes can't be moved into the job cgroups (%s); jobs will run in ncron's cgroup\n",
+                 strerror(err));
+        close(g_root_fd);
+        g_root_fd = -1;
+        return;
+    }
+    // The group was removed behind our back; it is made again next time.
+    if (err == ENOENT) {
+        log_line("The cgroup of job %d has gone away; it will be created again\n", job->id_);
+        if (job->cgroup_fd_ >= 0) close(job->cgroup_fd_);
+        job->cgroup_fd_ = -1;
+        return;
+    }
+    // EBUSY means that the group has controllers enabled for child groups,
+    // so it can't hold processes; that is particular to the job's group.
+    log_line("Failed to start job %d in its cgroup: %s; it will run in ncron's cgroup\n",
+             job->id_, strerror(err));
+    if (job->cgroup_fd_ >= 0) close(job->cgroup_fd_);
+    job->cgroup_fd_ = -2;
+}
@@ -0,0 +1,22 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_CGROUP_H_
+#define NCRON_CGROUP_H_
+#include <stdbool.h>
+
+struct Job;
+
+// Jobs are placed in child groups of dir, a cgroup v2 directory delegated
+// to ncron.  If dir is unusable, it is logged and jobs stay in ncron's own
+// cgroup.
+void cgroup_init(char const *dir);
+// Returns true if s may be used as the name of a job's cgroup.
+bool cgroup_name_valid(char const *s);
+// Returns a descriptor for the cgroup of job, creating and configuring it
+// on first use, or -1 if the job is to run in ncron's own cgroup.
+int cgroup_job_fd(struct Job *job);
+// Called when a run of job could not join its cgroup; err is the errno
+// value of the write to cgroup.procs.  Placement is turned off if no job
+// can be placed, and for the job if only its group is unusable.
+void cgroup_spawn_failed(struct Job *job, int err);
+#endif
@@ -0,0 +1,325 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "nk/log.h"
+#include "sched.h"
+#include "proc.h"
+#include "users.h"
+#include "metrics.h"
+#include "control.h"
+
+extern struct Job *g_jobs;
+extern size_t g_njobs;
+extern int gflags_debug;
+
+// Each connection carries one command line and gets its reply, after which
+// the connection is closed:
+//
+//   list          every job, in order of user and id
+//   show JOB      one job
+//   run JOB       dispatch the job now
+//   pause JOB     take the job out of the schedule
+//   resume JOB    put a paused job back into the schedule
+//   flush         save the history
+//   metrics       the metrics page, as for --metrics
+//   loglevel LVL  log messages up to level LVL (error, warn, info, debug)
+//
+// JOB is the id of a job, or with --users, USER:ID, as ids are only unique
+// within each user; jobs are listed the same way.  They are looked up with
+// a binary search.  Sockets are nonblocking
+// and served from the main event loop, so a slow client never holds up
+// dispatch.
+
+#define CONTROL_LINE_MAX 128
+
+struct ControlClient
+{
+    int fd;
+    size_t nin;
+    char in[CONTROL_LINE_MAX];
+    char *out;
+    size_t nout;
+    size_t outpos;
+    size_t outcap;
+};
+
+static int g_epfd = -1;
+static int g_lfd = -1;
+static char *g_path;
+static struct JobHeap *g_heap;
+static void (*g_flush)(void);
+static struct ControlClient g_clients[CONTROL_CLIENTS_MAX];
+static struct Job **g_byid; // built on first use after g_jobs changes
+
+void control_init(char const *path, int epfd, struct JobHeap *heap, void (*flush)(void))
+{
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof sa.sun_path)
+        suicide("Control socket path '%s' is too long\n", path);
+    memcpy(sa.sun_path, path, strlen(path) + 1);
+    g_lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (g_lfd < 0)
+        suicide("socket failed: %s\n", strerror(errno));
+    // A socket left behind by an earlier instance would make bind fail.
+    if (unlink(path) && errno != ENOENT)
+        suicide("Failed to remove '%s': %s\n", path, strerror(errno));
+    if (bind(g_lfd, (struct sockaddr *)&sa, sizeof sa))
+        suicide("Failed to bind control socket '%s': %s\n", path, strerror(errno));
+    if (listen(g_lfd, CONTROL_CLIENTS_MAX))
+        suicide("listen failed: %s\n", strerror(errno));
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = CONTROL_EV_LISTEN };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, g_lfd, &ev))
+        suicide("epoll_ctl failed: %s\n", strerror(errno));
+    g_path = strdup(path);
+    if (!g_path) abort();
+    g_epfd = epfd;
+    g_heap = heap;
+    g_flush = flush;
+    for (size_t i = 0; i < CONTROL_CLIENTS_MAX; ++i) g_clients[i].fd = -1;
+}
+
+void control_jobs_changed(void)
+{
+    free(g_byid);
+    g_byid = NULL;
+}
+
+void control_close(void)
+{
+    if (g_lfd < 0) return;
+    for (size_t i = 0; i < CONTROL_CLIENTS_MAX; ++i) {
+        if (g_clients[i].fd >= 0) close(g_clients[i].fd);
+        free(g_clients[i].out);
+    }
+    close(g_lfd);
+    g_lfd = -1;
+    unlink(g_path);
+    free(g_path);
+    control_jobs_changed();
+}
+
+static void client_close(struct ControlClient *c)
+{
+    close(c->fd);
+    c->fd = -1;
+    c->nin = c->nout = c->outpos = 0;
+}
+
+__attribute__((format (printf, 2, 3)))
+static void reply(struct ControlClient *c, char const *fmt, ...)
+{
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int r = vsnprintf(c->out + c->nout, c->outcap - c->nout, fmt, ap);
+        va_end(ap);
+        if (r < 0) return;
+        if ((size_t)r < c->outcap - c->nout) {
+            c->nout += (size_t)r;
+            return;
+        }
+        size_t ncap = c->outcap ? c->outcap * 2 : 256;
+        while (ncap - c->nout <= (size_t)r) ncap *= 2;
+        char *n = realloc(c->out, ncap);
+        if (!n) abort();
+        c->out = n;
+        c->outcap = ncap;
+    }
+}
+
+static char const *job_state(const struct Job *j)
+{
+    if (j->paused_) return "paused";
+    if (job_heap_contains(g_heap, j)) return "queued";
+    if (j->nafter_) return "waiting";
+    return "done";
+}
+
+static void reply_job(struct ControlClient *c, const struct Job *j)
+{
+    if (j->user_) reply(c, "%s:", j->user_->name);
+    reply(c, "%d next %ld last %ld runs %u %s%s %s\n", j->id_,
+          job_heap_contains(g_heap, j) ? (long)j->exectime_ : 0L, (long)j->lasttime_,
+          j->numruns_, job_state(j), proc_job_running(j) ? " running" : "",
+          j->command_ ? j->command_ : "");
+}
+
+static struct Job *control_find(char const *arg)
+{
+    if (!g_byid) g_byid = job_index_by_id(g_jobs, g_njobs);
+    return job_index_find_key(g_byid, g_njobs, arg, strlen(arg));
+}
+
+static void control_requeue(struct Job *j, time_t when)
+{
+    j->exectime_ = when;
+    j->exectime_nsec_ = 0;
+    if (job_heap_contains(g_heap, j))
+        job_heap_fix(g_heap, j);
+    else
+        job_heap_push(g_heap, j);
+}
+
+static void control_command(struct ControlClient *c, char *line)
+{
+    char *arg = strchr(line, ' ');
+    if (arg) *arg++ = 0;
+    if (!strcmp(line, "list")) {
+        if (!g_byid) g_byid = job_index_by_id(g_jobs, g_njobs);
+        for (size_t i = 0; i < g_njobs; ++i) reply_job(c, g_byid[i]);
+        return;
+    }
+    if (!strcmp(line, "loglevel")) {
+        enum nk_log_level lv;
+        if (!arg || !nk_log_parse_level(arg, &lv)) {
+            reply(c, "error: unknown log level '%s'\n", arg ? arg : "");
+            return;
+        }
+        nk_log_set_level(lv);
+        gflags_debug = lv == NK_LOG_DEBUG;
+        reply(c, "ok\n");
+        return;
+    }
+    if (!strcmp(line, "metrics")) {
+        size_t len;
+        char *page = metrics_page(g_heap, &len);
+        reply(c, "%s", page);
+        free(page);
+        return;
+    }
+    if (!strcmp(line, "flush")) {
+        g_flush();
+        reply(c, "ok\n");
+        return;
+    }
+    bool run = !strcmp(line, "run"), pause = !strcmp(line, "pause");
+    bool resume = !strcmp(line, "resume"), show = !strcmp(line, "show");
+    if (!run && !pause && !resume && !show) {
+        reply(c, "error: unknown command '%s'\n", line);
+        return;
+    }
+    struct Job *j = arg ? control_find(arg) : NULL;
+    if (!j) {
+        reply(c, "error: no job '%s'\n", arg ? arg : "");
+        return;
+    }
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts))
+        suicide("clock_gettime failed: %s\n", strerror(errno));
+    if (run) {
+        // A paused job runs once and stays paused.
+        control_requeue(j, ts.tv_sec);
+        log_line("Job %d run by control request\n", j->id_);
+    } else if (pause) {
+        if (job_heap_contains(g_heap, j)) job_heap_remove(g_heap, j);
+        j->paused_ = true;
+        log_line("Job %d paused\n", j->id_);
+    } else if (resume && j->paused_) {
+        j->paused_ = false;
+        if (!j->nafter_ && (j->maxruns_ == 0 || j->numruns_ < j->maxruns_)) {
+            job_set_initial_exectime(j, &ts);
+            control_requeue(j, j->exectime_);
+        }
+        log_line("Job %d resumed\n", j->id_);
+    }
+    reply_job(c, j);
+}
+
+static void client_flush(struct ControlClient *c)
+{
+    while (c->outpos < c->nout) {
+        ssize_t r = write(c->fd, c->out + c->outpos, c->nout - c->outpos);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                struct epoll_event ev = {
+                    .events = EPOLLOUT, .data.u64 = CONTROL_EV_LISTEN + 1 + (uint64_t)(c - g_clients)
+                };
+                if (epoll_ctl(g_epfd, EPOLL_CTL_MOD, c->fd, &ev)) client_close(c);
+                return;
+            }
+            break;
+        }
+        c->outpos += (size_t)r;
+    }
+    client_close(c);
+}
+
+static void client_read(struct ControlClient *c)
+{
+    for (;;) {
+        ssize_t r = read(c->fd, c->in + c->nin, sizeof c->in - c->nin);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) client_close(c);
+            return;
+        }
+        if (!r) {
+            client_close(c);
+            return;
+        }
+        c->nin += (size_t)r;
+        char *nl = memchr(c->in, '\n', c->nin);
+        if (nl) {
+            *nl = 0;
+            if (nl > c->in && nl[-1] == '\r') nl[-1] = 0;
+            control_command(c, c->in);
+            client_flush(c);
+            return;
+        }
+        if (c->nin == sizeof c->in) {
+            reply(c, "error: command too long\n");
+            client_flush(c);
+            return;
+        }
+    }
+}
+
+static void control_accept(void)
+{
+    for (;;) {
+        int fd = accept4(g_lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN)
+                log_line("accept failed on control socket: %s\n", strerror(errno));
+            return;
+        }
+        size_t i = 0;
+        while (i < CONTROL_CLIENTS_MAX && g_clients[i].fd >= 0) ++i;
+        if (i == CONTROL_CLIENTS_MAX) {
+            close(fd);
+            continue;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = CONTROL_EV_LISTEN + 1 + i };
+        if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev)) {
+            close(fd);
+            continue;
+        }
+        g_clients[i].fd = fd;
+    }
+}
+
+void control_event(uint64_t ev, uint32_t events)
+{
+    if (ev == CONTROL_EV_LISTEN) {
+        control_accept();
+        return;
+    }
+    struct ControlClient *c = &g_clients[ev - CONTROL_EV_LISTEN - 1];
+    if (c->fd < 0) return;
+    if (events & EPOLLOUT)
+        client_flush(c);
+    else
+        client_read(c);
+}
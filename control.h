@@ -0,0 +1,27 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_CONTROL_H_
+#define NCRON_CONTROL_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+struct JobHeap;
+
+#define CONTROL_CLIENTS_MAX 16
+// epoll data values of the listening socket and its clients; pids are
+// always below these.
+#define CONTROL_EV_LISTEN ((uint64_t)1 << 32)
+#define CONTROL_EV_LAST (CONTROL_EV_LISTEN + CONTROL_CLIENTS_MAX)
+
+// Listens for commands on a Unix socket at path, with its descriptors in
+// epfd.  Jobs that are run, paused or resumed are requeued in heap, and
+// flush is called to save the history.
+void control_init(char const *path, int epfd, struct JobHeap *heap, void (*flush)(void));
+// Handles an epoll event with data value ev, which is within
+// [CONTROL_EV_LISTEN, CONTROL_EV_LAST].
+void control_event(uint64_t ev, uint32_t events);
+// Called when g_jobs has been replaced.
+void control_jobs_changed(void);
+// Removes the socket.
+void control_close(void);
+#endif
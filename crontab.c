@@ -5,13 +5,23 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
 #include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "nk/log.h"
 #include "strconv.h"
 #include "sched.h"
+#include "cache.h"
+#include "history.h"
+#include "affinity.h"
+#include "cgroup.h"
+#include "users.h"
 
 #define MAX_LINE 2048
 
@@ -22,16 +32,19 @@ extern struct Job *g_jobs;
 struct item_history {
 	time_t lasttime;
 	unsigned int numruns;
+	unsigned int interval;
 };
 
 struct ParseCfgState
 {
 	char v_str[MAX_LINE];
 	
-	struct Job **stackl;
-	struct Job **deadstackl;
-	
 	struct Job *ce;
+	struct Job *ce_end;
+	struct JobCst cst; // scratch constraints for ce; interned by finish_ce
+	const char *path;
+	struct User *user; // owner of the crontab, or NULL
+	jmp_buf fail;      // where errors in the crontab of a user land
 	
 	const char *jobid_st;
 	const char *time_st;
@@ -43,6 +56,7 @@ struct ParseCfgState
 	size_t linenum;
 	
 	unsigned int v_time;
+	unsigned int v_time_ms; // sub-second part of v_time
 	
 	int v_int1;
 	int v_int2;
@@ -59,22 +73,101 @@ struct ParseCfgState
 	bool seen_job;
 };
 
-static void ParseCfgState_init(struct ParseCfgState *self, struct Job **stk, struct Job **dstk)
+static void ParseCfgState_init(struct ParseCfgState *self, const char *path,
+struct User *user, struct Job *jobs, size_t njobs)
 {
 	*self = (struct ParseCfgState){
-		.stackl = stk,
-		.deadstackl = dstk,
+		.ce = jobs,
+		.ce_end = jobs + njobs,
+		.path = path,
+		.user = user,
 		.v_int3 = -1,
 		.v_int4 = -1,
 	};
 }
 
+// Reports an error in the crontab.  The crontab of a user is then skipped
+// by parse_config_file(); any other error is fatal.
+__attribute__((format (printf, 2, 3), noreturn))
+static void ParseCfgState_fail(struct ParseCfgState *self, const char *fmt, ...)
+{
+	char msg[MAX_LINE];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof msg, fmt, ap);
+	va_end(ap);
+	if (!self->user) suicide("%s", msg);
+		log_line("%s", msg);
+	longjmp(self->fail, 1);
+}
+
+// Index of job ids to the crontab file that defines them; shared by all
+// of the parser threads so that ids are unique across a crontab directory.
+// With --users, ids need only be unique within the crontab of each user.
+struct JobIdEnt {
+	const char *path; // NULL if the slot is empty
+	const struct User *user;
+	int id;
+};
+static struct JobIdEnt *g_id_idx;
+static size_t g_id_idx_size; // power of two
+static size_t g_id_idx_count;
+static pthread_mutex_t g_id_idx_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t job_id_slot(const struct JobIdEnt *tab, size_t size,
+const struct User *user, int id)
+{
+	size_t h = ((unsigned)id ^ (size_t)user) * 2654435761u;
+	size_t i = h & (size - 1);
+	while (tab[i].path && (tab[i].id != id || tab[i].user != user))
+	i = (i + 1) & (size - 1);
+	return i;
+}
+
+// Returns NULL, or the path of the crontab that already has the id of j.
+static const char *job_id_index_add(const struct Job *j, const char *path)
+{
+	int id = j->id_;
+	const char *r = NULL;
+	pthread_mutex_lock(&g_id_idx_mtx);
+	if ((g_id_idx_count + 1) * 2 > g_id_idx_size) {
+		size_t nsize = g_id_idx_size ? g_id_idx_size * 2 : 256;
+		struct JobIdEnt *ntab = calloc(nsize, sizeof *ntab);
+		if (!ntab) abort();
+			for (size_t i = 0; i < g_id_idx_size; ++i) {
+			if (g_id_idx[i].path)
+				ntab[job_id_slot(ntab, nsize, g_id_idx[i].user, g_id_idx[i].id)] = g_id_idx[i];
+		}
+		free(g_id_idx);
+		g_id_idx = ntab;
+		g_id_idx_size = nsize;
+	}
+	size_t i = job_id_slot(g_id_idx, g_id_idx_size, j->user_, id);
+	if (g_id_idx[i].path) {
+		r = g_id_idx[i].path;
+	} else {
+		g_id_idx[i] = (struct JobIdEnt){ .path = path, .user = j->user_, .id = id };
+		++g_id_idx_count;
+	}
+	pthread_mutex_unlock(&g_id_idx_mtx);
+	return r;
+}
+
+static void job_id_index_destroy(void)
+{
+	free(g_id_idx);
+	g_id_idx = NULL;
+	g_id_idx_size = g_id_idx_count = 0;
+}
+
 static void ParseCfgState_create_ce(struct ParseCfgState *self)
 {
-	if (self->ce == g_jobs + g_njobs) {
-		suicide("job count mismatch\n");
+	if (self->ce == self->ce_end) {
+		ParseCfgState_fail(self, "job count mismatch\n");
 	}
 	job_init(self->ce);
+	self->ce->user_ = self->user;
+	job_cst_init(&self->cst);
 	self->seen_job = true;
 	self->have_command = false;
 	self->seen_cst_hhmm = false;
@@ -87,11 +180,23 @@ static void ParseCfgState_debug_print_ce(const struct ParseCfgState *self)
 {
 	if (!gflags_debug) return;
 		const struct Job *j = self->ce;
-	log_line("id=%d:\tcommand: %s\n", j->id_, j->command_ ? j->command_ : "");
-	log_line("\targs: %s\n", j->args_ ? j->args_ : "");
-	log_line("\tnumruns: %u\n\tmaxruns: %u\n", j->numruns_, j->maxruns_);
-	log_line("\tjournal: %s\n", j->journal_ ? "true" : "false");
-	log_line("\tinterval: %u\n\texectime: %lu\n\tlasttime: %lu\n", j->interval_, j->exectime_, j->lasttime_);
+	log_debug("id=%d:\tcommand: %s\n", j->id_, j->command_ ? j->command_ : "");
+	if (j->user_) log_debug("\tuser: %s\n", j->user_->name);
+		log_debug("\targs: %s\n", j->args_ ? j->args_ : "");
+	log_debug("\tnumruns: %u\n\tmaxruns: %u\n", j->numruns_, j->maxruns_);
+	log_debug("\ttimeout: %u\n\tdeadline: %u\n", j->timeout_, j->deadline_);
+	log_debug("\tcatchup: %u\n", j->catchup_);
+	log_debug("\ton_failure_interval: %u\n\tbackoff: %u\n", j->fail_interval_, j->backoff_);
+	for (unsigned k = 0; k < j->nafter_; ++k)
+	log_debug("\tafter: %d\n", j->after_[k]);
+	log_debug("\toutput: %s (rotate at %u KiB)\n", j->output_ ? j->output_ : "",
+	j->output_max_kb_);
+	log_debug("\tcpus: %s\n", j->cpus_ ? j->cpus_ : "");
+	log_debug("\tcgroup: %s (cpu_weight %u, io_weight %u, memory_high %u KiB)\n",
+	j->cgroup_ ? j->cgroup_ : "", j->cpu_weight_, j->io_weight_, j->memory_high_kb_);
+	log_debug("\tjournal: %s\n", j->journal_ ? "true" : "false");
+	log_debug("\tinterval: %u.%03u\n\texectime: %lu\n\tlasttime: %lu\n", j->interval_,
+	j->interval_ms_, j->exectime_, j->lasttime_);
 }
 
 static void ParseCfgState_finish_ce(struct ParseCfgState *self)
@@ -101,18 +206,24 @@ static void ParseCfgState_finish_ce(struct ParseCfgState *self)
 	ParseCfgState_debug_print_ce(self);
 	
 	if (self->ce->id_ < 0
-		|| (self->ce->interval_ <= 0 && self->ce->exectime_ <= 0)
+		|| (self->ce->interval_ <= 0 && !self->ce->interval_ms_ && self->ce->exectime_ <= 0
+	&& !self->ce->nafter_)
 	|| !self->ce->command_ || !self->have_command) {
-		suicide("ERROR IN CRONTAB: invalid id, command, or interval for job %d\n", self->ce->id_);
+		ParseCfgState_fail(self, "ERROR IN CRONTAB: invalid id, command, or interval for job %d\n",
+		self->ce->id_);
 	}
 	
-	// XXX: O(n^2) might be nice to avoid.
-	for (struct Job *i = g_jobs, *iend = self->ce; i != iend; ++i) {
-		if (i->id_ == self->ce->id_) {
-			suicide("ERROR IN CRONTAB: duplicate entry for job %d\n", self->ce->id_);
-		}
+	const char *dup = job_id_index_add(self->ce, self->path);
+	if (dup) {
+		if (!strcmp(dup, self->path))
+			ParseCfgState_fail(self, "ERROR IN CRONTAB: duplicate entry for job %d\n",
+		self->ce->id_);
+		ParseCfgState_fail(self, "ERROR IN CRONTAB: duplicate entry for job %d in '%s' and '%s'\n",
+		self->ce->id_, dup, self->path);
 	}
 	
+	self->ce->cst_ = job_cst_intern(&self->cst);
+	
 	// Preserve this job and work on the next one.
 	++self->ce;
 }
@@ -128,24 +239,25 @@ struct hstm {
 static void hstm_print(const struct hstm *self)
 {
 	if (!gflags_debug) return;
-		log_line("id=%d:\tnumruns = %u\n\tlasttime = %lu\n",
-	self->id, self->h.numruns, self->h.lasttime);
+		log_debug("id=%d:\tnumruns = %u\n\tlasttime = %lu\n\tinterval = %u\n",
+	self->id, self->h.numruns, self->h.lasttime, self->h.interval);
 }
 
 
-#line 162 "crontab.rl"
+#line 280 "crontab.rl"
 
 
 
-#line 138 "crontab.c"
+#line 249 "crontab.c"
 static const signed char _history_m_actions[] = {
 	0, 1, 0, 1, 1, 1, 2, 1,
-	3, 0
+	3, 1, 4, 0
 };
 
 static const char _history_m_trans_keys[] = {
 	1, 0, 0, 0, 0, 3, 0, 0,
-	0, 1, 0, 0, 0, 0, 0
+	0, 1, 0, 0, 0, 0, 0, 1,
+	0, 0, 0
 };
 
 static const signed char _history_m_char_class[] = {
@@ -154,40 +266,45 @@ static const signed char _history_m_char_class[] = {
 };
 
 static const signed char _history_m_index_offsets[] = {
-	0, 0, 1, 5, 6, 8, 9, 0
+	0, 0, 1, 5, 6, 8, 9, 10,
+	12, 0
 };
 
 static const signed char _history_m_indices[] = {
 	2, 3, 0, 0, 4, 6, 7, 8,
-	10, 12, 0
+	10, 12, 14, 15, 17, 0
 };
 
 static const signed char _history_m_index_defaults[] = {
-	0, 0, 0, 0, 0, 0, 0, 0
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0
 };
 
 static const signed char _history_m_cond_targs[] = {
 	0, 1, 2, 2, 3, 3, 4, 4,
-	5, 5, 6, 6, 6, 0
+	5, 5, 7, 6, 8, 7, 7, 6,
+	8, 8, 0
 };
 
 static const signed char _history_m_cond_actions[] = {
-	0, 0, 1, 0, 7, 0, 1, 0,
-	5, 0, 1, 3, 0, 0
+	0, 0, 1, 0, 9, 0, 1, 0,
+	5, 0, 1, 0, 1, 3, 0, 3,
+	7, 0, 0
 };
 
 static const signed char _history_m_eof_trans[] = {
-	1, 2, 4, 6, 8, 10, 12, 0
+	1, 2, 4, 6, 8, 10, 12, 14,
+	17, 0
 };
 
 static const int history_m_start = 1;
-static const int history_m_first_final = 6;
+static const int history_m_first_final = 7;
 static const int history_m_error = 0;
 
 static const int history_m_en_main = 1;
 
 
-#line 164 "crontab.rl"
+#line 282 "crontab.rl"
 
 
 static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
@@ -196,15 +313,15 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
 	const char *eof = pe;
 	
 
-#line 194 "crontab.c"
+#line 311 "crontab.c"
 	{
 		hst->cs = (int)history_m_start;
 	}
 	
-#line 171 "crontab.rl"
+#line 289 "crontab.rl"
 
 
-#line 199 "crontab.c"
+#line 316 "crontab.c"
 	{
 		unsigned int _trans = 0;
 		const char * _keys;
@@ -248,16 +365,16 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
 				{
 					case 0:  {
 							{
-#line 138 "crontab.rl"
+#line 249 "crontab.rl"
 							hst->st = p; }
 						
-#line 245 "crontab.c"
+#line 362 "crontab.c"
 
 						break; 
 					}
 					case 1:  {
 							{
-#line 139 "crontab.rl"
+#line 250 "crontab.rl"
 							
 							if (!strconv_to_i64(hst->st, p, &hst->h.lasttime)) {
 								hst->parse_error = true;
@@ -265,13 +382,13 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
 							}
 						}
 						
-#line 258 "crontab.c"
+#line 375 "crontab.c"
 
 						break; 
 					}
 					case 2:  {
 							{
-#line 145 "crontab.rl"
+#line 256 "crontab.rl"
 							
 							if (!strconv_to_u32(hst->st, p, &hst->h.numruns)) {
 								hst->parse_error = true;
@@ -279,13 +396,27 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
 							}
 						}
 						
-#line 271 "crontab.c"
+#line 388 "crontab.c"
 
 						break; 
 					}
 					case 3:  {
 							{
-#line 151 "crontab.rl"
+#line 262 "crontab.rl"
+							
+							if (!strconv_to_u32(hst->st, p, &hst->h.interval)) {
+								hst->parse_error = true;
+								{p += 1; goto _out; }
+							}
+						}
+						
+#line 401 "crontab.c"
+
+						break; 
+					}
+					case 4:  {
+							{
+#line 268 "crontab.rl"
 							
 							if (!strconv_to_i32(hst->st, p, &hst->id)) {
 								hst->parse_error = true;
@@ -293,7 +424,7 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
 							}
 						}
 						
-#line 284 "crontab.c"
+#line 414 "crontab.c"
 
 						break; 
 					}
@@ -305,7 +436,7 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
 		}
 		
 		if ( p == eof ) {
-			if ( hst->cs >= 6 )
+			if ( hst->cs >= 7 )
 				goto _out;
 		}
 		else {
@@ -317,7 +448,7 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
 		_out: {}
 	}
 	
-#line 172 "crontab.rl"
+#line 290 "crontab.rl"
 
 	
 	if (hst->parse_error) return -1;
@@ -328,7 +459,25 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
 	return -2;
 }
 
-static void parse_history(char const *path)
+int history_parse_line(const char *p, size_t plen, int *id, unsigned int *numruns,
+time_t *lasttime, unsigned int *interval)
+{
+	struct hstm hst = { .st = NULL, .cs = 0, .id = -1, .parse_error = false };
+	int r = do_parse_history(&hst, p, plen);
+	if (r < 0) return r;
+		hstm_print(&hst);
+	*id = hst.id;
+	*numruns = hst.h.numruns;
+	*lasttime = hst.h.lasttime;
+	*interval = hst.h.interval;
+	return r;
+}
+
+// The journal is optional, and its records are only applied if they are
+// at least as recent as what is already known.  The records of a history
+// file are those of the jobs of user, if any; in the journal, the record of
+// a user's job starts with "USER:".
+static void parse_history(char const *path, const struct User *user, bool journal)
 {
 	struct timespec ts;
 	if (clock_gettime(CLOCK_REALTIME, &ts)) {
@@ -339,9 +488,12 @@ static void parse_history(char const *path)
 	char buf[MAX_LINE];
 	FILE *f = fopen(path, "r");
 	if (!f) {
-		log_line("Failed to open history file '%s' for read: %s\n", path, strerror(errno));
+		if (!journal || errno != ENOENT)
+			log_line("Failed to open history file '%s' for read: %s\n", path, strerror(errno));
 		return;
 	}
+	struct Job **byid = job_index_by_id(g_jobs, g_njobs);
+	
 	size_t linenum = 0;
 	while (fgets(buf, sizeof buf, f)) {
 		size_t llen = strlen(buf);
@@ -350,23 +502,25 @@ static void parse_history(char const *path)
 		if (buf[llen-1] == '\n')
 			buf[--llen] = 0;
 		++linenum;
-		struct hstm hst = { .st = NULL, .cs = 0, .id = -1, .parse_error = false };
-		int r = do_parse_history(&hst, buf, llen);
+		char *rec = buf;
+		char *c = journal ? memchr(buf, ':', strcspn(buf, "=")) : NULL;
+		if (c) rec = c + 1;
+			int id;
+		unsigned int numruns, interval;
+		time_t lasttime;
+		int r = history_parse_line(rec, llen - (size_t)(rec - buf), &id, &numruns,
+		&lasttime, &interval);
 		if (r < 0) {
 			log_line("%s history entry at line %zu; ignoring\n",
 			r == -2 ? "Incomplete" : "Malformed", linenum);
 			continue;
 		}
 		
-		for (struct Job *j = g_jobs, *jend = g_jobs + g_njobs; j != jend; ++j) {
-			if (j->id_ == hst.id) {
-				hstm_print(&hst);
-				j->numruns_ = hst.h.numruns;
-				j->lasttime_ = hst.h.lasttime;
-				job_set_initial_exectime(j, &ts);
-			}
+		struct Job *j = c ? job_index_find_name(byid, g_njobs, buf, (size_t)(c - buf), id)
+		: job_index_find(byid, g_njobs, user, id);
+		if (j) history_apply(j, numruns, lasttime, interval, &ts, true);
 		}
-	}
+	free(byid);
 	if (ferror(f)) {
 		log_line("IO error reading history file '%s'\n", path);
 		exit(EXIT_FAILURE);
@@ -385,11 +539,11 @@ static bool ParseCfgState_add_cst_mon(struct ParseCfgState *self)
 		if (min <= 0 || min > 12) return false;
 		if (max <= 0 || max > 12) return false;
 		if (!self->seen_cst_mon) {
-		memset(&self->ce->cst_mon_, 0, sizeof self->ce->cst_mon_);
+		memset(&self->cst.mon_, 0, sizeof self->cst.mon_);
 		self->seen_cst_mon = true;
 	}
 	for (int i = min; i <= max; ++i)
-	self->ce->cst_mon_[i - 1] = true;
+	self->cst.mon_[i - 1] = true;
 	return true;
 }
 
@@ -404,11 +558,11 @@ static bool ParseCfgState_add_cst_mday(struct ParseCfgState *self)
 		if (min <= 0 || min > 31) return false;
 		if (max <= 0 || max > 31) return false;
 		if (!self->seen_cst_mday) {
-		memset(&self->ce->cst_mday_, 0, sizeof self->ce->cst_mday_);
+		memset(&self->cst.mday_, 0, sizeof self->cst.mday_);
 		self->seen_cst_mday = true;
 	}
 	for (int i = min; i <= max; ++i)
-	self->ce->cst_mday_[i - 1] = true;
+	self->cst.mday_[i - 1] = true;
 	return true;
 }
 
@@ -423,11 +577,11 @@ static bool ParseCfgState_add_cst_wday(struct ParseCfgState *self)
 		if (min <= 0 || min > 7) return false;
 		if (max <= 0 || max > 7) return false;
 		if (!self->seen_cst_wday) {
-		memset(&self->ce->cst_wday_, 0, sizeof self->ce->cst_wday_);
+		memset(&self->cst.wday_, 0, sizeof self->cst.wday_);
 		self->seen_cst_wday = true;
 	}
 	for (int i = min; i <= max; ++i)
-	self->ce->cst_wday_[i - 1] = true;
+	self->cst.wday_[i - 1] = true;
 	return true;
 }
 
@@ -442,7 +596,7 @@ static bool ParseCfgState_add_cst_time(struct ParseCfgState *self)
 			}
 	}
 	if (!self->seen_cst_hhmm) {
-		memset(&self->ce->cst_hhmm_, 0, sizeof self->ce->cst_hhmm_);
+		memset(&self->cst.hhmm_, 0, sizeof self->cst.hhmm_);
 		self->seen_cst_hhmm = true;
 	}
 	int min = self->v_int1 * 60 + self->v_int2;
@@ -450,7 +604,7 @@ static bool ParseCfgState_add_cst_time(struct ParseCfgState *self)
 	assert(min >= 0 && min < 1440);
 	assert(max >= 0 && max < 1440);
 	for (int i = min; i <= max; ++i)
-	self->ce->cst_hhmm_[i] = true;
+	self->cst.hhmm_[i] = true;
 	return true;
 }
 
@@ -460,11 +614,11 @@ struct Pckm {
 };
 
 
-#line 359 "crontab.rl"
+#line 500 "crontab.rl"
 
 
 
-#line 451 "crontab.c"
+#line 604 "crontab.c"
 static const signed char _parse_cmd_key_m_actions[] = {
 	0, 1, 0, 1, 1, 1, 2, 2,
 	0, 2, 2, 1, 0, 2, 1, 2,
@@ -533,7 +687,7 @@ static const int parse_cmd_key_m_error = 0;
 static const int parse_cmd_key_m_en_main = 1;
 
 
-#line 361 "crontab.rl"
+#line 502 "crontab.rl"
 
 
 static void ParseCfgState_parse_command_key(struct ParseCfgState *self)
@@ -545,18 +699,18 @@ static void ParseCfgState_parse_command_key(struct ParseCfgState *self)
 	struct Pckm pckm = {0};
 	
 	if (self->have_command)
-		suicide("Duplicate 'command' value at line %zu\n", self->linenum);
+		ParseCfgState_fail(self, "Duplicate 'command' value at line %zu\n", self->linenum);
 	
 
-#line 532 "crontab.c"
+#line 685 "crontab.c"
 	{
 		pckm.cs = (int)parse_cmd_key_m_start;
 	}
 	
-#line 374 "crontab.rl"
+#line 515 "crontab.rl"
 
 
-#line 537 "crontab.c"
+#line 690 "crontab.c"
 	{
 		unsigned int _trans = 0;
 		const char * _keys;
@@ -600,16 +754,16 @@ static void ParseCfgState_parse_command_key(struct ParseCfgState *self)
 				{
 					case 0:  {
 							{
-#line 317 "crontab.rl"
+#line 458 "crontab.rl"
 							pckm.st = p; }
 						
-#line 583 "crontab.c"
+#line 736 "crontab.c"
 
 						break; 
 					}
 					case 1:  {
 							{
-#line 318 "crontab.rl"
+#line 459 "crontab.rl"
 							
 							size_t l = p > pckm.st ? (size_t)(p - pckm.st) : 0;
 							if (l) {
@@ -636,13 +790,13 @@ static void ParseCfgState_parse_command_key(struct ParseCfgState *self)
 							}
 						}
 						
-#line 615 "crontab.c"
+#line 768 "crontab.c"
 
 						break; 
 					}
 					case 2:  {
 							{
-#line 343 "crontab.rl"
+#line 484 "crontab.rl"
 							
 							size_t l = p > pckm.st ? (size_t)(p - pckm.st) : 0;
 							if (l) {
@@ -654,7 +808,7 @@ static void ParseCfgState_parse_command_key(struct ParseCfgState *self)
 							}
 						}
 						
-#line 632 "crontab.c"
+#line 785 "crontab.c"
 
 						break; 
 					}
@@ -678,79 +832,165 @@ static void ParseCfgState_parse_command_key(struct ParseCfgState *self)
 		_out: {}
 	}
 	
-#line 375 "crontab.rl"
+#line 516 "crontab.rl"
 
 	
 	if (pckm.cs == parse_cmd_key_m_error) {
-		suicide("Malformed 'command' value at line %zu\n", self->linenum);
+		ParseCfgState_fail(self, "Malformed 'command' value at line %zu\n", self->linenum);
 	} else if (pckm.cs >= parse_cmd_key_m_first_final) {
 		self->have_command = true;
 	} else {
-		suicide("Incomplete 'command' value at line %zu\n", self->linenum);
+		ParseCfgState_fail(self, "Incomplete 'command' value at line %zu\n", self->linenum);
 	}
 }
 
-static void ParseCfgState_parse_time_unit(const struct ParseCfgState *self, const char *p, unsigned unit, unsigned *dest)
+static void ParseCfgState_add_after(struct ParseCfgState *self, int id)
+{
+	struct Job *j = self->ce;
+	if (id == j->id_)
+		ParseCfgState_fail(self, "ERROR IN CRONTAB: job %d is after itself at line %zu\n",
+	id, self->linenum);
+	for (unsigned k = 0; k < j->nafter_; ++k) {
+		if (j->after_[k] == id) return;
+		}
+	if (j->nafter_ == JOB_AFTER_MAX)
+		ParseCfgState_fail(self, "ERROR IN CRONTAB: job %d has more than %d upstream jobs\n",
+	j->id_, JOB_AFTER_MAX);
+	j->after_ = realloc(j->after_, (j->nafter_ + 1) * sizeof *j->after_);
+	if (!j->after_) abort();
+		j->after_[j->nafter_++] = id;
+}
+
+static void ParseCfgState_parse_time_unit(struct ParseCfgState *self, const char *p, unsigned unit, unsigned *dest)
 {
 	unsigned t;
 	if (!strconv_to_u32(self->time_st, p - 1, &t))
-		suicide("Invalid time unit at line %zu\n", self->linenum);
+		ParseCfgState_fail(self, "Invalid time unit at line %zu\n", self->linenum);
 	*dest += unit * t;
 }
 
-static void parse_int_value(const char *p, const char *start, size_t linenum, int *dest)
+static void ParseCfgState_parse_time_ms(struct ParseCfgState *self, const char *p)
+{
+	unsigned t;
+	if (!strconv_to_u32(self->time_st, p - 2, &t))
+		ParseCfgState_fail(self, "Invalid time unit at line %zu\n", self->linenum);
+	self->v_time += t / 1000;
+	self->v_time_ms = t % 1000;
+}
+
+// Only intervals are kept to sub-second precision.
+static unsigned ParseCfgState_whole_secs(struct ParseCfgState *self)
+{
+	if (self->v_time_ms)
+		ParseCfgState_fail(self, "Time at line %zu must be in whole seconds\n", self->linenum);
+	return self->v_time;
+}
+
+static void ParseCfgState_parse_int(struct ParseCfgState *self, const char *p,
+const char *start, int *dest)
 {
 	if (!strconv_to_i32(start, p, dest))
-		suicide("Invalid integer value at line %zu\n", linenum);
+		ParseCfgState_fail(self, "Invalid integer value at line %zu\n", self->linenum);
 }
 
 static void swap_int_pair(int *a, int *b) { int t = *a; *a = *b; *b = t; }
 
 
-#line 498 "crontab.rl"
+#line 759 "crontab.rl"
 
 
 
-#line 685 "crontab.c"
+#line 873 "crontab.c"
 static const signed char _ncrontab_actions[] = {
 	0, 1, 0, 1, 1, 1, 2, 1,
 	3, 1, 4, 1, 5, 1, 6, 1,
-	7, 1, 8, 1, 12, 1, 14, 1,
-	22, 1, 23, 1, 24, 2, 1, 0,
-	2, 1, 16, 2, 2, 0, 2, 2,
-	16, 2, 3, 0, 2, 3, 16, 2,
-	4, 0, 2, 4, 16, 2, 5, 0,
-	2, 5, 16, 2, 7, 15, 2, 7,
-	17, 2, 7, 18, 2, 7, 19, 2,
-	9, 10, 2, 9, 17, 2, 9, 18,
-	2, 9, 19, 2, 11, 6, 2, 13,
-	21, 3, 9, 10, 20, 0
+	7, 1, 8, 1, 9, 1, 13, 1,
+	15, 1, 20, 1, 21, 1, 22, 1,
+	27, 1, 38, 1, 39, 1, 40, 2,
+	1, 0, 2, 1, 17, 2, 1, 18,
+	2, 1, 19, 2, 1, 23, 2, 2,
+	0, 2, 2, 17, 2, 2, 18, 2,
+	2, 19, 2, 2, 23, 2, 3, 0,
+	2, 3, 17, 2, 3, 18, 2, 3,
+	19, 2, 3, 23, 2, 4, 0, 2,
+	4, 17, 2, 4, 18, 2, 4, 19,
+	2, 4, 23, 2, 5, 0, 2, 5,
+	17, 2, 5, 18, 2, 5, 19, 2,
+	5, 23, 2, 6, 0, 2, 6, 17,
+	2, 6, 18, 2, 6, 19, 2, 6,
+	23, 2, 8, 16, 2, 8, 24, 2,
+	8, 26, 2, 8, 30, 2, 8, 31,
+	2, 8, 32, 2, 8, 33, 2, 8,
+	34, 2, 8, 35, 2, 10, 11, 2,
+	10, 33, 2, 10, 34, 2, 10, 35,
+	2, 12, 7, 2, 14, 25, 2, 14,
+	28, 2, 14, 29, 2, 14, 37, 3,
+	10, 11, 36, 0
 };
 
 static const char _ncrontab_trans_keys[] = {
-	1, 0, 3, 37, 6, 10, 24, 24,
-	22, 35, 22, 35, 13, 13, 23, 23,
-	15, 33, 2, 12, 0, 2, 13, 13,
-	32, 32, 2, 12, 2, 10, 6, 10,
-	23, 23, 27, 27, 16, 16, 25, 25,
-	29, 29, 13, 13, 21, 21, 2, 12,
-	2, 10, 6, 37, 24, 24, 28, 28,
-	25, 25, 23, 23, 13, 13, 21, 21,
-	13, 24, 31, 31, 25, 25, 28, 28,
-	23, 23, 26, 36, 2, 12, 2, 10,
-	23, 23, 27, 27, 17, 34, 2, 12,
-	2, 10, 6, 10, 18, 18, 22, 35,
-	16, 16, 2, 12, 2, 10, 6, 11,
-	11, 11, 6, 9, 6, 10, 2, 5,
-	2, 10, 6, 11, 11, 11, 6, 9,
-	6, 10, 6, 11, 6, 11, 16, 16,
-	16, 16, 20, 20, 15, 33, 13, 13,
-	32, 32, 2, 12, 2, 10, 6, 10,
-	6, 10, 1, 0, 0, 0, 0, 2,
-	5, 10, 6, 10, 2, 10, 2, 10,
-	2, 10, 2, 10, 2, 10, 1, 0,
-	6, 10, 5, 10, 6, 10, 2, 5,
-	1, 0, 5, 10, 6, 10, 0
+	1, 0, 3, 44, 7, 11, 19, 19,
+	32, 32, 18, 18, 30, 30, 2, 13,
+	2, 11, 2, 5, 14, 14, 16, 16,
+	24, 24, 28, 28, 19, 19, 19, 19,
+	2, 13, 2, 11, 14, 29, 32, 32,
+	16, 16, 21, 41, 33, 33, 29, 29,
+	2, 13, 2, 43, 27, 27, 16, 16,
+	18, 18, 24, 32, 22, 22, 29, 29,
+	14, 14, 20, 20, 20, 20, 18, 18,
+	30, 30, 30, 30, 28, 28, 33, 33,
+	29, 29, 2, 13, 0, 2, 26, 42,
+	26, 42, 14, 14, 27, 27, 17, 40,
+	2, 13, 0, 2, 33, 33, 31, 43,
+	2, 13, 0, 2, 35, 44, 18, 18,
+	22, 22, 20, 20, 21, 41, 32, 32,
+	2, 13, 2, 11, 14, 18, 37, 37,
+	2, 13, 2, 11, 7, 11, 14, 14,
+	17, 40, 25, 25, 22, 22, 27, 27,
+	18, 18, 2, 13, 2, 11, 7, 44,
+	27, 28, 32, 32, 18, 18, 30, 30,
+	34, 34, 14, 14, 25, 25, 2, 13,
+	2, 11, 7, 44, 39, 39, 35, 44,
+	18, 18, 22, 22, 20, 20, 21, 41,
+	32, 32, 2, 13, 2, 11, 28, 28,
+	33, 33, 30, 30, 27, 27, 14, 14,
+	25, 25, 14, 28, 36, 36, 30, 30,
+	33, 33, 27, 27, 31, 43, 2, 13,
+	2, 11, 26, 42, 28, 28, 30, 30,
+	37, 37, 39, 39, 21, 41, 22, 22,
+	20, 20, 21, 41, 2, 13, 2, 11,
+	27, 27, 32, 32, 21, 41, 2, 13,
+	2, 11, 7, 11, 27, 33, 39, 39,
+	19, 19, 14, 14, 22, 22, 25, 25,
+	33, 33, 30, 30, 18, 18, 39, 39,
+	22, 22, 27, 27, 32, 32, 18, 18,
+	30, 30, 34, 34, 14, 14, 25, 25,
+	2, 13, 2, 11, 7, 44, 32, 32,
+	29, 29, 33, 33, 32, 32, 2, 39,
+	2, 13, 0, 2, 31, 43, 22, 22,
+	38, 38, 18, 18, 2, 13, 2, 11,
+	22, 22, 26, 42, 18, 18, 2, 28,
+	2, 13, 2, 11, 7, 12, 12, 12,
+	7, 10, 7, 11, 2, 6, 2, 11,
+	7, 12, 12, 12, 7, 10, 7, 11,
+	7, 12, 7, 12, 33, 33, 32, 32,
+	2, 13, 2, 11, 7, 44, 18, 18,
+	18, 18, 24, 24, 17, 40, 14, 14,
+	37, 37, 2, 13, 2, 11, 7, 11,
+	7, 11, 1, 0, 2, 11, 7, 11,
+	1, 0, 1, 0, 1, 0, 0, 0,
+	0, 2, 0, 0, 0, 2, 0, 0,
+	0, 2, 7, 11, 6, 11, 7, 11,
+	2, 11, 2, 11, 2, 43, 2, 11,
+	2, 11, 2, 11, 2, 11, 2, 11,
+	2, 43, 2, 11, 2, 11, 2, 11,
+	7, 11, 1, 0, 7, 11, 7, 11,
+	6, 11, 7, 11, 2, 11, 2, 11,
+	2, 43, 2, 11, 2, 11, 2, 11,
+	0, 0, 0, 2, 7, 11, 2, 6,
+	1, 0, 2, 11, 2, 11, 2, 43,
+	2, 11, 2, 11, 2, 11, 6, 11,
+	7, 11, 0
 };
 
 static const signed char _ncrontab_char_class[] = {
@@ -759,106 +999,282 @@ static const signed char _ncrontab_char_class[] = {
 	1, 1, 1, 1, 1, 1, 1, 1,
 	1, 1, 1, 1, 1, 1, 1, 1,
 	2, 3, 1, 4, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 5, 1, 1,
-	6, 6, 7, 8, 9, 9, 10, 10,
-	10, 10, 11, 4, 1, 12, 1, 1,
-	1, 13, 1, 14, 15, 16, 1, 1,
-	17, 18, 19, 20, 21, 22, 23, 24,
-	1, 1, 25, 26, 27, 28, 29, 30,
-	31, 32, 1, 1, 1, 1, 1, 1,
-	1, 13, 1, 14, 33, 16, 1, 1,
-	34, 18, 19, 20, 21, 35, 23, 24,
-	1, 1, 25, 36, 27, 28, 29, 37,
-	31, 32, 0
+	1, 1, 1, 1, 5, 6, 1, 1,
+	7, 7, 8, 9, 10, 10, 11, 11,
+	11, 11, 12, 4, 1, 13, 1, 1,
+	1, 14, 15, 16, 17, 18, 19, 20,
+	21, 22, 23, 24, 25, 26, 27, 28,
+	29, 1, 30, 31, 32, 33, 34, 35,
+	36, 37, 38, 1, 1, 1, 1, 39,
+	1, 14, 15, 16, 40, 18, 19, 20,
+	41, 22, 23, 24, 25, 42, 27, 28,
+	29, 1, 30, 43, 32, 33, 34, 44,
+	36, 37, 38, 0
 };
 
 static const short _ncrontab_index_offsets[] = {
-	0, 0, 35, 40, 41, 55, 69, 70,
-	71, 90, 101, 104, 105, 106, 117, 126,
-	131, 132, 133, 134, 135, 136, 137, 138,
-	149, 158, 190, 191, 192, 193, 194, 195,
-	196, 208, 209, 210, 211, 212, 223, 234,
-	243, 244, 245, 263, 274, 283, 288, 289,
-	303, 304, 315, 324, 330, 331, 335, 340,
-	344, 353, 359, 360, 364, 369, 375, 381,
-	382, 383, 384, 403, 404, 405, 416, 425,
-	430, 435, 435, 436, 439, 445, 450, 459,
-	468, 477, 486, 495, 495, 500, 506, 511,
-	515, 515, 521, 0
+	0, 0, 42, 47, 48, 49, 50, 51,
+	63, 73, 77, 78, 79, 80, 81, 82,
+	83, 95, 105, 121, 122, 123, 144, 145,
+	146, 158, 200, 201, 202, 203, 212, 213,
+	214, 215, 216, 217, 218, 219, 220, 221,
+	222, 223, 235, 238, 255, 272, 273, 274,
+	298, 310, 313, 314, 327, 339, 342, 352,
+	353, 354, 355, 376, 377, 389, 399, 404,
+	405, 417, 427, 432, 433, 457, 458, 459,
+	460, 461, 473, 483, 521, 523, 524, 525,
+	526, 527, 528, 529, 541, 551, 589, 590,
+	600, 601, 602, 603, 624, 625, 637, 647,
+	648, 649, 650, 651, 652, 653, 668, 669,
+	670, 671, 672, 685, 697, 707, 724, 725,
+	726, 727, 728, 749, 750, 751, 772, 784,
+	794, 795, 796, 817, 829, 839, 844, 851,
+	852, 853, 854, 855, 856, 857, 858, 859,
+	860, 861, 862, 863, 864, 865, 866, 867,
+	868, 880, 890, 928, 929, 930, 931, 932,
+	970, 982, 985, 998, 999, 1000, 1001, 1013,
+	1023, 1024, 1041, 1042, 1069, 1081, 1091, 1097,
+	1098, 1102, 1107, 1112, 1122, 1128, 1129, 1133,
+	1138, 1144, 1150, 1151, 1152, 1164, 1174, 1212,
+	1213, 1214, 1215, 1239, 1240, 1241, 1253, 1263,
+	1268, 1273, 1273, 1283, 1288, 1288, 1288, 1288,
+	1289, 1292, 1293, 1296, 1297, 1300, 1305, 1311,
+	1316, 1326, 1336, 1378, 1388, 1398, 1408, 1418,
+	1428, 1470, 1480, 1490, 1500, 1505, 1505, 1510,
+	1515, 1521, 1526, 1536, 1546, 1588, 1598, 1608,
+	1618, 1619, 1622, 1627, 1632, 1632, 1642, 1652,
+	1694, 1704, 1714, 1724, 1730, 0
 };
 
 static const short _ncrontab_indices[] = {
 	2, 3, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 4, 5, 0, 0, 6,
-	7, 0, 0, 8, 0, 0, 0, 0,
-	9, 0, 0, 10, 0, 0, 5, 0,
-	8, 0, 10, 12, 12, 12, 12, 12,
-	13, 14, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 14, 15,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 15, 16, 17, 18,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 18, 18, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 19, 0, 20, 21,
-	22, 23, 23, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 24, 24, 0, 0,
-	0, 25, 25, 25, 25, 25, 27, 27,
-	27, 27, 27, 28, 29, 30, 31, 32,
-	33, 34, 34, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 35, 35, 0, 0,
-	0, 36, 36, 36, 36, 36, 37, 37,
-	37, 37, 37, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 38, 39, 40, 41, 42, 43, 44,
-	45, 46, 47, 48, 49, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 50,
-	51, 52, 53, 54, 55, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 55, 55,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 56, 56, 0, 0, 0, 57, 57,
-	57, 57, 57, 58, 59, 60, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 60, 60,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 61, 61, 0, 0, 0, 62, 62,
-	62, 62, 62, 64, 64, 64, 64, 64,
-	65, 66, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 66, 67,
-	67, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 68, 68, 0, 0, 0, 69,
-	70, 71, 71, 71, 73, 73, 73, 73,
-	73, 74, 74, 76, 76, 76, 76, 78,
-	78, 78, 78, 78, 79, 0, 0, 80,
-	80, 0, 0, 0, 81, 82, 83, 83,
-	83, 85, 85, 85, 85, 85, 86, 86,
-	88, 88, 88, 88, 90, 90, 90, 90,
-	90, 85, 85, 85, 0, 0, 86, 73,
-	73, 73, 0, 0, 74, 93, 94, 95,
-	96, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 96, 97, 98, 98, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 99,
-	99, 0, 0, 0, 100, 100, 100, 100,
-	100, 102, 102, 102, 102, 102, 104, 104,
-	104, 104, 104, 0, 0, 20, 21, 109,
-	110, 110, 110, 110, 110, 112, 112, 112,
-	112, 112, 114, 0, 0, 0, 115, 115,
-	115, 115, 115, 117, 0, 0, 0, 118,
-	118, 118, 118, 118, 120, 0, 0, 0,
-	121, 121, 121, 121, 121, 123, 0, 0,
-	0, 124, 124, 124, 124, 124, 126, 0,
-	0, 0, 127, 127, 127, 127, 127, 130,
-	130, 130, 130, 130, 132, 133, 133, 133,
-	133, 133, 135, 135, 135, 135, 135, 137,
-	0, 0, 138, 141, 142, 142, 142, 142,
-	142, 144, 144, 144, 144, 144, 0
+	0, 0, 0, 4, 5, 6, 7, 0,
+	0, 0, 0, 8, 9, 0, 0, 10,
+	0, 11, 0, 0, 0, 12, 0, 0,
+	13, 0, 0, 0, 0, 7, 0, 10,
+	0, 13, 15, 15, 15, 15, 15, 16,
+	17, 18, 19, 19, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 20, 20,
+	0, 0, 0, 0, 21, 21, 21, 21,
+	21, 22, 0, 0, 20, 23, 24, 25,
+	26, 27, 28, 28, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 29, 29,
+	0, 0, 0, 0, 30, 30, 30, 30,
+	30, 31, 0, 0, 0, 0, 0, 32,
+	0, 0, 0, 0, 0, 0, 0, 33,
+	34, 35, 36, 37, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 37,
+	38, 39, 39, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 40, 40, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	41, 0, 0, 42, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 42,
+	43, 44, 45, 46, 0, 0, 0, 0,
+	0, 0, 0, 47, 48, 49, 50, 51,
+	52, 53, 54, 55, 56, 57, 58, 58,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 59, 0, 60, 61, 62, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 62, 63,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 63,
+	64, 65, 66, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 66, 66, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 67, 0, 68,
+	69, 70, 71, 0, 0, 0, 0, 0,
+	0, 0, 72, 0, 0, 0, 71, 71,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 73, 0, 74, 75, 76, 0,
+	0, 0, 0, 0, 0, 0, 0, 76,
+	77, 78, 79, 80, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 80,
+	81, 81, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 82, 82, 0, 0,
+	0, 0, 83, 83, 83, 83, 83, 84,
+	0, 0, 0, 85, 86, 86, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	87, 87, 0, 0, 0, 0, 88, 88,
+	88, 88, 88, 90, 90, 90, 90, 90,
+	91, 92, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	92, 93, 94, 95, 96, 96, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	97, 97, 0, 0, 0, 0, 98, 98,
+	98, 98, 98, 99, 99, 99, 99, 99,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 100, 101, 102, 103,
+	104, 105, 106, 107, 108, 109, 110, 111,
+	112, 112, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 113, 113, 0, 0,
+	0, 0, 114, 114, 114, 114, 114, 115,
+	115, 115, 115, 115, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	116, 117, 118, 119, 120, 121, 122, 0,
+	0, 0, 0, 0, 0, 0, 0, 122,
+	123, 124, 125, 126, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 126,
+	127, 127, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 128, 128, 0, 0,
+	0, 0, 129, 129, 129, 129, 129, 130,
+	131, 132, 133, 134, 135, 136, 0, 0,
+	0, 137, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 138, 139, 140, 141, 142,
+	143, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 143, 143, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	144, 144, 0, 0, 0, 0, 145, 145,
+	145, 145, 145, 146, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 146, 147, 148, 149, 150,
+	151, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 151, 152, 153, 154,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 154, 154, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 155,
+	155, 0, 0, 0, 0, 156, 156, 156,
+	156, 156, 157, 158, 159, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	159, 159, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 160, 160, 0, 0,
+	0, 0, 161, 161, 161, 161, 161, 163,
+	163, 163, 163, 163, 164, 0, 0, 0,
+	0, 0, 165, 166, 167, 168, 169, 170,
+	171, 172, 173, 174, 175, 176, 177, 178,
+	179, 180, 181, 182, 182, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 183,
+	183, 0, 0, 0, 0, 184, 184, 184,
+	184, 184, 185, 185, 185, 185, 185, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 186, 187, 188, 189, 190,
+	191, 192, 193, 194, 195, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 196,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 197, 195, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 196, 0, 198,
+	199, 200, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 200, 201, 202,
+	203, 203, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 204, 204, 0, 0,
+	0, 0, 205, 205, 205, 205, 205, 206,
+	207, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	207, 208, 209, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 210, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 211, 209, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	210, 210, 0, 0, 0, 0, 212, 213,
+	214, 214, 214, 216, 216, 216, 216, 216,
+	217, 217, 219, 219, 219, 219, 221, 221,
+	221, 221, 221, 222, 0, 0, 0, 223,
+	223, 0, 0, 0, 0, 224, 225, 226,
+	226, 226, 228, 228, 228, 228, 228, 229,
+	229, 231, 231, 231, 231, 233, 233, 233,
+	233, 233, 228, 228, 228, 0, 0, 229,
+	216, 216, 216, 0, 0, 217, 236, 237,
+	237, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 238, 238, 0, 0, 0,
+	0, 239, 239, 239, 239, 239, 240, 240,
+	240, 240, 240, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 241,
+	242, 243, 244, 245, 246, 247, 248, 249,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 249, 250,
+	251, 251, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 252, 252, 0, 0,
+	0, 0, 253, 253, 253, 253, 253, 255,
+	255, 255, 255, 255, 257, 257, 257, 257,
+	257, 259, 0, 0, 260, 0, 261, 261,
+	261, 261, 261, 263, 263, 263, 263, 263,
+	0, 0, 60, 61, 0, 0, 68, 69,
+	0, 0, 74, 75, 277, 277, 277, 277,
+	277, 279, 280, 280, 280, 280, 280, 282,
+	282, 282, 282, 282, 284, 0, 0, 0,
+	0, 285, 285, 285, 285, 285, 287, 0,
+	0, 0, 0, 288, 288, 288, 288, 288,
+	290, 0, 0, 0, 0, 291, 291, 291,
+	291, 291, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 292, 294, 0, 0, 0, 0, 295,
+	295, 295, 295, 295, 297, 0, 0, 0,
+	0, 298, 298, 298, 298, 298, 300, 0,
+	0, 0, 0, 301, 301, 301, 301, 301,
+	303, 0, 0, 0, 0, 304, 304, 304,
+	304, 304, 306, 0, 0, 0, 0, 307,
+	307, 307, 307, 307, 309, 0, 0, 0,
+	0, 310, 310, 310, 310, 310, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 311, 313, 0,
+	0, 0, 0, 314, 314, 314, 314, 314,
+	316, 0, 0, 0, 0, 317, 317, 317,
+	317, 317, 319, 0, 0, 0, 0, 320,
+	320, 320, 320, 320, 322, 322, 322, 322,
+	322, 325, 325, 325, 325, 325, 327, 327,
+	327, 327, 327, 329, 330, 330, 330, 330,
+	330, 332, 332, 332, 332, 332, 334, 0,
+	0, 0, 0, 335, 335, 335, 335, 335,
+	337, 0, 0, 0, 0, 338, 338, 338,
+	338, 338, 340, 0, 0, 0, 0, 341,
+	341, 341, 341, 341, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 342, 344, 0, 0, 0,
+	0, 345, 345, 345, 345, 345, 347, 0,
+	0, 0, 0, 348, 348, 348, 348, 348,
+	350, 0, 0, 0, 0, 351, 351, 351,
+	351, 351, 0, 0, 198, 199, 356, 356,
+	356, 356, 356, 358, 0, 0, 0, 359,
+	362, 0, 0, 0, 0, 363, 363, 363,
+	363, 363, 365, 0, 0, 0, 0, 366,
+	366, 366, 366, 366, 368, 0, 0, 0,
+	0, 369, 369, 369, 369, 369, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 370, 372, 0,
+	0, 0, 0, 373, 373, 373, 373, 373,
+	375, 0, 0, 0, 0, 376, 376, 376,
+	376, 376, 378, 0, 0, 0, 0, 379,
+	379, 379, 379, 379, 381, 382, 382, 382,
+	382, 382, 384, 384, 384, 384, 384, 0
 };
 
-static const signed char _ncrontab_index_defaults[] = {
+static const short _ncrontab_index_defaults[] = {
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 60, 0, 0, 0, 0, 0,
+	0, 68, 0, 0, 0, 74, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 20, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0,
@@ -866,78 +1282,170 @@ static const signed char _ncrontab_index_defaults[] = {
 	0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 3, 106, 20, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 198, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 3, 0, 0, 0, 0, 0, 268,
+	60, 271, 68, 274, 74, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	353, 198, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0
 };
 
-static const signed char _ncrontab_cond_targs[] = {
-	0, 1, 2, 73, 3, 11, 16, 26,
-	32, 46, 63, 2, 72, 4, 5, 6,
-	7, 8, 9, 10, 74, 75, 12, 13,
-	14, 76, 15, 77, 17, 18, 19, 20,
-	21, 22, 23, 24, 25, 25, 78, 79,
-	80, 81, 82, 27, 28, 29, 30, 31,
-	83, 33, 40, 34, 35, 36, 37, 38,
-	39, 84, 41, 42, 43, 44, 85, 45,
-	86, 47, 48, 49, 50, 51, 62, 52,
-	51, 52, 53, 53, 54, 54, 87, 55,
-	56, 57, 61, 58, 57, 58, 59, 59,
-	60, 60, 88, 61, 62, 64, 65, 66,
-	67, 68, 69, 70, 89, 71, 90, 72,
-	72, 74, 74, 75, 76, 15, 76, 77,
-	77, 78, 24, 25, 79, 24, 25, 80,
-	24, 25, 81, 24, 25, 82, 24, 25,
-	83, 84, 84, 85, 45, 85, 86, 86,
-	87, 55, 56, 88, 89, 71, 89, 90,
-	90, 0
+static const short _ncrontab_cond_targs[] = {
+	0, 1, 2, 193, 3, 10, 18, 62,
+	76, 95, 101, 126, 160, 183, 2, 192,
+	4, 5, 6, 7, 8, 194, 9, 11,
+	12, 13, 14, 15, 16, 17, 195, 19,
+	37, 43, 50, 20, 21, 22, 23, 24,
+	25, 26, 29, 27, 28, 196, 30, 32,
+	31, 197, 33, 34, 35, 36, 198, 38,
+	39, 40, 41, 42, 199, 200, 44, 45,
+	46, 47, 48, 49, 201, 202, 51, 52,
+	54, 53, 203, 204, 55, 56, 57, 58,
+	59, 60, 61, 205, 63, 67, 64, 65,
+	206, 66, 207, 68, 69, 70, 71, 72,
+	73, 74, 75, 75, 208, 209, 210, 212,
+	213, 77, 86, 78, 79, 80, 81, 82,
+	83, 84, 85, 85, 214, 215, 216, 218,
+	219, 87, 88, 89, 90, 91, 92, 93,
+	94, 220, 96, 97, 98, 99, 100, 221,
+	102, 109, 120, 103, 104, 105, 106, 107,
+	108, 222, 110, 111, 112, 113, 114, 115,
+	116, 117, 118, 119, 223, 121, 122, 123,
+	124, 224, 125, 225, 127, 147, 128, 129,
+	130, 131, 132, 133, 134, 135, 136, 137,
+	138, 139, 140, 141, 142, 143, 144, 145,
+	146, 146, 226, 227, 228, 230, 231, 148,
+	149, 150, 151, 152, 153, 154, 232, 233,
+	155, 156, 157, 158, 159, 234, 161, 162,
+	163, 164, 165, 178, 166, 177, 167, 166,
+	167, 168, 168, 169, 169, 235, 170, 171,
+	172, 176, 173, 172, 173, 174, 174, 175,
+	175, 236, 176, 177, 179, 180, 181, 182,
+	182, 237, 238, 239, 241, 242, 184, 185,
+	186, 187, 188, 189, 190, 243, 191, 244,
+	192, 192, 194, 9, 8, 194, 195, 195,
+	196, 197, 198, 199, 199, 200, 201, 201,
+	202, 203, 203, 204, 205, 205, 206, 66,
+	206, 207, 207, 208, 74, 75, 209, 74,
+	75, 210, 74, 75, 211, 211, 74, 75,
+	212, 74, 75, 213, 74, 75, 214, 84,
+	85, 215, 84, 85, 216, 84, 85, 217,
+	217, 84, 85, 218, 84, 85, 219, 84,
+	85, 220, 220, 221, 222, 222, 223, 223,
+	224, 125, 224, 225, 225, 226, 145, 146,
+	227, 145, 146, 228, 145, 146, 229, 229,
+	145, 146, 230, 145, 146, 231, 145, 146,
+	232, 232, 233, 234, 234, 235, 170, 171,
+	236, 237, 181, 182, 238, 181, 182, 239,
+	181, 182, 240, 240, 181, 182, 241, 181,
+	182, 242, 181, 182, 243, 191, 243, 244,
+	244, 0
 };
 
-static const signed char _ncrontab_cond_actions[] = {
-	0, 0, 27, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 23, 0, 0, 0,
-	0, 0, 0, 0, 19, 19, 0, 0,
-	0, 13, 0, 17, 0, 0, 0, 0,
-	0, 0, 0, 0, 1, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 0, 0, 0, 0,
-	0, 13, 0, 0, 0, 0, 13, 0,
-	17, 0, 0, 0, 0, 83, 83, 83,
-	0, 0, 15, 0, 17, 0, 0, 0,
-	0, 13, 13, 13, 0, 0, 15, 0,
-	17, 0, 0, 0, 0, 0, 0, 0,
-	0, 0, 0, 0, 13, 0, 17, 25,
-	0, 86, 0, 86, 65, 15, 0, 77,
-	0, 50, 9, 47, 44, 7, 41, 38,
-	5, 35, 32, 3, 29, 56, 11, 53,
-	21, 59, 0, 62, 15, 0, 74, 0,
-	89, 71, 71, 89, 68, 15, 0, 80,
+static const short _ncrontab_cond_actions[] = {
+	0, 0, 37, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 33,
+	0, 0, 0, 0, 0, 15, 0, 0,
+	0, 0, 0, 0, 0, 0, 15, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 21, 21, 0, 0,
+	0, 0, 0, 0, 21, 21, 0, 0,
+	0, 0, 21, 21, 0, 0, 0, 0,
+	0, 0, 0, 15, 0, 0, 0, 0,
+	15, 0, 19, 0, 0, 0, 0, 0,
+	0, 0, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 15, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 15, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 15, 0, 0, 0,
+	0, 15, 0, 19, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	1, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 21, 21,
+	0, 0, 0, 0, 0, 15, 0, 0,
+	0, 0, 0, 0, 168, 168, 168, 0,
+	0, 17, 0, 19, 0, 0, 0, 0,
+	15, 15, 15, 0, 0, 17, 0, 19,
+	0, 0, 0, 0, 0, 0, 0, 1,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 15, 0, 19,
+	35, 0, 31, 31, 31, 0, 132, 0,
+	25, 27, 29, 177, 0, 177, 180, 0,
+	180, 174, 0, 174, 138, 0, 150, 17,
+	0, 162, 0, 108, 11, 99, 93, 9,
+	84, 78, 7, 69, 0, 48, 3, 39,
+	63, 5, 54, 123, 13, 114, 102, 11,
+	99, 87, 9, 84, 72, 7, 69, 0,
+	42, 3, 39, 57, 5, 54, 117, 13,
+	114, 141, 0, 23, 129, 0, 144, 0,
+	147, 17, 0, 159, 0, 111, 11, 99,
+	96, 9, 84, 81, 7, 69, 0, 51,
+	3, 39, 66, 5, 54, 126, 13, 114,
+	171, 0, 171, 135, 0, 183, 156, 156,
+	183, 105, 11, 99, 90, 9, 84, 75,
+	7, 69, 0, 45, 3, 39, 60, 5,
+	54, 120, 13, 114, 153, 17, 0, 165,
 	0, 0
 };
 
 static const short _ncrontab_eof_trans[] = {
-	1, 2, 12, 5, 14, 15, 16, 17,
-	18, 19, 20, 6, 23, 24, 25, 27,
-	7, 29, 30, 31, 32, 33, 34, 35,
-	36, 38, 8, 44, 45, 46, 47, 48,
-	9, 50, 52, 53, 54, 55, 56, 57,
-	51, 59, 60, 61, 62, 64, 10, 66,
-	67, 68, 69, 73, 74, 76, 78, 80,
-	81, 85, 86, 88, 90, 92, 93, 11,
-	94, 95, 96, 97, 98, 99, 100, 102,
-	104, 4, 106, 108, 109, 112, 114, 117,
-	120, 123, 126, 129, 130, 132, 135, 137,
-	140, 141, 144, 0
+	1, 2, 15, 5, 17, 18, 19, 20,
+	21, 23, 6, 24, 25, 26, 27, 28,
+	29, 30, 7, 32, 36, 37, 38, 39,
+	40, 41, 42, 44, 45, 43, 47, 49,
+	48, 51, 52, 53, 54, 33, 56, 57,
+	58, 59, 60, 34, 63, 64, 65, 66,
+	67, 68, 35, 71, 72, 74, 73, 77,
+	78, 79, 80, 81, 82, 83, 8, 85,
+	87, 88, 90, 86, 92, 93, 94, 95,
+	96, 97, 98, 100, 9, 106, 108, 109,
+	110, 111, 112, 113, 114, 116, 107, 122,
+	123, 124, 125, 126, 127, 128, 129, 10,
+	131, 132, 133, 134, 135, 11, 137, 140,
+	141, 142, 143, 144, 145, 138, 147, 148,
+	149, 150, 151, 152, 153, 154, 155, 156,
+	139, 158, 159, 160, 161, 163, 12, 165,
+	167, 168, 169, 170, 171, 172, 173, 174,
+	175, 176, 177, 178, 179, 180, 181, 182,
+	183, 184, 186, 166, 192, 193, 194, 195,
+	196, 197, 198, 201, 202, 203, 204, 205,
+	13, 207, 208, 209, 210, 211, 216, 217,
+	219, 221, 223, 224, 228, 229, 231, 233,
+	235, 236, 212, 237, 238, 239, 241, 14,
+	247, 248, 249, 250, 251, 252, 253, 255,
+	257, 4, 259, 263, 265, 266, 267, 268,
+	270, 271, 273, 274, 276, 277, 279, 282,
+	284, 287, 290, 294, 297, 300, 303, 306,
+	309, 313, 316, 319, 322, 324, 325, 327,
+	329, 332, 334, 337, 340, 344, 347, 350,
+	353, 355, 356, 358, 361, 362, 365, 368,
+	372, 375, 378, 381, 384, 0
 };
 
 static const int ncrontab_start = 1;
-static const int ncrontab_first_final = 72;
+static const int ncrontab_first_final = 192;
 static const int ncrontab_error = 0;
 
 static const int ncrontab_en_main = 1;
 
 
-#line 500 "crontab.rl"
+#line 761 "crontab.rl"
 
 
 static int do_parse_config(struct ParseCfgState *ncs, const char *p, size_t plen)
@@ -946,15 +1454,15 @@ static int do_parse_config(struct ParseCfgState *ncs, const char *p, size_t plen
 	const char *eof = pe;
 	
 
-#line 917 "crontab.c"
+#line 1424 "crontab.c"
 	{
 		ncs->cs = (int)ncrontab_start;
 	}
 	
-#line 507 "crontab.rl"
+#line 768 "crontab.rl"
 
 
-#line 922 "crontab.c"
+#line 1429 "crontab.c"
 	{
 		unsigned int _trans = 0;
 		const char * _keys;
@@ -974,7 +1482,7 @@ static int do_parse_config(struct ParseCfgState *ncs, const char *p, size_t plen
 			_keys = ( _ncrontab_trans_keys + ((ncs->cs<<1)));
 			_inds = ( _ncrontab_indices + (_ncrontab_index_offsets[ncs->cs]));
 			
-			if ( ( (*( p))) <= 121 && ( (*( p))) >= 0 ) {
+			if ( ( (*( p))) <= 122 && ( (*( p))) >= 0 ) {
 				_ic = (int)_ncrontab_char_class[(int)( (*( p))) - 0];
 				if ( _ic <= (int)(*( _keys+1)) && _ic >= (int)(*( _keys)) )
 					_trans = (unsigned int)(*( _inds + (int)( _ic - (int)(*( _keys)) ) )); 
@@ -998,244 +1506,428 @@ static int do_parse_config(struct ParseCfgState *ncs, const char *p, size_t plen
 				{
 					case 0:  {
 							{
-#line 409 "crontab.rl"
-							ncs->time_st = p; ncs->v_time = 0; }
+#line 585 "crontab.rl"
+							ncs->time_st = p; ncs->v_time = 0; ncs->v_time_ms = 0; }
 						
-#line 968 "crontab.c"
+#line 1475 "crontab.c"
 
 						break; 
 					}
 					case 1:  {
 							{
-#line 410 "crontab.rl"
-							ParseCfgState_parse_time_unit(ncs, p, 1, &ncs->v_time); }
+#line 586 "crontab.rl"
+							ParseCfgState_parse_time_ms(ncs, p); }
 						
-#line 976 "crontab.c"
+#line 1483 "crontab.c"
 
 						break; 
 					}
 					case 2:  {
 							{
-#line 411 "crontab.rl"
-							ParseCfgState_parse_time_unit(ncs, p, 60, &ncs->v_time); }
+#line 587 "crontab.rl"
+							ParseCfgState_parse_time_unit(ncs, p, 1, &ncs->v_time); }
 						
-#line 984 "crontab.c"
+#line 1491 "crontab.c"
 
 						break; 
 					}
 					case 3:  {
 							{
-#line 412 "crontab.rl"
-							ParseCfgState_parse_time_unit(ncs, p, 3600, &ncs->v_time); }
+#line 588 "crontab.rl"
+							ParseCfgState_parse_time_unit(ncs, p, 60, &ncs->v_time); }
 						
-#line 992 "crontab.c"
+#line 1499 "crontab.c"
 
 						break; 
 					}
 					case 4:  {
 							{
-#line 413 "crontab.rl"
-							ParseCfgState_parse_time_unit(ncs, p, 86400, &ncs->v_time); }
+#line 589 "crontab.rl"
+							ParseCfgState_parse_time_unit(ncs, p, 3600, &ncs->v_time); }
 						
-#line 1000 "crontab.c"
+#line 1507 "crontab.c"
 
 						break; 
 					}
 					case 5:  {
 							{
-#line 414 "crontab.rl"
-							ParseCfgState_parse_time_unit(ncs, p, 604800, &ncs->v_time); }
+#line 590 "crontab.rl"
+							ParseCfgState_parse_time_unit(ncs, p, 86400, &ncs->v_time); }
 						
-#line 1008 "crontab.c"
+#line 1515 "crontab.c"
 
 						break; 
 					}
 					case 6:  {
 							{
-#line 416 "crontab.rl"
+#line 591 "crontab.rl"
+							ParseCfgState_parse_time_unit(ncs, p, 604800, &ncs->v_time); }
+						
+#line 1523 "crontab.c"
+
+						break; 
+					}
+					case 7:  {
+							{
+#line 593 "crontab.rl"
 							
 							ncs->intv_st = p;
 							ncs->v_int1 = ncs->v_int2 = 0;
 							ncs->intv2_exist = false;
 						}
 						
-#line 1020 "crontab.c"
+#line 1535 "crontab.c"
 
 						break; 
 					}
-					case 7:  {
+					case 8:  {
 							{
-#line 421 "crontab.rl"
-							parse_int_value(p, ncs->intv_st, ncs->linenum, &ncs->v_int1); }
+#line 598 "crontab.rl"
+							ParseCfgState_parse_int(ncs, p, ncs->intv_st, &ncs->v_int1); }
 						
-#line 1028 "crontab.c"
+#line 1543 "crontab.c"
 
 						break; 
 					}
-					case 8:  {
+					case 9:  {
 							{
-#line 422 "crontab.rl"
+#line 599 "crontab.rl"
 							ncs->intv2_st = p; }
 						
-#line 1036 "crontab.c"
+#line 1551 "crontab.c"
 
 						break; 
 					}
-					case 9:  {
+					case 10:  {
 							{
-#line 423 "crontab.rl"
-							parse_int_value(p, ncs->intv2_st, ncs->linenum, &ncs->v_int2); ncs->intv2_exist = true; }
+#line 600 "crontab.rl"
+							ParseCfgState_parse_int(ncs, p, ncs->intv2_st, &ncs->v_int2); ncs->intv2_exist = true; }
 						
-#line 1044 "crontab.c"
+#line 1559 "crontab.c"
 
 						break; 
 					}
-					case 10:  {
+					case 11:  {
 							{
-#line 424 "crontab.rl"
+#line 601 "crontab.rl"
 							
 							swap_int_pair(&ncs->v_int1, &ncs->v_int3);
 							swap_int_pair(&ncs->v_int2, &ncs->v_int4);
 						}
 						
-#line 1055 "crontab.c"
+#line 1570 "crontab.c"
 
 						break; 
 					}
-					case 11:  {
+					case 12:  {
 							{
-#line 428 "crontab.rl"
+#line 605 "crontab.rl"
 							
 							ncs->v_int3 = -1;
 							ncs->v_int4 = -1;
 						}
 						
-#line 1066 "crontab.c"
+#line 1581 "crontab.c"
 
 						break; 
 					}
-					case 12:  {
+					case 13:  {
 							{
-#line 433 "crontab.rl"
+#line 610 "crontab.rl"
 							ncs->strv_st = p; ncs->v_strlen = 0; }
 						
-#line 1074 "crontab.c"
+#line 1589 "crontab.c"
 
 						break; 
 					}
-					case 13:  {
+					case 14:  {
 							{
-#line 434 "crontab.rl"
+#line 611 "crontab.rl"
 							
 							ncs->v_strlen = p > ncs->strv_st ? (size_t)(p - ncs->strv_st) : 0;
 							if (ncs->v_strlen >= sizeof ncs->v_str)
-							suicide("error parsing line %zu in crontab: too long\n", ncs->linenum);
+							ParseCfgState_fail(ncs, "error parsing line %zu in crontab: too long\n", ncs->linenum);
 							memcpy(ncs->v_str, ncs->strv_st, ncs->v_strlen);
 							ncs->v_str[ncs->v_strlen] = 0;
 						}
 						
-#line 1088 "crontab.c"
+#line 1603 "crontab.c"
 
 						break; 
 					}
-					case 14:  {
+					case 15:  {
 							{
-#line 455 "crontab.rl"
+#line 633 "crontab.rl"
 							ncs->ce->journal_ = true; }
 						
-#line 1096 "crontab.c"
+#line 1611 "crontab.c"
 
 						break; 
 					}
-					case 15:  {
+					case 16:  {
 							{
-#line 458 "crontab.rl"
+#line 636 "crontab.rl"
 							
 							ncs->ce->maxruns_ = ncs->v_int1 > 0 ? (unsigned)ncs->v_int1 : 0;
 						}
 						
-#line 1106 "crontab.c"
+#line 1621 "crontab.c"
 
 						break; 
 					}
-					case 16:  {
+					case 17:  {
 							{
-#line 464 "crontab.rl"
-							ncs->ce->interval_ = ncs->v_time; }
+#line 642 "crontab.rl"
+							
+							ncs->ce->interval_ = ncs->v_time;
+							ncs->ce->interval_ms_ = ncs->v_time_ms;
+						}
 						
-#line 1114 "crontab.c"
+#line 1632 "crontab.c"
 
 						break; 
 					}
-					case 17:  {
+					case 18:  {
 							{
-#line 473 "crontab.rl"
+#line 649 "crontab.rl"
+							ncs->ce->timeout_ = ParseCfgState_whole_secs(ncs); }
+						
+#line 1640 "crontab.c"
+
+						break; 
+					}
+					case 19:  {
+							{
+#line 653 "crontab.rl"
+							ncs->ce->deadline_ = ParseCfgState_whole_secs(ncs); }
+						
+#line 1648 "crontab.c"
+
+						break; 
+					}
+					case 20:  {
+							{
+#line 654 "crontab.rl"
+							ncs->ce->catchup_ = JOB_CATCHUP_ONCE; }
+						
+#line 1656 "crontab.c"
+
+						break; 
+					}
+					case 21:  {
+							{
+#line 655 "crontab.rl"
+							ncs->ce->catchup_ = JOB_CATCHUP_SKIP; }
+						
+#line 1664 "crontab.c"
+
+						break; 
+					}
+					case 22:  {
+							{
+#line 656 "crontab.rl"
+							ncs->ce->catchup_ = JOB_CATCHUP_STAGGER; }
+						
+#line 1672 "crontab.c"
+
+						break; 
+					}
+					case 23:  {
+							{
+#line 662 "crontab.rl"
+							ncs->ce->fail_interval_ = ParseCfgState_whole_secs(ncs); }
+						
+#line 1680 "crontab.c"
+
+						break; 
+					}
+					case 24:  {
+							{
+#line 663 "crontab.rl"
+							
+							ncs->ce->backoff_ = ncs->v_int1 > 1 ? (unsigned)ncs->v_int1 : 1;
+						}
+						
+#line 1690 "crontab.c"
+
+						break; 
+					}
+					case 25:  {
+							{
+#line 670 "crontab.rl"
+							
+							if (ncs->ce->output_)
+							ParseCfgState_fail(ncs, "Duplicate 'output' value at line %zu\n", ncs->linenum);
+							ncs->ce->output_ = strdup(ncs->v_str);
+							if (!ncs->ce->output_) abort();
+						}
+						
+#line 1703 "crontab.c"
+
+						break; 
+					}
+					case 26:  {
+							{
+#line 676 "crontab.rl"
+							
+							ncs->ce->output_max_kb_ = ncs->v_int1 > 0 ? (unsigned)ncs->v_int1 : 0;
+						}
+						
+#line 1713 "crontab.c"
+
+						break; 
+					}
+					case 27:  {
+							{
+#line 680 "crontab.rl"
+							
+							int upid;
+							ParseCfgState_parse_int(ncs, p, ncs->intv_st, &upid);
+							ParseCfgState_add_after(ncs, upid);
+						}
+						
+#line 1725 "crontab.c"
+
+						break; 
+					}
+					case 28:  {
+							{
+#line 686 "crontab.rl"
+							
+							if (ncs->ce->cpus_)
+							ParseCfgState_fail(ncs, "Duplicate 'cpus' value at line %zu\n", ncs->linenum);
+							if (!cpu_list_valid(ncs->v_str))
+							ParseCfgState_fail(ncs, "Invalid CPU list at line %zu: '%s'\n", ncs->linenum, ncs->v_str);
+							ncs->ce->cpus_ = strdup(ncs->v_str);
+							if (!ncs->ce->cpus_) abort();
+						}
+						
+#line 1740 "crontab.c"
+
+						break; 
+					}
+					case 29:  {
+							{
+#line 695 "crontab.rl"
+							
+							if (ncs->ce->cgroup_)
+							ParseCfgState_fail(ncs, "Duplicate 'cgroup' value at line %zu\n", ncs->linenum);
+							if (!cgroup_name_valid(ncs->v_str))
+							ParseCfgState_fail(ncs, "Invalid cgroup name at line %zu: '%s'\n", ncs->linenum, ncs->v_str);
+							ncs->ce->cgroup_ = strdup(ncs->v_str);
+							if (!ncs->ce->cgroup_) abort();
+						}
+						
+#line 1755 "crontab.c"
+
+						break; 
+					}
+					case 30:  {
+							{
+#line 703 "crontab.rl"
+							
+							if (ncs->v_int1 < 1 || ncs->v_int1 > 10000)
+							ParseCfgState_fail(ncs, "cpu_weight must be within [1,10000] at line %zu\n", ncs->linenum);
+							ncs->ce->cpu_weight_ = (unsigned)ncs->v_int1;
+						}
+						
+#line 1767 "crontab.c"
+
+						break; 
+					}
+					case 31:  {
+							{
+#line 708 "crontab.rl"
+							
+							if (ncs->v_int1 < 1 || ncs->v_int1 > 10000)
+							ParseCfgState_fail(ncs, "io_weight must be within [1,10000] at line %zu\n", ncs->linenum);
+							ncs->ce->io_weight_ = (unsigned)ncs->v_int1;
+						}
+						
+#line 1779 "crontab.c"
+
+						break; 
+					}
+					case 32:  {
+							{
+#line 713 "crontab.rl"
+							
+							ncs->ce->memory_high_kb_ = ncs->v_int1 > 0 ? (unsigned)ncs->v_int1 : 0;
+						}
+						
+#line 1789 "crontab.c"
+
+						break; 
+					}
+					case 33:  {
+							{
+#line 732 "crontab.rl"
 							ParseCfgState_add_cst_mon(ncs); }
 						
-#line 1122 "crontab.c"
+#line 1797 "crontab.c"
 
 						break; 
 					}
-					case 18:  {
+					case 34:  {
 							{
-#line 474 "crontab.rl"
+#line 733 "crontab.rl"
 							ParseCfgState_add_cst_mday(ncs); }
 						
-#line 1130 "crontab.c"
+#line 1805 "crontab.c"
 
 						break; 
 					}
-					case 19:  {
+					case 35:  {
 							{
-#line 475 "crontab.rl"
+#line 734 "crontab.rl"
 							ParseCfgState_add_cst_wday(ncs); }
 						
-#line 1138 "crontab.c"
+#line 1813 "crontab.c"
 
 						break; 
 					}
-					case 20:  {
+					case 36:  {
 							{
-#line 476 "crontab.rl"
+#line 735 "crontab.rl"
 							ParseCfgState_add_cst_time(ncs); }
 						
-#line 1146 "crontab.c"
+#line 1821 "crontab.c"
 
 						break; 
 					}
-					case 21:  {
+					case 37:  {
 							{
-#line 483 "crontab.rl"
+#line 742 "crontab.rl"
 							ParseCfgState_parse_command_key(ncs); }
 						
-#line 1154 "crontab.c"
+#line 1829 "crontab.c"
 
 						break; 
 					}
-					case 22:  {
+					case 38:  {
 							{
-#line 490 "crontab.rl"
+#line 751 "crontab.rl"
 							ncs->jobid_st = p; }
 						
-#line 1162 "crontab.c"
+#line 1837 "crontab.c"
 
 						break; 
 					}
-					case 23:  {
+					case 39:  {
 							{
-#line 491 "crontab.rl"
-							parse_int_value(p, ncs->jobid_st, ncs->linenum, &ncs->ce->id_); }
+#line 752 "crontab.rl"
+							ParseCfgState_parse_int(ncs, p, ncs->jobid_st, &ncs->ce->id_); }
 						
-#line 1170 "crontab.c"
+#line 1845 "crontab.c"
 
 						break; 
 					}
-					case 24:  {
+					case 40:  {
 							{
-#line 492 "crontab.rl"
+#line 753 "crontab.rl"
 							ParseCfgState_finish_ce(ncs); ParseCfgState_create_ce(ncs); }
 						
-#line 1178 "crontab.c"
+#line 1853 "crontab.c"
 
 						break; 
 					}
@@ -1247,7 +1939,7 @@ static int do_parse_config(struct ParseCfgState *ncs, const char *p, size_t plen
 		}
 		
 		if ( p == eof ) {
-			if ( ncs->cs >= 72 )
+			if ( ncs->cs >= 192 )
 				goto _out;
 		}
 		else {
@@ -1259,7 +1951,7 @@ static int do_parse_config(struct ParseCfgState *ncs, const char *p, size_t plen
 		_out: {}
 	}
 	
-#line 508 "crontab.rl"
+#line 769 "crontab.rl"
 
 	
 	if (ncs->cs == ncrontab_error)
@@ -1291,24 +1983,62 @@ static size_t count_config_jobs(FILE *f)
 	return r;
 }
 
-void parse_config(char const *path, char const *execfile,
-struct Job **stk, struct Job **deadstk)
+// A user may have at most users_max_jobs() jobs; the crontab of a user
+// with more is skipped, so that one user can't flood the schedule.
+static bool user_jobs_ok(char const *path, const struct User *user, size_t njobs)
+{
+	unsigned max = users_max_jobs();
+	if (!user || !max || njobs <= max) return true;
+		log_line("Crontab '%s' has %zu jobs, more than the %u allowed per user; skipping it\n",
+	path, njobs, max);
+	return false;
+}
+
+static void destroy_jobs(struct Job **jobs, size_t *njobs)
+{
+	for (size_t i = 0; i < *njobs; ++i) job_destroy(&(*jobs)[i]);
+	free(*jobs);
+	*jobs = NULL;
+	*njobs = 0;
+}
+
+// Returns false if the crontab was skipped, as the crontab of a user is
+// if it has errors.
+static bool parse_config_file(char const *path, struct User *user,
+struct Job **jobs, size_t *njobs)
 {
-	struct ParseCfgState ncs;
-	ParseCfgState_init(&ncs, stk, deadstk);
-	
 	char buf[MAX_LINE];
 	FILE *f = fopen(path, "r");
-	if (!f)
-		suicide("Failed to open config file '%s': %s\n", path, strerror(errno));
-	g_njobs = count_config_jobs(f);
-	if (!g_njobs) {
-		log_line("No jobs found in config file.  Exiting.\n");
-		exit(EXIT_SUCCESS);
+	if (!f) {
+		if (!user)
+			suicide("Failed to open config file '%s': %s\n", path, strerror(errno));
+		log_line("Failed to open crontab '%s': %s; skipping it\n", path, strerror(errno));
+		*jobs = NULL;
+		*njobs = 0;
+		return false;
+	}
+	*njobs = count_config_jobs(f);
+	*jobs = NULL;
+	if (!user_jobs_ok(path, user, *njobs)) {
+		*njobs = 0;
+		fclose(f);
+		return false;
+	}
+	if (*njobs) {
+		*jobs = malloc(*njobs * sizeof(struct Job));
+		if (!*jobs) abort();
+		}
+	
+	struct ParseCfgState ncs;
+	ParseCfgState_init(&ncs, path, user, *jobs, *njobs);
+	if (setjmp(ncs.fail)) {
+		// The jobs before ce are complete, and ce itself has been started.
+		*njobs = (size_t)(ncs.ce - *jobs) + (ncs.seen_job && ncs.ce != ncs.ce_end);
+		destroy_jobs(jobs, njobs);
+		fclose(f);
+		log_line("Crontab '%s' has errors; skipping it\n", path);
+		return false;
 	}
-	g_jobs = malloc(g_njobs * sizeof(struct Job));
-	if (!g_jobs) abort();
-		ncs.ce = g_jobs;
 	while (fgets(buf, sizeof buf, f)) {
 		size_t llen = strlen(buf);
 		if (llen == 0)
@@ -1317,18 +2047,237 @@ struct Job **stk, struct Job **deadstk)
 			buf[--llen] = 0;
 		++ncs.linenum;
 		if (do_parse_config(&ncs, buf, llen) < 0)
-			suicide("Config file '%s' is malformed at line %zu\n", path, ncs.linenum);
+			ParseCfgState_fail(&ncs, "Config file '%s' is malformed at line %zu\n",
+		path, ncs.linenum);
 	}
 	if (ferror(f)) {
 		log_line("IO error reading config file '%s'\n", path);
 		exit(EXIT_FAILURE);
 	}
 	ParseCfgState_finish_ce(&ncs);
-	parse_history(execfile);
+	fclose(f);
+	return true;
+}
+
+void parse_config_jobs(char const *path)
+{
+	parse_config_file(path, NULL, &g_jobs, &g_njobs);
+	job_id_index_destroy();
+	if (!g_njobs) {
+		log_line("No jobs found in config file.  Exiting.\n");
+		exit(EXIT_SUCCESS);
+	}
+}
+
+struct CfgFrag {
+	char *path;
+	char *cache_path;
+	struct User *user;
+	struct Job *jobs;
+	size_t njobs;
+};
+
+static void parse_config_frag(struct CfgFrag *self)
+{
+	if (self->cache_path
+		&& cache_load(self->cache_path, self->path, &self->jobs, &self->njobs)) {
+		if (!user_jobs_ok(self->path, self->user, self->njobs)) {
+			destroy_jobs(&self->jobs, &self->njobs);
+			return;
+		}
+		for (size_t i = 0; i < self->njobs; ++i) {
+			self->jobs[i].user_ = self->user;
+			const char *dup = job_id_index_add(&self->jobs[i], self->path);
+			if (!dup) continue;
+				if (!self->user)
+				suicide("ERROR IN CRONTAB: duplicate entry for job %d in '%s' and '%s'\n",
+			self->jobs[i].id_, dup, self->path);
+			log_line("Crontab '%s' has a duplicate entry for job %d; skipping it\n",
+			self->path, self->jobs[i].id_);
+			destroy_jobs(&self->jobs, &self->njobs);
+			return;
+		}
+	} else {
+		struct stat st;
+		uint64_t hash;
+		bool cacheable = self->cache_path && cache_src_hash(self->path, &st, &hash);
+		if (parse_config_file(self->path, self->user, &self->jobs, &self->njobs) && cacheable)
+			cache_write(self->cache_path, self->path, &st, hash, self->jobs, self->njobs);
+	}
+	// The after= links of a user stay within the user's crontab, so they
+	// are checked here, where a bad one only loses that crontab.
+	if (self->user && !job_deps_link(self->jobs, self->njobs)) {
+		log_line("Crontab '%s' has errors; skipping it\n", self->path);
+		destroy_jobs(&self->jobs, &self->njobs);
+	}
+}
+
+struct CfgFragQueue {
+	struct CfgFrag *frags;
+	size_t nfrags;
+	size_t next;
+};
+
+static void *parse_config_frag_thread(void *arg)
+{
+	struct CfgFragQueue *q = arg;
+	for (;;) {
+		size_t i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED);
+		if (i >= q->nfrags) break;
+			parse_config_frag(&q->frags[i]);
+	}
+	return NULL;
+}
+
+static char *path_join(char const *dir, char const *name, char const *suffix)
+{
+	size_t dl = strlen(dir), nl = strlen(name), sl = strlen(suffix);
+	char *r = malloc(dl + nl + sl + 2);
+	if (!r) abort();
+		memcpy(r, dir, dl);
+	r[dl] = '/';
+	memcpy(r + dl + 1, name, nl);
+	memcpy(r + dl + 1 + nl, suffix, sl + 1);
+	return r;
+}
+
+static int strcmp_p(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// Returns the sorted names of the crontab fragments in dir.  Hidden
+// files and editor backups (ending in '~') are skipped.
+static char **list_config_dir(char const *dir, size_t *n)
+{
+	DIR *d = opendir(dir);
+	if (!d)
+		suicide("Failed to open crontab directory '%s': %s\n", dir, strerror(errno));
+	char **names = NULL;
+	size_t cap = 0;
+	*n = 0;
+	struct dirent *de;
+	while ((de = readdir(d))) {
+		size_t l = strlen(de->d_name);
+		if (de->d_name[0] == '.' || de->d_name[l - 1] == '~') continue;
+			struct stat st;
+		char *p = path_join(dir, de->d_name, "");
+		bool reg = !stat(p, &st) && S_ISREG(st.st_mode);
+		free(p);
+		if (!reg) continue;
+			if (*n == cap) {
+			cap = cap ? cap * 2 : 16;
+			names = realloc(names, cap * sizeof *names);
+			if (!names) abort();
+			}
+		names[*n] = strdup(de->d_name);
+		if (!names[*n]) abort();
+			++*n;
+	}
+	closedir(d);
+	if (*n) qsort(names, *n, sizeof *names, strcmp_p);
+		return names;
+}
+
+void parse_config_dir(char const *dir, char const *cachedir)
+{
+	size_t nfrags;
+	char **names = list_config_dir(dir, &nfrags);
+	struct stat st;
+	if (cachedir && (stat(cachedir, &st) || !S_ISDIR(st.st_mode)))
+		cachedir = NULL;
 	
-	for (struct Job *j = g_jobs, *jend = g_jobs + g_njobs; j != jend; ++j) {
-		bool alive = j->exectime_ && (j->maxruns_ == 0 || j->numruns_ < j->maxruns_);
-		job_insert(alive ? stk : deadstk, j);
+	struct CfgFrag *frags = calloc(nfrags + 1, sizeof *frags);
+	if (!frags) abort();
+		size_t k = 0;
+	for (size_t i = 0; i < nfrags; ++i) {
+		// Accounts are looked up here as getpwnam() is not thread-safe.
+		struct User *u = NULL;
+		if (users_enabled() && !(u = users_get(names[i]))) {
+			log_line("Crontab '%s/%s' is not named for a user; skipping it\n", dir, names[i]);
+			free(names[i]);
+			continue;
+		}
+		frags[k].path = path_join(dir, names[i], "");
+		if (cachedir) frags[k].cache_path = path_join(cachedir, names[i], ".cache");
+			frags[k++].user = u;
+		free(names[i]);
 	}
-	fclose(f);
+	free(names);
+	nfrags = k;
+	
+	struct CfgFragQueue q = { .frags = frags, .nfrags = nfrags };
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nthreads = ncpu > 1 ? (size_t)ncpu - 1 : 0;
+	if (nthreads >= nfrags) nthreads = nfrags ? nfrags - 1 : 0;
+		pthread_t *threads = calloc(nthreads + 1, sizeof *threads);
+	if (!threads) abort();
+		for (size_t i = 0; i < nthreads; ++i) {
+		if (pthread_create(&threads[i], NULL, parse_config_frag_thread, &q)) {
+			nthreads = i;
+			break;
+		}
+	}
+	parse_config_frag_thread(&q);
+	for (size_t i = 0; i < nthreads; ++i)
+	pthread_join(threads[i], NULL);
+	free(threads);
+	job_id_index_destroy();
+	
+	g_njobs = 0;
+	for (size_t i = 0; i < nfrags; ++i) g_njobs += frags[i].njobs;
+	if (!g_njobs) {
+		log_line("No jobs found in crontab directory.  Exiting.\n");
+		exit(EXIT_SUCCESS);
+	}
+	g_jobs = malloc(g_njobs * sizeof(struct Job));
+	if (!g_jobs) abort();
+		struct Job *j = g_jobs;
+	for (size_t i = 0; i < nfrags; ++i) {
+		if (frags[i].njobs) memcpy(j, frags[i].jobs, frags[i].njobs * sizeof *j);
+			j += frags[i].njobs;
+		free(frags[i].jobs);
+		free(frags[i].path);
+		free(frags[i].cache_path);
+	}
+	free(frags);
+}
+
+void parse_config_defs(char const *path, char const *dir, char const *cachefile)
+{
+	if (dir)
+		parse_config_dir(dir, cachefile);
+	else if (!cachefile || !cache_load(cachefile, path, &g_jobs, &g_njobs))
+		parse_config_jobs(path);
+	job_deps_resolve(g_jobs, g_njobs);
+}
+
+void parse_config(char const *path, char const *dir, char const *execfile,
+char const *cachefile, struct JobHeap *heap)
+{
+	parse_config_defs(path, dir, cachefile);
+	if (users_enabled()) {
+		// The jobs of each user are together in g_jobs.
+		for (size_t i = 0; i < g_njobs; ++i) {
+			if (i && g_jobs[i].user_ == g_jobs[i - 1].user_) continue;
+				char *upath = history_user_path(g_jobs[i].user_);
+			parse_history(upath, g_jobs[i].user_, true);
+			free(upath);
+		}
+		parse_history(history_journal_path(), NULL, true);
+	} else if (!history_load_binary()) {
+		parse_history(execfile, NULL, false);
+		parse_history(history_journal_path(), NULL, true);
+	}
+	
+	struct timespec ts;
+	if (clock_gettime(CLOCK_REALTIME, &ts))
+		suicide("clock_gettime failed: %s\n", strerror(errno));
+	job_catchup_stagger(g_jobs, g_njobs, &ts);
+	
+	for (struct Job *j = g_jobs, *jend = g_jobs + g_njobs; j != jend; ++j) {
+		bool alive = j->exectime_ && !j->nafter_
+		&& (j->maxruns_ == 0 || j->numruns_ < j->maxruns_);
+		if (alive) job_heap_push(heap, j);
+		}
 }
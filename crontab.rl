@@ -4,13 +4,23 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
 #include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "nk/log.h"
 #include "strconv.h"
 #include "sched.h"
+#include "cache.h"
+#include "history.h"
+#include "affinity.h"
+#include "cgroup.h"
+#include "users.h"
 
 #define MAX_LINE 2048
 
@@ -21,16 +31,19 @@ extern struct Job *g_jobs;
 struct item_history {
     time_t lasttime;
     unsigned int numruns;
+    unsigned int interval;
 };
 
 struct ParseCfgState
 {
     char v_str[MAX_LINE];
 
-    struct Job **stackl;
-    struct Job **deadstackl;
-
     struct Job *ce;
+    struct Job *ce_end;
+    struct JobCst cst; // scratch constraints for ce; interned by finish_ce
+    const char *path;
+    struct User *user; // owner of the crontab, or NULL
+    jmp_buf fail;      // where errors in the crontab of a user land
 
     const char *jobid_st;
     const char *time_st;
@@ -42,6 +55,7 @@ struct ParseCfgState
     size_t linenum;
 
     unsigned int v_time;
+    unsigned int v_time_ms; // sub-second part of v_time
 
     int v_int1;
     int v_int2;
@@ -58,22 +72,101 @@ struct ParseCfgState
     bool seen_job;
 };
 
-static void ParseCfgState_init(struct ParseCfgState *self, struct Job **stk, struct Job **dstk)
+static void ParseCfgState_init(struct ParseCfgState *self, const char *path,
+                               struct User *user, struct Job *jobs, size_t njobs)
 {
     *self = (struct ParseCfgState){
-        .stackl = stk,
-        .deadstackl = dstk,
+        .ce = jobs,
+        .ce_end = jobs + njobs,
+        .path = path,
+        .user = user,
         .v_int3 = -1,
         .v_int4 = -1,
     };
 }
 
+// Reports an error in the crontab.  The crontab of a user is then skipped
+// by parse_config_file(); any other error is fatal.
+__attribute__((format (printf, 2, 3), noreturn))
+static void ParseCfgState_fail(struct ParseCfgState *self, const char *fmt, ...)
+{
+    char msg[MAX_LINE];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof msg, fmt, ap);
+    va_end(ap);
+    if (!self->user) suicide("%s", msg);
+    log_line("%s", msg);
+    longjmp(self->fail, 1);
+}
+
+// Index of job ids to the crontab file that defines them; shared by all
+// of the parser threads so that ids are unique across a crontab directory.
+// With --users, ids need only be unique within the crontab of each user.
+struct JobIdEnt {
+    const char *path; // NULL if the slot is empty
+    const struct User *user;
+    int id;
+};
+static struct JobIdEnt *g_id_idx;
+static size_t g_id_idx_size; // power of two
+static size_t g_id_idx_count;
+static pthread_mutex_t g_id_idx_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t job_id_slot(const struct JobIdEnt *tab, size_t size,
+                          const struct User *user, int id)
+{
+    size_t h = ((unsigned)id ^ (size_t)user) * 2654435761u;
+    size_t i = h & (size - 1);
+    while (tab[i].path && (tab[i].id != id || tab[i].user != user))
+        i = (i + 1) & (size - 1);
+    return i;
+}
+
+// Returns NULL, or the path of the crontab that already has the id of j.
+static const char *job_id_index_add(const struct Job *j, const char *path)
+{
+    int id = j->id_;
+    const char *r = NULL;
+    pthread_mutex_lock(&g_id_idx_mtx);
+    if ((g_id_idx_count + 1) * 2 > g_id_idx_size) {
+        size_t nsize = g_id_idx_size ? g_id_idx_size * 2 : 256;
+        struct JobIdEnt *ntab = calloc(nsize, sizeof *ntab);
+        if (!ntab) abort();
+        for (size_t i = 0; i < g_id_idx_size; ++i) {
+            if (g_id_idx[i].path)
+                ntab[job_id_slot(ntab, nsize, g_id_idx[i].user, g_id_idx[i].id)] = g_id_idx[i];
+        }
+        free(g_id_idx);
+        g_id_idx = ntab;
+        g_id_idx_size = nsize;
+    }
+    size_t i = job_id_slot(g_id_idx, g_id_idx_size, j->user_, id);
+    if (g_id_idx[i].path) {
+        r = g_id_idx[i].path;
+    } else {
+        g_id_idx[i] = (struct JobIdEnt){ .path = path, .user = j->user_, .id = id };
+        ++g_id_idx_count;
+    }
+    pthread_mutex_unlock(&g_id_idx_mtx);
+    return r;
+}
+
+static void job_id_index_destroy(void)
+{
+    free(g_id_idx);
+    g_id_idx = NULL;
+    g_id_idx_size = g_id_idx_count = 0;
+}
+
 static void ParseCfgState_create_ce(struct ParseCfgState *self)
 {
-    if (self->ce == g_jobs + g_njobs) {
-        suicide("job count mismatch\n");
+    if (self->ce == self->ce_end) {
+        ParseCfgState_fail(self, "job count mismatch\n");
     }
     job_init(self->ce);
+    self->ce->user_ = self->user;
+    job_cst_init(&self->cst);
     self->seen_job = true;
     self->have_command = false;
     self->seen_cst_hhmm = false;
@@ -86,11 +179,23 @@ static void ParseCfgState_debug_print_ce(const struct ParseCfgState *self)
 {
     if (!gflags_debug) return;
     const struct Job *j = self->ce;
-    log_line("id=%d:\tcommand: %s\n", j->id_, j->command_ ? j->command_ : "");
-    log_line("\targs: %s\n", j->args_ ? j->args_ : "");
-    log_line("\tnumruns: %u\n\tmaxruns: %u\n", j->numruns_, j->maxruns_);
-    log_line("\tjournal: %s\n", j->journal_ ? "true" : "false");
-    log_line("\tinterval: %u\n\texectime: %lu\n\tlasttime: %lu\n", j->interval_, j->exectime_, j->lasttime_);
+    log_debug("id=%d:\tcommand: %s\n", j->id_, j->command_ ? j->command_ : "");
+    if (j->user_) log_debug("\tuser: %s\n", j->user_->name);
+    log_debug("\targs: %s\n", j->args_ ? j->args_ : "");
+    log_debug("\tnumruns: %u\n\tmaxruns: %u\n", j->numruns_, j->maxruns_);
+    log_debug("\ttimeout: %u\n\tdeadline: %u\n", j->timeout_, j->deadline_);
+    log_debug("\tcatchup: %u\n", j->catchup_);
+    log_debug("\ton_failure_interval: %u\n\tbackoff: %u\n", j->fail_interval_, j->backoff_);
+    for (unsigned k = 0; k < j->nafter_; ++k)
+        log_debug("\tafter: %d\n", j->after_[k]);
+    log_debug("\toutput: %s (rotate at %u KiB)\n", j->output_ ? j->output_ : "",
+             j->output_max_kb_);
+    log_debug("\tcpus: %s\n", j->cpus_ ? j->cpus_ : "");
+    log_debug("\tcgroup: %s (cpu_weight %u, io_weight %u, memory_high %u KiB)\n",
+             j->cgroup_ ? j->cgroup_ : "", j->cpu_weight_, j->io_weight_, j->memory_high_kb_);
+    log_debug("\tjournal: %s\n", j->journal_ ? "true" : "false");
+    log_debug("\tinterval: %u.%03u\n\texectime: %lu\n\tlasttime: %lu\n", j->interval_,
+              j->interval_ms_, j->exectime_, j->lasttime_);
 }
 
 static void ParseCfgState_finish_ce(struct ParseCfgState *self)
@@ -100,18 +205,24 @@ static void ParseCfgState_finish_ce(struct ParseCfgState *self)
     ParseCfgState_debug_print_ce(self);
 
     if (self->ce->id_ < 0
-        || (self->ce->interval_ <= 0 && self->ce->exectime_ <= 0)
+        || (self->ce->interval_ <= 0 && !self->ce->interval_ms_ && self->ce->exectime_ <= 0
+            && !self->ce->nafter_)
         || !self->ce->command_ || !self->have_command) {
-        suicide("ERROR IN CRONTAB: invalid id, command, or interval for job %d\n", self->ce->id_);
+        ParseCfgState_fail(self, "ERROR IN CRONTAB: invalid id, command, or interval for job %d\n",
+                           self->ce->id_);
     }
 
-    // XXX: O(n^2) might be nice to avoid.
-    for (struct Job *i = g_jobs, *iend = self->ce; i != iend; ++i) {
-        if (i->id_ == self->ce->id_) {
-            suicide("ERROR IN CRONTAB: duplicate entry for job %d\n", self->ce->id_);
-        }
+    const char *dup = job_id_index_add(self->ce, self->path);
+    if (dup) {
+        if (!strcmp(dup, self->path))
+            ParseCfgState_fail(self, "ERROR IN CRONTAB: duplicate entry for job %d\n",
+                               self->ce->id_);
+        ParseCfgState_fail(self, "ERROR IN CRONTAB: duplicate entry for job %d in '%s' and '%s'\n",
+                           self->ce->id_, dup, self->path);
     }
 
+    self->ce->cst_ = job_cst_intern(&self->cst);
+
     // Preserve this job and work on the next one.
     ++self->ce;
 }
@@ -127,8 +238,8 @@ struct hstm {
 static void hstm_print(const struct hstm *self)
 {
     if (!gflags_debug) return;
-    log_line("id=%d:\tnumruns = %u\n\tlasttime = %lu\n",
-             self->id, self->h.numruns, self->h.lasttime);
+    log_debug("id=%d:\tnumruns = %u\n\tlasttime = %lu\n\tinterval = %u\n",
+             self->id, self->h.numruns, self->h.lasttime, self->h.interval);
 }
 
 %%{
@@ -148,6 +259,12 @@ static void hstm_print(const struct hstm *self)
             fbreak;
         }
     }
+    action IntervalEn {
+        if (!strconv_to_u32(hst->st, p, &hst->h.interval)) {
+            hst->parse_error = true;
+            fbreak;
+        }
+    }
     action IdEn {
         if (!strconv_to_i32(hst->st, p, &hst->id)) {
             hst->parse_error = true;
@@ -158,7 +275,8 @@ static void hstm_print(const struct hstm *self)
     lasttime = ':' digit+ > St % LastTimeEn;
     numruns = '=' digit+ > St % NumRunsEn;
     id = digit+ > St % IdEn;
-    main := id numruns lasttime;
+    interval = ':' digit+ > St % IntervalEn;
+    main := id numruns lasttime interval?;
 }%%
 
 %% write data;
@@ -179,7 +297,25 @@ static int do_parse_history(struct hstm *hst, const char *p, size_t plen)
     return -2;
 }
 
-static void parse_history(char const *path)
+int history_parse_line(const char *p, size_t plen, int *id, unsigned int *numruns,
+                       time_t *lasttime, unsigned int *interval)
+{
+    struct hstm hst = { .st = NULL, .cs = 0, .id = -1, .parse_error = false };
+    int r = do_parse_history(&hst, p, plen);
+    if (r < 0) return r;
+    hstm_print(&hst);
+    *id = hst.id;
+    *numruns = hst.h.numruns;
+    *lasttime = hst.h.lasttime;
+    *interval = hst.h.interval;
+    return r;
+}
+
+// The journal is optional, and its records are only applied if they are
+// at least as recent as what is already known.  The records of a history
+// file are those of the jobs of user, if any; in the journal, the record of
+// a user's job starts with "USER:".
+static void parse_history(char const *path, const struct User *user, bool journal)
 {
     struct timespec ts;
     if (clock_gettime(CLOCK_REALTIME, &ts)) {
@@ -190,9 +326,12 @@ static void parse_history(char const *path)
     char buf[MAX_LINE];
     FILE *f = fopen(path, "r");
     if (!f) {
-        log_line("Failed to open history file '%s' for read: %s\n", path, strerror(errno));
+        if (!journal || errno != ENOENT)
+            log_line("Failed to open history file '%s' for read: %s\n", path, strerror(errno));
         return;
     }
+    struct Job **byid = job_index_by_id(g_jobs, g_njobs);
+
     size_t linenum = 0;
     while (fgets(buf, sizeof buf, f)) {
         size_t llen = strlen(buf);
@@ -201,23 +340,25 @@ static void parse_history(char const *path)
         if (buf[llen-1] == '\n')
             buf[--llen] = 0;
         ++linenum;
-        struct hstm hst = { .st = NULL, .cs = 0, .id = -1, .parse_error = false };
-        int r = do_parse_history(&hst, buf, llen);
+        char *rec = buf;
+        char *c = journal ? memchr(buf, ':', strcspn(buf, "=")) : NULL;
+        if (c) rec = c + 1;
+        int id;
+        unsigned int numruns, interval;
+        time_t lasttime;
+        int r = history_parse_line(rec, llen - (size_t)(rec - buf), &id, &numruns,
+                                   &lasttime, &interval);
         if (r < 0) {
             log_line("%s history entry at line %zu; ignoring\n",
                      r == -2 ? "Incomplete" : "Malformed", linenum);
             continue;
         }
 
-        for (struct Job *j = g_jobs, *jend = g_jobs + g_njobs; j != jend; ++j) {
-            if (j->id_ == hst.id) {
-                hstm_print(&hst);
-                j->numruns_ = hst.h.numruns;
-                j->lasttime_ = hst.h.lasttime;
-                job_set_initial_exectime(j, &ts);
-            }
-        }
+        struct Job *j = c ? job_index_find_name(byid, g_njobs, buf, (size_t)(c - buf), id)
+                          : job_index_find(byid, g_njobs, user, id);
+        if (j) history_apply(j, numruns, lasttime, interval, &ts, true);
     }
+    free(byid);
     if (ferror(f)) {
        log_line("IO error reading history file '%s'\n", path);
        exit(EXIT_FAILURE);
@@ -236,11 +377,11 @@ static bool ParseCfgState_add_cst_mon(struct ParseCfgState *self)
     if (min <= 0 || min > 12) return false;
     if (max <= 0 || max > 12) return false;
     if (!self->seen_cst_mon) {
-        memset(&self->ce->cst_mon_, 0, sizeof self->ce->cst_mon_);
+        memset(&self->cst.mon_, 0, sizeof self->cst.mon_);
         self->seen_cst_mon = true;
     }
     for (int i = min; i <= max; ++i)
-        self->ce->cst_mon_[i - 1] = true;
+        self->cst.mon_[i - 1] = true;
     return true;
 }
 
@@ -255,11 +396,11 @@ static bool ParseCfgState_add_cst_mday(struct ParseCfgState *self)
     if (min <= 0 || min > 31) return false;
     if (max <= 0 || max > 31) return false;
     if (!self->seen_cst_mday) {
-        memset(&self->ce->cst_mday_, 0, sizeof self->ce->cst_mday_);
+        memset(&self->cst.mday_, 0, sizeof self->cst.mday_);
         self->seen_cst_mday = true;
     }
     for (int i = min; i <= max; ++i)
-        self->ce->cst_mday_[i - 1] = true;
+        self->cst.mday_[i - 1] = true;
     return true;
 }
 
@@ -274,11 +415,11 @@ static bool ParseCfgState_add_cst_wday(struct ParseCfgState *self)
     if (min <= 0 || min > 7) return false;
     if (max <= 0 || max > 7) return false;
     if (!self->seen_cst_wday) {
-        memset(&self->ce->cst_wday_, 0, sizeof self->ce->cst_wday_);
+        memset(&self->cst.wday_, 0, sizeof self->cst.wday_);
         self->seen_cst_wday = true;
     }
     for (int i = min; i <= max; ++i)
-        self->ce->cst_wday_[i - 1] = true;
+        self->cst.wday_[i - 1] = true;
     return true;
 }
 
@@ -293,7 +434,7 @@ static bool ParseCfgState_add_cst_time(struct ParseCfgState *self)
         }
     }
     if (!self->seen_cst_hhmm) {
-        memset(&self->ce->cst_hhmm_, 0, sizeof self->ce->cst_hhmm_);
+        memset(&self->cst.hhmm_, 0, sizeof self->cst.hhmm_);
         self->seen_cst_hhmm = true;
     }
     int min = self->v_int1 * 60 + self->v_int2;
@@ -301,7 +442,7 @@ static bool ParseCfgState_add_cst_time(struct ParseCfgState *self)
     assert(min >= 0 && min < 1440);
     assert(max >= 0 && max < 1440);
     for (int i = min; i <= max; ++i)
-        self->ce->cst_hhmm_[i] = true;
+        self->cst.hhmm_[i] = true;
     return true;
 }
 
@@ -369,32 +510,67 @@ static void ParseCfgState_parse_command_key(struct ParseCfgState *self)
     struct Pckm pckm = {0};
 
     if (self->have_command)
-        suicide("Duplicate 'command' value at line %zu\n", self->linenum);
+        ParseCfgState_fail(self, "Duplicate 'command' value at line %zu\n", self->linenum);
 
     %% write init;
     %% write exec;
 
     if (pckm.cs == parse_cmd_key_m_error) {
-        suicide("Malformed 'command' value at line %zu\n", self->linenum);
+        ParseCfgState_fail(self, "Malformed 'command' value at line %zu\n", self->linenum);
     } else if (pckm.cs >= parse_cmd_key_m_first_final) {
         self->have_command = true;
     } else {
-        suicide("Incomplete 'command' value at line %zu\n", self->linenum);
+        ParseCfgState_fail(self, "Incomplete 'command' value at line %zu\n", self->linenum);
     }
 }
 
-static void ParseCfgState_parse_time_unit(const struct ParseCfgState *self, const char *p, unsigned unit, unsigned *dest)
+static void ParseCfgState_add_after(struct ParseCfgState *self, int id)
+{
+    struct Job *j = self->ce;
+    if (id == j->id_)
+        ParseCfgState_fail(self, "ERROR IN CRONTAB: job %d is after itself at line %zu\n",
+                           id, self->linenum);
+    for (unsigned k = 0; k < j->nafter_; ++k) {
+        if (j->after_[k] == id) return;
+    }
+    if (j->nafter_ == JOB_AFTER_MAX)
+        ParseCfgState_fail(self, "ERROR IN CRONTAB: job %d has more than %d upstream jobs\n",
+                           j->id_, JOB_AFTER_MAX);
+    j->after_ = realloc(j->after_, (j->nafter_ + 1) * sizeof *j->after_);
+    if (!j->after_) abort();
+    j->after_[j->nafter_++] = id;
+}
+
+static void ParseCfgState_parse_time_unit(struct ParseCfgState *self, const char *p, unsigned unit, unsigned *dest)
 {
     unsigned t;
     if (!strconv_to_u32(self->time_st, p - 1, &t))
-        suicide("Invalid time unit at line %zu\n", self->linenum);
+        ParseCfgState_fail(self, "Invalid time unit at line %zu\n", self->linenum);
     *dest += unit * t;
 }
 
-static void parse_int_value(const char *p, const char *start, size_t linenum, int *dest)
+static void ParseCfgState_parse_time_ms(struct ParseCfgState *self, const char *p)
+{
+    unsigned t;
+    if (!strconv_to_u32(self->time_st, p - 2, &t))
+        ParseCfgState_fail(self, "Invalid time unit at line %zu\n", self->linenum);
+    self->v_time += t / 1000;
+    self->v_time_ms = t % 1000;
+}
+
+// Only intervals are kept to sub-second precision.
+static unsigned ParseCfgState_whole_secs(struct ParseCfgState *self)
+{
+    if (self->v_time_ms)
+        ParseCfgState_fail(self, "Time at line %zu must be in whole seconds\n", self->linenum);
+    return self->v_time;
+}
+
+static void ParseCfgState_parse_int(struct ParseCfgState *self, const char *p,
+                                    const char *start, int *dest)
 {
     if (!strconv_to_i32(start, p, dest))
-        suicide("Invalid integer value at line %zu\n", linenum);
+        ParseCfgState_fail(self, "Invalid integer value at line %zu\n", self->linenum);
 }
 
 static void swap_int_pair(int *a, int *b) { int t = *a; *a = *b; *b = t; }
@@ -406,7 +582,8 @@ static void swap_int_pair(int *a, int *b) { int t = *a; *a = *b; *b = t; }
     spc = [ \t];
     eqsep = spc* '=' spc*;
 
-    action TUnitSt { ncs->time_st = p; ncs->v_time = 0; }
+    action TUnitSt { ncs->time_st = p; ncs->v_time = 0; ncs->v_time_ms = 0; }
+    action TMsecEn { ParseCfgState_parse_time_ms(ncs, p); }
     action TSecEn  { ParseCfgState_parse_time_unit(ncs, p, 1, &ncs->v_time); }
     action TMinEn  { ParseCfgState_parse_time_unit(ncs, p, 60, &ncs->v_time); }
     action THrEn   { ParseCfgState_parse_time_unit(ncs, p, 3600, &ncs->v_time); }
@@ -418,9 +595,9 @@ static void swap_int_pair(int *a, int *b) { int t = *a; *a = *b; *b = t; }
         ncs->v_int1 = ncs->v_int2 = 0;
         ncs->intv2_exist = false;
     }
-    action IntValEn { parse_int_value(p, ncs->intv_st, ncs->linenum, &ncs->v_int1); }
+    action IntValEn { ParseCfgState_parse_int(ncs, p, ncs->intv_st, &ncs->v_int1); }
     action IntVal2St { ncs->intv2_st = p; }
-    action IntVal2En { parse_int_value(p, ncs->intv2_st, ncs->linenum, &ncs->v_int2); ncs->intv2_exist = true; }
+    action IntVal2En { ParseCfgState_parse_int(ncs, p, ncs->intv2_st, &ncs->v_int2); ncs->intv2_exist = true; }
     action IntValSwap {
         swap_int_pair(&ncs->v_int1, &ncs->v_int3);
         swap_int_pair(&ncs->v_int2, &ncs->v_int4);
@@ -434,7 +611,7 @@ static void swap_int_pair(int *a, int *b) { int t = *a; *a = *b; *b = t; }
     action StrValEn {
         ncs->v_strlen = p > ncs->strv_st ? (size_t)(p - ncs->strv_st) : 0;
         if (ncs->v_strlen >= sizeof ncs->v_str)
-            suicide("error parsing line %zu in crontab: too long\n", ncs->linenum);
+            ParseCfgState_fail(ncs, "error parsing line %zu in crontab: too long\n", ncs->linenum);
         memcpy(ncs->v_str, ncs->strv_st, ncs->v_strlen);
         ncs->v_str[ncs->v_strlen] = 0;
     }
@@ -444,7 +621,8 @@ static void swap_int_pair(int *a, int *b) { int t = *a; *a = *b; *b = t; }
     t_hr   = (digit+ > TUnitSt) 'h' % THrEn;
     t_day  = (digit+ > TUnitSt) 'd' % TDayEn;
     t_week = (digit+ > TUnitSt) 'w' % TWeekEn;
-    t_any = (t_sec | t_min | t_hr | t_day | t_week);
+    t_msec = (digit+ > TUnitSt) 'ms' % TMsecEn;
+    t_any = (t_msec | t_sec | t_min | t_hr | t_day | t_week);
 
     intval = (digit+ > IntValSt % IntValEn);
     timeval = t_any (spc* t_any)*;
@@ -461,10 +639,91 @@ static void swap_int_pair(int *a, int *b) { int t = *a; *a = *b; *b = t; }
 
     maxruns = 'maxruns'i eqsep intval % MaxRunsEn;
 
-    action IntervalEn { ncs->ce->interval_ = ncs->v_time; }
+    action IntervalEn {
+        ncs->ce->interval_ = ncs->v_time;
+        ncs->ce->interval_ms_ = ncs->v_time_ms;
+    }
 
     interval = 'interval'i eqsep timeval % IntervalEn;
 
+    action TimeoutEn { ncs->ce->timeout_ = ParseCfgState_whole_secs(ncs); }
+
+    timeout = 'timeout'i eqsep timeval % TimeoutEn;
+
+    action DeadlineEn { ncs->ce->deadline_ = ParseCfgState_whole_secs(ncs); }
+    action CatchupOnceEn { ncs->ce->catchup_ = JOB_CATCHUP_ONCE; }
+    action CatchupSkipEn { ncs->ce->catchup_ = JOB_CATCHUP_SKIP; }
+    action CatchupStaggerEn { ncs->ce->catchup_ = JOB_CATCHUP_STAGGER; }
+
+    deadline = 'deadline'i eqsep timeval % DeadlineEn;
+    catchup = 'catchup'i eqsep ('once'i % CatchupOnceEn | 'skip'i % CatchupSkipEn |
+                                'stagger'i % CatchupStaggerEn);
+
+    action FailIntervalEn { ncs->ce->fail_interval_ = ParseCfgState_whole_secs(ncs); }
+    action BackoffEn {
+        ncs->ce->backoff_ = ncs->v_int1 > 1 ? (unsigned)ncs->v_int1 : 1;
+    }
+
+    on_failure_interval = 'on_failure_interval'i eqsep timeval % FailIntervalEn;
+    backoff = 'backoff'i eqsep intval % BackoffEn;
+
+    action OutputEn {
+        if (ncs->ce->output_)
+            ParseCfgState_fail(ncs, "Duplicate 'output' value at line %zu\n", ncs->linenum);
+        ncs->ce->output_ = strdup(ncs->v_str);
+        if (!ncs->ce->output_) abort();
+    }
+    action OutputSizeEn {
+        ncs->ce->output_max_kb_ = ncs->v_int1 > 0 ? (unsigned)ncs->v_int1 : 0;
+    }
+
+    action AfterEn {
+        int upid;
+        ParseCfgState_parse_int(ncs, p, ncs->intv_st, &upid);
+        ParseCfgState_add_after(ncs, upid);
+    }
+
+    action CpusEn {
+        if (ncs->ce->cpus_)
+            ParseCfgState_fail(ncs, "Duplicate 'cpus' value at line %zu\n", ncs->linenum);
+        if (!cpu_list_valid(ncs->v_str))
+            ParseCfgState_fail(ncs, "Invalid CPU list at line %zu: '%s'\n", ncs->linenum, ncs->v_str);
+        ncs->ce->cpus_ = strdup(ncs->v_str);
+        if (!ncs->ce->cpus_) abort();
+    }
+
+    action CgroupEn {
+        if (ncs->ce->cgroup_)
+            ParseCfgState_fail(ncs, "Duplicate 'cgroup' value at line %zu\n", ncs->linenum);
+        if (!cgroup_name_valid(ncs->v_str))
+            ParseCfgState_fail(ncs, "Invalid cgroup name at line %zu: '%s'\n", ncs->linenum, ncs->v_str);
+        ncs->ce->cgroup_ = strdup(ncs->v_str);
+        if (!ncs->ce->cgroup_) abort();
+    }
+    action CpuWeightEn {
+        if (ncs->v_int1 < 1 || ncs->v_int1 > 10000)
+            ParseCfgState_fail(ncs, "cpu_weight must be within [1,10000] at line %zu\n", ncs->linenum);
+        ncs->ce->cpu_weight_ = (unsigned)ncs->v_int1;
+    }
+    action IoWeightEn {
+        if (ncs->v_int1 < 1 || ncs->v_int1 > 10000)
+            ParseCfgState_fail(ncs, "io_weight must be within [1,10000] at line %zu\n", ncs->linenum);
+        ncs->ce->io_weight_ = (unsigned)ncs->v_int1;
+    }
+    action MemoryHighEn {
+        ncs->ce->memory_high_kb_ = ncs->v_int1 > 0 ? (unsigned)ncs->v_int1 : 0;
+    }
+
+    output = 'output'i eqsep stringval % OutputEn;
+    cgroup = 'cgroup'i eqsep stringval % CgroupEn;
+    cpu_weight = 'cpu_weight'i eqsep intval % CpuWeightEn;
+    io_weight = 'io_weight'i eqsep intval % IoWeightEn;
+    memory_high = 'memory_high'i eqsep intval % MemoryHighEn;
+    cpus = 'cpus'i eqsep stringval % CpusEn;
+    afterid = digit+ > IntValSt % AfterEn;
+    after = 'after'i eqsep afterid (spc* ',' spc* afterid)*;
+    output_size = 'output_size'i eqsep intval % OutputSizeEn;
+
     xhour = digit | ('0' digit) | ('1' digit) | '20' | '21' | '22' | '23';
     xminute = ('0' | '1' | '2' | '3' | '4' | '5') digit;
     hhmm = xhour > IntValSt % IntValEn ':' xminute > IntVal2St % IntVal2En;
@@ -485,10 +744,12 @@ static void swap_int_pair(int *a, int *b) { int t = *a; *a = *b; *b = t; }
     command = 'command'i eqsep stringval % CommandEn;
 
     cmds = command | time | weekday | day |
-           month | interval | maxruns | journal;
+           month | interval | maxruns | journal | timeout | deadline | catchup |
+           output | output_size | after | on_failure_interval | backoff |
+           cpus | cgroup | cpu_weight | io_weight | memory_high;
 
     action JobIdSt { ncs->jobid_st = p; }
-    action JobIdEn { parse_int_value(p, ncs->jobid_st, ncs->linenum, &ncs->ce->id_); }
+    action JobIdEn { ParseCfgState_parse_int(ncs, p, ncs->jobid_st, &ncs->ce->id_); }
     action CreateCe { ParseCfgState_finish_ce(ncs); ParseCfgState_create_ce(ncs); }
 
     jobid = ('!' > CreateCe) (digit+ > JobIdSt) % JobIdEn;
@@ -536,24 +797,62 @@ static size_t count_config_jobs(FILE *f)
     return r;
 }
 
-void parse_config(char const *path, char const *execfile,
-                  struct Job **stk, struct Job **deadstk)
+// A user may have at most users_max_jobs() jobs; the crontab of a user
+// with more is skipped, so that one user can't flood the schedule.
+static bool user_jobs_ok(char const *path, const struct User *user, size_t njobs)
 {
-    struct ParseCfgState ncs;
-    ParseCfgState_init(&ncs, stk, deadstk);
+    unsigned max = users_max_jobs();
+    if (!user || !max || njobs <= max) return true;
+    log_line("Crontab '%s' has %zu jobs, more than the %u allowed per user; skipping it\n",
+             path, njobs, max);
+    return false;
+}
 
+static void destroy_jobs(struct Job **jobs, size_t *njobs)
+{
+    for (size_t i = 0; i < *njobs; ++i) job_destroy(&(*jobs)[i]);
+    free(*jobs);
+    *jobs = NULL;
+    *njobs = 0;
+}
+
+// Returns false if the crontab was skipped, as the crontab of a user is
+// if it has errors.
+static bool parse_config_file(char const *path, struct User *user,
+                              struct Job **jobs, size_t *njobs)
+{
     char buf[MAX_LINE];
     FILE *f = fopen(path, "r");
-    if (!f)
-        suicide("Failed to open config file '%s': %s\n", path, strerror(errno));
-    g_njobs = count_config_jobs(f);
-    if (!g_njobs) {
-        log_line("No jobs found in config file.  Exiting.\n");
-        exit(EXIT_SUCCESS);
+    if (!f) {
+        if (!user)
+            suicide("Failed to open config file '%s': %s\n", path, strerror(errno));
+        log_line("Failed to open crontab '%s': %s; skipping it\n", path, strerror(errno));
+        *jobs = NULL;
+        *njobs = 0;
+        return false;
+    }
+    *njobs = count_config_jobs(f);
+    *jobs = NULL;
+    if (!user_jobs_ok(path, user, *njobs)) {
+        *njobs = 0;
+        fclose(f);
+        return false;
+    }
+    if (*njobs) {
+        *jobs = malloc(*njobs * sizeof(struct Job));
+        if (!*jobs) abort();
+    }
+
+    struct ParseCfgState ncs;
+    ParseCfgState_init(&ncs, path, user, *jobs, *njobs);
+    if (setjmp(ncs.fail)) {
+        // The jobs before ce are complete, and ce itself has been started.
+        *njobs = (size_t)(ncs.ce - *jobs) + (ncs.seen_job && ncs.ce != ncs.ce_end);
+        destroy_jobs(jobs, njobs);
+        fclose(f);
+        log_line("Crontab '%s' has errors; skipping it\n", path);
+        return false;
     }
-    g_jobs = malloc(g_njobs * sizeof(struct Job));
-    if (!g_jobs) abort();
-    ncs.ce = g_jobs;
     while (fgets(buf, sizeof buf, f)) {
         size_t llen = strlen(buf);
         if (llen == 0)
@@ -562,18 +861,237 @@ void parse_config(char const *path, char const *execfile,
             buf[--llen] = 0;
         ++ncs.linenum;
         if (do_parse_config(&ncs, buf, llen) < 0)
-            suicide("Config file '%s' is malformed at line %zu\n", path, ncs.linenum);
+            ParseCfgState_fail(&ncs, "Config file '%s' is malformed at line %zu\n",
+                               path, ncs.linenum);
     }
     if (ferror(f)) {
         log_line("IO error reading config file '%s'\n", path);
         exit(EXIT_FAILURE);
     }
     ParseCfgState_finish_ce(&ncs);
-    parse_history(execfile);
+    fclose(f);
+    return true;
+}
+
+void parse_config_jobs(char const *path)
+{
+    parse_config_file(path, NULL, &g_jobs, &g_njobs);
+    job_id_index_destroy();
+    if (!g_njobs) {
+        log_line("No jobs found in config file.  Exiting.\n");
+        exit(EXIT_SUCCESS);
+    }
+}
+
+struct CfgFrag {
+    char *path;
+    char *cache_path;
+    struct User *user;
+    struct Job *jobs;
+    size_t njobs;
+};
+
+static void parse_config_frag(struct CfgFrag *self)
+{
+    if (self->cache_path
+        && cache_load(self->cache_path, self->path, &self->jobs, &self->njobs)) {
+        if (!user_jobs_ok(self->path, self->user, self->njobs)) {
+            destroy_jobs(&self->jobs, &self->njobs);
+            return;
+        }
+        for (size_t i = 0; i < self->njobs; ++i) {
+            self->jobs[i].user_ = self->user;
+            const char *dup = job_id_index_add(&self->jobs[i], self->path);
+            if (!dup) continue;
+            if (!self->user)
+                suicide("ERROR IN CRONTAB: duplicate entry for job %d in '%s' and '%s'\n",
+                        self->jobs[i].id_, dup, self->path);
+            log_line("Crontab '%s' has a duplicate entry for job %d; skipping it\n",
+                     self->path, self->jobs[i].id_);
+            destroy_jobs(&self->jobs, &self->njobs);
+            return;
+        }
+    } else {
+        struct stat st;
+        uint64_t hash;
+        bool cacheable = self->cache_path && cache_src_hash(self->path, &st, &hash);
+        if (parse_config_file(self->path, self->user, &self->jobs, &self->njobs) && cacheable)
+            cache_write(self->cache_path, self->path, &st, hash, self->jobs, self->njobs);
+    }
+    // The after= links of a user stay within the user's crontab, so they
+    // are checked here, where a bad one only loses that crontab.
+    if (self->user && !job_deps_link(self->jobs, self->njobs)) {
+        log_line("Crontab '%s' has errors; skipping it\n", self->path);
+        destroy_jobs(&self->jobs, &self->njobs);
+    }
+}
+
+struct CfgFragQueue {
+    struct CfgFrag *frags;
+    size_t nfrags;
+    size_t next;
+};
+
+static void *parse_config_frag_thread(void *arg)
+{
+    struct CfgFragQueue *q = arg;
+    for (;;) {
+        size_t i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED);
+        if (i >= q->nfrags) break;
+        parse_config_frag(&q->frags[i]);
+    }
+    return NULL;
+}
+
+static char *path_join(char const *dir, char const *name, char const *suffix)
+{
+    size_t dl = strlen(dir), nl = strlen(name), sl = strlen(suffix);
+    char *r = malloc(dl + nl + sl + 2);
+    if (!r) abort();
+    memcpy(r, dir, dl);
+    r[dl] = '/';
+    memcpy(r + dl + 1, name, nl);
+    memcpy(r + dl + 1 + nl, suffix, sl + 1);
+    return r;
+}
+
+static int strcmp_p(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// Returns the sorted names of the crontab fragments in dir.  Hidden
+// files and editor backups (ending in '~') are skipped.
+static char **list_config_dir(char const *dir, size_t *n)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+        suicide("Failed to open crontab directory '%s': %s\n", dir, strerror(errno));
+    char **names = NULL;
+    size_t cap = 0;
+    *n = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        size_t l = strlen(de->d_name);
+        if (de->d_name[0] == '.' || de->d_name[l - 1] == '~') continue;
+        struct stat st;
+        char *p = path_join(dir, de->d_name, "");
+        bool reg = !stat(p, &st) && S_ISREG(st.st_mode);
+        free(p);
+        if (!reg) continue;
+        if (*n == cap) {
+            cap = cap ? cap * 2 : 16;
+            names = realloc(names, cap * sizeof *names);
+            if (!names) abort();
+        }
+        names[*n] = strdup(de->d_name);
+        if (!names[*n]) abort();
+        ++*n;
+    }
+    closedir(d);
+    if (*n) qsort(names, *n, sizeof *names, strcmp_p);
+    return names;
+}
+
+void parse_config_dir(char const *dir, char const *cachedir)
+{
+    size_t nfrags;
+    char **names = list_config_dir(dir, &nfrags);
+    struct stat st;
+    if (cachedir && (stat(cachedir, &st) || !S_ISDIR(st.st_mode)))
+        cachedir = NULL;
+
+    struct CfgFrag *frags = calloc(nfrags + 1, sizeof *frags);
+    if (!frags) abort();
+    size_t k = 0;
+    for (size_t i = 0; i < nfrags; ++i) {
+        // Accounts are looked up here as getpwnam() is not thread-safe.
+        struct User *u = NULL;
+        if (users_enabled() && !(u = users_get(names[i]))) {
+            log_line("Crontab '%s/%s' is not named for a user; skipping it\n", dir, names[i]);
+            free(names[i]);
+            continue;
+        }
+        frags[k].path = path_join(dir, names[i], "");
+        if (cachedir) frags[k].cache_path = path_join(cachedir, names[i], ".cache");
+        frags[k++].user = u;
+        free(names[i]);
+    }
+    free(names);
+    nfrags = k;
+
+    struct CfgFragQueue q = { .frags = frags, .nfrags = nfrags };
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = ncpu > 1 ? (size_t)ncpu - 1 : 0;
+    if (nthreads >= nfrags) nthreads = nfrags ? nfrags - 1 : 0;
+    pthread_t *threads = calloc(nthreads + 1, sizeof *threads);
+    if (!threads) abort();
+    for (size_t i = 0; i < nthreads; ++i) {
+        if (pthread_create(&threads[i], NULL, parse_config_frag_thread, &q)) {
+            nthreads = i;
+            break;
+        }
+    }
+    parse_config_frag_thread(&q);
+    for (size_t i = 0; i < nthreads; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    job_id_index_destroy();
+
+    g_njobs = 0;
+    for (size_t i = 0; i < nfrags; ++i) g_njobs += frags[i].njobs;
+    if (!g_njobs) {
+        log_line("No jobs found in crontab directory.  Exiting.\n");
+        exit(EXIT_SUCCESS);
+    }
+    g_jobs = malloc(g_njobs * sizeof(struct Job));
+    if (!g_jobs) abort();
+    struct Job *j = g_jobs;
+    for (size_t i = 0; i < nfrags; ++i) {
+        if (frags[i].njobs) memcpy(j, frags[i].jobs, frags[i].njobs * sizeof *j);
+        j += frags[i].njobs;
+        free(frags[i].jobs);
+        free(frags[i].path);
+        free(frags[i].cache_path);
+    }
+    free(frags);
+}
+
+void parse_config_defs(char const *path, char const *dir, char const *cachefile)
+{
+    if (dir)
+        parse_config_dir(dir, cachefile);
+    else if (!cachefile || !cache_load(cachefile, path, &g_jobs, &g_njobs))
+        parse_config_jobs(path);
+    job_deps_resolve(g_jobs, g_njobs);
+}
+
+void parse_config(char const *path, char const *dir, char const *execfile,
+                  char const *cachefile, struct JobHeap *heap)
+{
+    parse_config_defs(path, dir, cachefile);
+    if (users_enabled()) {
+        // The jobs of each user are together in g_jobs.
+        for (size_t i = 0; i < g_njobs; ++i) {
+            if (i && g_jobs[i].user_ == g_jobs[i - 1].user_) continue;
+            char *upath = history_user_path(g_jobs[i].user_);
+            parse_history(upath, g_jobs[i].user_, true);
+            free(upath);
+        }
+        parse_history(history_journal_path(), NULL, true);
+    } else if (!history_load_binary()) {
+        parse_history(execfile, NULL, false);
+        parse_history(history_journal_path(), NULL, true);
+    }
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts))
+        suicide("clock_gettime failed: %s\n", strerror(errno));
+    job_catchup_stagger(g_jobs, g_njobs, &ts);
 
     for (struct Job *j = g_jobs, *jend = g_jobs + g_njobs; j != jend; ++j) {
-        bool alive = j->exectime_ && (j->maxruns_ == 0 || j->numruns_ < j->maxruns_);
-        job_insert(alive ? stk : deadstk, j);
+        bool alive = j->exectime_ && !j->nafter_
+                     && (j->maxruns_ == 0 || j->numruns_ < j->maxruns_);
+        if (alive) job_heap_push(heap, j);
     }
-    fclose(f);
 }
@@ -0,0 +1,130 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sched.h"
+#include "forecast.h"
+
+#define FORECAST_TOP 10
+
+struct burst {
+    time_t t;
+    unsigned n;
+};
+
+// Keeps the FORECAST_TOP largest entries, largest first.
+static void burst_add(struct burst *top, time_t t, unsigned n)
+{
+    if (n <= top[FORECAST_TOP - 1].n) return;
+    size_t i = FORECAST_TOP - 1;
+    for (; i > 0 && top[i - 1].n < n; --i) top[i] = top[i - 1];
+    top[i] = (struct burst){ .t = t, .n = n };
+}
+
+static const char *fmt_time(char *buf, size_t len, time_t t, bool secs)
+{
+    struct tm tm;
+    size_t r = 0;
+    if (localtime_r(&t, &tm)) {
+        r = secs ? strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm)
+                 : strftime(buf, len, "%Y-%m-%d %H:%M", &tm);
+    }
+    if (!r) snprintf(buf, len, "%ld", (long)t);
+    return buf;
+}
+
+void forecast(struct JobHeap *q, const struct timespec *start, unsigned days)
+{
+    // With TZ unset, glibc stats /etc/localtime on every localtime() and
+    // mktime() call.  The zone won't change during a forecast, so pin it.
+    if (!getenv("TZ")) setenv("TZ", ":/etc/localtime", 0);
+
+    time_t end = start->tv_sec + (time_t)days * 86400;
+    time_t mbase = start->tv_sec - start->tv_sec % 60;
+    time_t hbase = start->tv_sec - start->tv_sec % 3600;
+    size_t nmin = (size_t)(end - mbase + 59) / 60;
+    size_t nhr = (size_t)(end - hbase + 3599) / 3600;
+    uint32_t *mins = calloc(nmin, sizeof *mins);
+    uint32_t *hrs = calloc(nhr, sizeof *hrs);
+    if (!mins || !hrs) abort();
+
+    struct burst top_sec[FORECAST_TOP] = {0}, top_min[FORECAST_TOP] = {0};
+    time_t cur_sec = 0;
+    unsigned cur_n = 0;
+    size_t total = 0, njobs = q->n;
+
+    // The same dispatch loop as the daemon, except that time advances to
+    // the next exectime instead of sleeping.
+    struct timespec ts = *start;
+    while (q->n) {
+        struct Job *j = q->v[0].job;
+        struct timespec e = job_exectime(j);
+        if (timespec_before(&ts, &e)) ts = e;
+        if (ts.tv_sec >= end) break;
+
+        ++mins[(ts.tv_sec - mbase) / 60];
+        ++hrs[(ts.tv_sec - hbase) / 3600];
+        ++total;
+        if (ts.tv_sec != cur_sec) {
+            burst_add(top_sec, cur_sec, cur_n);
+            cur_sec = ts.tv_sec;
+            cur_n = 0;
+        }
+        ++cur_n;
+
+        job_mark_run(j, &ts);
+        if (j->exectime_ && (j->numruns_ < j->maxruns_ || j->maxruns_ == 0))
+            job_heap_fix(q, j);
+        else
+            job_heap_remove(q, j);
+    }
+    burst_add(top_sec, cur_sec, cur_n);
+
+    uint32_t peak_min = 0, peak_hr = 0;
+    for (size_t i = 0; i < nmin; ++i) {
+        if (mins[i] > peak_min) peak_min = mins[i];
+        burst_add(top_min, mbase + (time_t)i * 60, mins[i]);
+    }
+    for (size_t i = 0; i < nhr; ++i)
+        if (hrs[i] > peak_hr) peak_hr = hrs[i];
+
+    char buf[64];
+    printf("Forecast of %zu jobs over %u days from %s.\n", njobs, days,
+           fmt_time(buf, sizeof buf, start->tv_sec, true));
+    printf("Total dispatches: %zu\n", total);
+    printf("Peak per minute: %u\nPeak per hour: %u\n", peak_min, peak_hr);
+
+    printf("\nDispatches per hour:\n");
+    for (size_t i = 0; i < nhr; ++i) {
+        printf("  %s  %u\n", fmt_time(buf, sizeof buf, hbase + (time_t)i * 3600, false),
+               hrs[i]);
+    }
+
+    // Per-minute counts are summarized as the number of minutes that see
+    // each count; a full table would be 1440 lines per day.
+    uint32_t *mhist = calloc((size_t)peak_min + 1, sizeof *mhist);
+    if (!mhist) abort();
+    for (size_t i = 0; i < nmin; ++i) ++mhist[mins[i]];
+    printf("\nMinutes by dispatch count:\n");
+    for (uint32_t k = 0; k <= peak_min; ++k) {
+        if (mhist[k]) printf("  %u  %u\n", k, mhist[k]);
+    }
+    free(mhist);
+
+    printf("\nBusiest minutes:\n");
+    for (size_t i = 0; i < FORECAST_TOP && top_min[i].n; ++i) {
+        printf("  %s  %u\n", fmt_time(buf, sizeof buf, top_min[i].t, false),
+               top_min[i].n);
+    }
+    printf("\nLargest bursts (dispatches in the same second):\n");
+    for (size_t i = 0; i < FORECAST_TOP && top_sec[i].n; ++i) {
+        printf("  %s  %u\n", fmt_time(buf, sizeof buf, top_sec[i].t, true),
+               top_sec[i].n);
+    }
+    free(hrs);
+    free(mins);
+}
@@ -0,0 +1,13 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_FORECAST_H_
+#define NCRON_FORECAST_H_
+#include <time.h>
+
+struct JobHeap;
+
+// Runs the scheduler in virtual time from start for the given number of
+// days, without spawning anything, and prints dispatch load statistics.
+// The jobs in the heap are advanced as if they had run.
+void forecast(struct JobHeap *q, const struct timespec *start, unsigned days);
+#endif
@@ -0,0 +1,21 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_HASH_H_
+#define NCRON_HASH_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#define FNV1A64_INIT 0xcbf29ce484222325ULL
+
+// FNV-1a; not cryptographic, only used to detect identical contents.
+static inline uint64_t fnv1a64(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#endif
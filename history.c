@@ -0,0 +1,1048 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "nk/log.h"
+#include "nk/io.h"
+#include "hash.h"
+#include "sched.h"
+#include "history.h"
+#include "users.h"
+#include "trace.h"
+
+extern int gflags_debug;
+extern size_t g_njobs;
+extern struct Job *g_jobs;
+
+// History is kept as a snapshot file of "id=numruns:lasttime[:interval]"
+// lines, where the interval is present only while a job is running at a
+// longer interval because of failures, and
+// an append-only journal of the same records.  At startup the snapshot is
+// read and then the journal is replayed over it.  Compaction writes a new
+// snapshot and discards the journal.
+//
+// Alternatively, the history file may be in a binary format: a header
+// followed by fixed-size, checksummed records.  It is mapped, and each job
+// owns one record slot, so recording a run is a single store into the
+// mapping and there is neither a journal nor compaction.
+//
+// With --users, each user's jobs have a text snapshot of their own, while
+// the journal is shared and its records start with "USER:".
+//
+// Once the daemon is running, all history I/O is done by a writer thread
+// so that a slow disk never delays dispatch.  The scheduler hands it
+// updates through a lock-free single-producer queue of job indices; the
+// values themselves travel through a per-job seqlock, so a job is queued at
+// most once and the queue can never fill.  The writer keeps its own copy
+// of the history of every job, and never looks at g_jobs while running.
+
+#define HISTORY_MAGIC "NCRONHST"
+#define HISTORY_VERSION 1
+
+struct hist_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint64_t nslots;
+};
+
+struct hist_rec {
+    int32_t id;
+    uint32_t numruns;
+    int64_t lasttime;
+    uint32_t interval; // cur_interval_
+    uint32_t used;
+    uint32_t sum; // covers the preceding fields
+    uint32_t pad_;
+};
+
+// Longest record: "-2147483648=4294967295:-9223372036854775808:4294967295\n"
+#define HISTORY_RECORD_MAX 64
+
+// Syncs slower than this are logged even without -V.
+#define HISTORY_SLOW_SYNC_NS 1000000000ULL
+
+static bool g_readonly;
+static bool g_per_user;
+static char *g_path;
+static char *g_path_tmp;
+static char *g_journal_path;
+static char *g_dir_path;
+static int g_journal_fd = -1;
+static size_t g_journal_records; // appended since the last compaction
+static bool g_durable;
+static unsigned g_window_ms;
+static struct history_stats g_stats;
+
+// Binary format state.
+static bool g_binary;
+static int g_bin_fd = -1;
+static void *g_map;
+static size_t g_map_size;
+static struct hist_rec *g_recs;
+static size_t g_nslots;
+static size_t g_dirty_lo = SIZE_MAX; // slot range awaiting msync()
+static size_t g_dirty_hi;
+
+// The writer thread's copy of each job's history, indexed like g_jobs.
+struct hist_ent {
+    int id;
+    unsigned int numruns;
+    unsigned int interval;
+    time_t lasttime;
+    uint32_t hslot;
+    const struct User *user;
+};
+static struct hist_ent *g_ents;
+
+// Latest values handed from the scheduler to the writer, indexed like
+// g_jobs.  Written only by the scheduler; seq is odd during a write.
+struct hist_xfer {
+    unsigned int seq;
+    unsigned int numruns;
+    unsigned int interval;
+    int64_t lasttime;
+    bool queued;
+};
+static struct hist_xfer *g_xfer;
+static uint32_t *g_ring; // job indices; capacity >= g_njobs
+static size_t g_ring_mask;
+static size_t g_ring_head; // written by the scheduler
+static size_t g_ring_tail; // private to the writer
+static int g_wake_fd = -1;
+static bool g_stop;
+static bool g_writer_running;
+static pthread_t g_writer;
+
+// Records queued for the next commit.
+static char *g_buf;
+static size_t g_buf_len;
+static size_t g_buf_size;
+static size_t g_buf_records;
+static struct timespec g_buf_deadline;
+
+static char *path_suffix(char const *path, char const *suffix)
+{
+    size_t l = strlen(path), sl = strlen(suffix);
+    char *r = malloc(l + sl + 1);
+    if (!r) abort();
+    memcpy(r, path, l);
+    memcpy(r + l, suffix, sl + 1);
+    return r;
+}
+
+void history_init(char const *path, bool readonly, bool per_user)
+{
+    g_readonly = readonly;
+    g_per_user = per_user;
+    g_path = path_suffix(path, "");
+    g_path_tmp = path_suffix(path, "~");
+    if (per_user) {
+        g_journal_path = path_suffix(path, "/.journal");
+        g_dir_path = path_suffix(path, "");
+        return;
+    }
+    g_journal_path = path_suffix(path, ".journal");
+    g_dir_path = path_suffix(path, "");
+    char *sl = strrchr(g_dir_path, '/');
+    if (!sl) strcpy(g_dir_path, ".");
+    else if (sl == g_dir_path) sl[1] = 0;
+    else *sl = 0;
+}
+
+char const *history_path(void) { return g_path; }
+char const *history_journal_path(void) { return g_journal_path; }
+
+char *history_user_path(const struct User *user)
+{
+    size_t l = strlen(g_path), nl = strlen(user->name);
+    char *r = malloc(l + nl + 2);
+    if (!r) abort();
+    memcpy(r, g_path, l);
+    r[l] = '/';
+    memcpy(r + l + 1, user->name, nl + 1);
+    return r;
+}
+
+void history_set_durable(bool durable, unsigned window_ms)
+{
+    g_durable = durable;
+    g_window_ms = window_ms;
+}
+
+const struct history_stats *history_get_stats(void) { return &g_stats; }
+
+// The stats have one writer at a time but may be read by the main thread
+// while the writer thread runs.
+static void stat_add(uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static void stat_max(uint64_t *p, uint64_t v)
+{
+    if (v > __atomic_load_n(p, __ATOMIC_RELAXED)) __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+void history_stats_read(struct history_stats *hs)
+{
+#define STAT_READ(f) hs->f = __atomic_load_n(&g_stats.f, __ATOMIC_RELAXED)
+    STAT_READ(commits);
+    STAT_READ(records);
+    STAT_READ(syncs);
+    STAT_READ(sync_ns_total);
+    STAT_READ(sync_ns_max);
+    STAT_READ(timed_commits);
+    STAT_READ(commit_ns_total);
+    STAT_READ(commit_ns_max);
+#undef STAT_READ
+}
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts)) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void history_sync_done(char const *path, uint64_t st)
+{
+    uint64_t el = mono_ns() - st;
+    stat_add(&g_stats.syncs, 1);
+    stat_add(&g_stats.sync_ns_total, el);
+    stat_max(&g_stats.sync_ns_max, el);
+    if (el >= HISTORY_SLOW_SYNC_NS || gflags_debug)
+        nk_log(el >= HISTORY_SLOW_SYNC_NS ? NK_LOG_WARN : NK_LOG_DEBUG,
+               "SYNC %s took %lu.%06lu s\n", path,
+                 el / 1000000000, (el % 1000000000) / 1000);
+}
+
+// fdatasync() if dataonly, else fsync(), while keeping latency stats.
+static bool history_sync(int fd, char const *path, bool dataonly)
+{
+    uint64_t st = mono_ns();
+    if (dataonly ? fdatasync(fd) : fsync(fd)) {
+        log_line("Failed to sync %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    history_sync_done(path, st);
+    return true;
+}
+
+// Syncs the mapped records in slots [lo, hi].
+static bool history_msync(size_t lo, size_t hi)
+{
+    static size_t pgsz;
+    if (!pgsz) pgsz = (size_t)sysconf(_SC_PAGESIZE);
+    size_t b = sizeof(struct hist_hdr) + lo * sizeof *g_recs;
+    size_t e = sizeof(struct hist_hdr) + (hi + 1) * sizeof *g_recs;
+    b -= b % pgsz;
+    uint64_t st = mono_ns();
+    if (msync((char *)g_map + b, e - b, MS_SYNC)) {
+        log_line("Failed to sync %s: %s\n", g_path, strerror(errno));
+        return false;
+    }
+    history_sync_done(g_path, st);
+    return true;
+}
+
+static uint32_t hist_rec_sum(const struct hist_rec *r)
+{
+    return (uint32_t)fnv1a64(FNV1A64_INIT, r, offsetof(struct hist_rec, sum));
+}
+
+static bool hist_rec_valid(const struct hist_rec *r)
+{
+    return r->used == 1 && r->sum == hist_rec_sum(r);
+}
+
+static void hist_rec_store(struct hist_rec *r, int id, unsigned int numruns,
+                           time_t lasttime, unsigned int interval)
+{
+    struct hist_rec t = { .id = id, .numruns = numruns, .lasttime = lasttime,
+                          .interval = interval, .used = 1 };
+    t.sum = hist_rec_sum(&t);
+    *r = t;
+}
+
+// Formats a text record into buf, which holds HISTORY_RECORD_MAX bytes.
+static int hist_fmt(char *buf, int id, unsigned int numruns, time_t lasttime,
+                    unsigned int interval)
+{
+    int r = interval
+        ? snprintf(buf, HISTORY_RECORD_MAX, "%d=%u:%ld:%u\n", id, numruns, lasttime, interval)
+        : snprintf(buf, HISTORY_RECORD_MAX, "%d=%u:%ld\n", id, numruns, lasttime);
+    if (r < 0 || r >= HISTORY_RECORD_MAX) abort();
+    return r;
+}
+
+bool history_apply(struct Job *j, unsigned int numruns, time_t lasttime,
+                   unsigned int interval, const struct timespec *ts,
+                   bool startup)
+{
+    if (lasttime < j->lasttime_) return false;
+    j->numruns_ = numruns;
+    j->lasttime_ = lasttime;
+    // Only kept while the job is still configured to adapt its interval.
+    j->cur_interval_ = j->fail_interval_ || j->backoff_ > 1 ? interval : 0;
+    if (startup) job_load_exectime(j, ts);
+    else job_set_initial_exectime(j, ts);
+    return true;
+}
+
+// Returns true if fd refers to a binary history file, leaving the file
+// offset just past the header, which is stored in hdr.
+static bool history_read_hdr(int fd, struct hist_hdr *hdr)
+{
+    ssize_t r = safe_read(fd, (char *)hdr, sizeof *hdr);
+    if (r != (ssize_t)sizeof *hdr || memcmp(hdr->magic, HISTORY_MAGIC, sizeof hdr->magic))
+        return false;
+    if (hdr->version != HISTORY_VERSION || hdr->rec_size != sizeof(struct hist_rec))
+        suicide("History file '%s' has an unsupported format version\n", g_path);
+    return true;
+}
+
+// Reads the hdr->nslots records that follow the header into a new array.
+// Damaged records are logged and left unused.  Returns NULL if the file is
+// truncated.
+static struct hist_rec *history_read_recs(int fd, const struct hist_hdr *hdr)
+{
+    struct hist_rec *recs = calloc(hdr->nslots ? hdr->nslots : 1, sizeof *recs);
+    if (!recs) abort();
+    for (uint64_t i = 0; i < hdr->nslots; ++i) {
+        struct hist_rec *r = &recs[i];
+        if (safe_read(fd, (char *)r, sizeof *r) != (ssize_t)sizeof *r) goto trunc;
+        if (r->used && !hist_rec_valid(r)) {
+            log_line("Damaged history record at slot %lu; ignoring\n", i);
+            *r = (struct hist_rec){ .used = 0 };
+        }
+    }
+    return recs;
+trunc:
+    free(recs);
+    log_line("History file '%s' is truncated\n", g_path);
+    return NULL;
+}
+
+static bool history_write_recs(FILE *f, const struct hist_rec *recs, size_t n)
+{
+    struct hist_hdr hdr = { .magic = HISTORY_MAGIC, .version = HISTORY_VERSION,
+                            .rec_size = sizeof(struct hist_rec), .nslots = n };
+    return fwrite(&hdr, sizeof hdr, 1, f) == 1
+        && (!n || fwrite(recs, sizeof *recs, n, f) == n);
+}
+
+static void history_map(size_t nslots)
+{
+    g_map_size = sizeof(struct hist_hdr) + nslots * sizeof(struct hist_rec);
+    g_map = mmap(NULL, g_map_size, g_readonly ? PROT_READ : PROT_READ | PROT_WRITE,
+                 g_readonly ? MAP_PRIVATE : MAP_SHARED, g_bin_fd, 0);
+    if (g_map == MAP_FAILED)
+        suicide("Failed to map history file '%s': %s\n", g_path, strerror(errno));
+    g_recs = (struct hist_rec *)((struct hist_hdr *)g_map + 1);
+    g_nslots = nslots;
+}
+
+// Applies the records in g_recs to g_jobs, which get the slots they own.
+// Gives each job that has no slot yet the record with its id, if any; if
+// several records have the id, the newest one wins, as in a text file.
+// On a reload, damage isn't reported again and missed runs aren't caught up.
+static void history_claim_slots(bool reload)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts))
+        suicide("clock_gettime failed: %s\n", strerror(errno));
+
+    // Jobs that already own a slot keep it, and their state.
+    bool *claim = malloc(g_njobs ? g_njobs : 1);
+    if (!claim) abort();
+    for (size_t i = 0; i < g_njobs; ++i) claim[i] = g_jobs[i].hslot_ == UINT32_MAX;
+    struct Job **byid = job_index_by_id(g_jobs, g_njobs);
+    for (size_t i = 0; i < g_nslots; ++i) {
+        const struct hist_rec *r = &g_recs[i];
+        if (!r->used) continue;
+        if (!hist_rec_valid(r)) {
+            if (!reload) log_line("Damaged history record at slot %zu; ignoring\n", i);
+            continue;
+        }
+        struct Job *j = job_index_find(byid, g_njobs, NULL, r->id);
+        if (j && claim[j - g_jobs]
+            && history_apply(j, r->numruns, r->lasttime, r->interval, &ts,
+                             !reload))
+            j->hslot_ = (uint32_t)i;
+    }
+    free(byid);
+    free(claim);
+}
+
+static void history_apply_slots(void)
+{
+    for (size_t i = 0; i < g_njobs; ++i) g_jobs[i].hslot_ = UINT32_MAX;
+    history_claim_slots(false);
+}
+
+// Jobs that have never run get fresh slots at the end.  The space is
+// allocated now so that stores into the mapping can't fault later.
+static void history_add_slots(void)
+{
+    size_t nslots = g_nslots;
+    for (size_t i = 0; i < g_njobs; ++i) {
+        if (g_jobs[i].hslot_ == UINT32_MAX) g_jobs[i].hslot_ = (uint32_t)nslots++;
+    }
+    if (nslots != g_nslots) {
+        munmap(g_map, g_map_size);
+        size_t nsize = sizeof(struct hist_hdr) + nslots * sizeof(struct hist_rec);
+        int r = posix_fallocate(g_bin_fd, 0, (off_t)nsize);
+        if (r)
+            suicide("Failed to extend history file '%s': %s\n", g_path, strerror(r));
+        history_map(nslots);
+        for (size_t i = 0; i < g_njobs; ++i) {
+            const struct Job *j = &g_jobs[i];
+            if (!g_recs[j->hslot_].used)
+                hist_rec_store(&g_recs[j->hslot_], j->id_, j->numruns_, j->lasttime_,
+                               j->cur_interval_);
+        }
+        ((struct hist_hdr *)g_map)->nslots = nslots;
+        if (g_durable && !history_msync(0, nslots - 1)) exit(EXIT_FAILURE);
+    }
+}
+
+bool history_load_binary(void)
+{
+    if (g_per_user) return false;
+    g_bin_fd = open(g_path, (g_readonly ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+    if (g_bin_fd < 0) return false; // Reported by the text parser.
+    struct hist_hdr hdr;
+    struct stat st;
+    if (!history_read_hdr(g_bin_fd, &hdr)) {
+        close(g_bin_fd);
+        g_bin_fd = -1;
+        return false;
+    }
+    if (fstat(g_bin_fd, &st))
+        suicide("Failed to stat history file '%s': %s\n", g_path, strerror(errno));
+    if (hdr.nslots > ((uint64_t)st.st_size - sizeof hdr) / sizeof(struct hist_rec))
+        suicide("History file '%s' is truncated\n", g_path);
+    g_binary = true;
+    history_map((size_t)hdr.nslots);
+    history_apply_slots();
+    if (!g_readonly) history_add_slots();
+    return true;
+}
+
+void history_reload(void)
+{
+    if (!g_binary || g_readonly) return;
+    // A job that was removed and has come back picks up its old record.
+    history_claim_slots(true);
+    history_add_slots();
+}
+
+static void history_note_pending(void)
+{
+    if (g_buf_len || g_dirty_lo != SIZE_MAX) return;
+    if (clock_gettime(CLOCK_REALTIME, &g_buf_deadline))
+        suicide("clock_gettime failed: %s\n", strerror(errno));
+    g_buf_deadline.tv_sec += g_window_ms / 1000;
+    g_buf_deadline.tv_nsec += (long)(g_window_ms % 1000) * 1000000L;
+    if (g_buf_deadline.tv_nsec >= 1000000000L) {
+        ++g_buf_deadline.tv_sec;
+        g_buf_deadline.tv_nsec -= 1000000000L;
+    }
+}
+
+static bool history_sync_dir(void)
+{
+    int fd = open(g_dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        log_line("Failed to open directory %s: %s\n", g_dir_path, strerror(errno));
+        return false;
+    }
+    bool r = history_sync(fd, g_dir_path, false);
+    close(fd);
+    return r;
+}
+
+static bool do_history_save(FILE *f, char const *tmp,
+                            const struct hist_ent *b, const struct hist_ent *eend)
+{
+    char buf[HISTORY_RECORD_MAX];
+    for (const struct hist_ent *e = b; e != eend; ++e) {
+        hist_fmt(buf, e->id, e->numruns, e->lasttime, e->interval);
+        if (fputs(buf, f) < 0) {
+            log_line("Failed to write to history file %s\n", tmp);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool history_save_binary(void)
+{
+    for (struct hist_ent *e = g_ents, *eend = g_ents + g_njobs; e != eend; ++e)
+        hist_rec_store(&g_recs[e->hslot], e->id, e->numruns, e->lasttime, e->interval);
+    g_dirty_lo = SIZE_MAX;
+    g_dirty_hi = 0;
+    g_buf_records = 0;
+    return !g_durable || history_msync(0, g_nslots - 1);
+}
+
+// Writes the records [b, e) to tmp and then renames it to path.
+static bool history_write_text(char const *path, char const *tmp,
+                               const struct hist_ent *b, const struct hist_ent *e)
+{
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        log_line("Failed to open history file %s for write\n", tmp);
+        return false;
+    }
+    if (!do_history_save(f, tmp, b, e)) goto err1;
+    if (g_durable) {
+        if (fflush(f)) {
+            log_line("Failed to write to history file %s\n", tmp);
+            goto err1;
+        }
+        if (!history_sync(fileno(f), tmp, true)) goto err1;
+    }
+    if (fclose(f)) {
+        log_line("Failed to write to history file %s\n", tmp);
+        goto err0;
+    }
+
+    if (rename(tmp, path)) {
+        log_line("Failed to update history file (%s => %s): %s\n",
+                 tmp, path, strerror(errno));
+        goto err0;
+    }
+    return true;
+err1:
+    fclose(f);
+err0:
+    unlink(tmp);
+    return false;
+}
+
+// The jobs of each user are together in g_jobs, and so are their records.
+// If a user's file can't be written, the files already written are only
+// ahead of the journal, which is kept.
+static bool history_save_users(void)
+{
+    for (const struct hist_ent *b = g_ents, *eend = g_ents + g_njobs; b != eend;) {
+        const struct hist_ent *e = b + 1;
+        while (e != eend && e->user == b->user) ++e;
+        char *path = history_user_path(b->user);
+        char *tmp = path_suffix(path, "~");
+        bool ok = history_write_text(path, tmp, b, e);
+        free(tmp);
+        free(path);
+        if (!ok) return false;
+        b = e;
+    }
+    return true;
+}
+
+static bool history_save_text(void)
+{
+    if (g_per_user) {
+        if (!history_save_users()) return false;
+    } else if (!history_write_text(g_path, g_path_tmp, g_ents, g_ents + g_njobs)) {
+        return false;
+    }
+    if (g_durable && !history_sync_dir()) return false;
+    // The snapshot now covers everything in the journal.  If we die before
+    // the journal is removed, replaying it is harmless as records never
+    // move a job's lasttime backwards.
+    if (g_journal_fd >= 0) {
+        close(g_journal_fd);
+        g_journal_fd = -1;
+    }
+    if (unlink(g_journal_path) && errno != ENOENT)
+        log_line("Failed to remove history journal %s: %s\n", g_journal_path, strerror(errno));
+    g_journal_records = 0;
+    g_buf_len = g_buf_records = 0;
+    return true;
+}
+
+bool history_save(void)
+{
+    TRACE1(save__start, g_njobs);
+    bool ok = g_binary ? history_save_binary() : history_save_text();
+    TRACE2(save__done, g_njobs, ok);
+    return ok;
+}
+
+// Queues the record of e for the next commit.
+static void history_queue(const struct hist_ent *e)
+{
+    if (g_binary) {
+        hist_rec_store(&g_recs[e->hslot], e->id, e->numruns, e->lasttime, e->interval);
+        if (g_durable) {
+            history_note_pending();
+            if (e->hslot < g_dirty_lo) g_dirty_lo = e->hslot;
+            if (e->hslot > g_dirty_hi) g_dirty_hi = e->hslot;
+            ++g_buf_records;
+        } else {
+            stat_add(&g_stats.commits, 1);
+            stat_add(&g_stats.records, 1);
+        }
+        return;
+    }
+    // With --users, the journal is shared, so records carry their user.
+    size_t ul = e->user ? strlen(e->user->name) + 1 : 0;
+    while (g_buf_len + ul + HISTORY_RECORD_MAX > g_buf_size) {
+        g_buf_size = g_buf_size ? g_buf_size * 2 : 4096;
+        g_buf = realloc(g_buf, g_buf_size);
+        if (!g_buf) abort();
+    }
+    history_note_pending();
+    if (ul) {
+        memcpy(g_buf + g_buf_len, e->user->name, ul - 1);
+        g_buf[g_buf_len + ul - 1] = ':';
+        g_buf_len += ul;
+    }
+    g_buf_len += (size_t)hist_fmt(g_buf + g_buf_len, e->id, e->numruns, e->lasttime,
+                                  e->interval);
+    ++g_buf_records;
+}
+
+// Returns true if records are queued, and sets deadline to the time by
+// which they should be committed.
+static bool history_commit_due(struct timespec *deadline)
+{
+    if (!g_buf_len && g_dirty_lo == SIZE_MAX) return false;
+    *deadline = g_buf_deadline;
+    return true;
+}
+
+// Appends queued records to the journal with a single write (and sync),
+// and compacts the journal into the snapshot once it has grown large.
+static bool history_commit(void)
+{
+    if (g_binary) {
+        if (g_dirty_lo == SIZE_MAX) return true;
+        size_t lo = g_dirty_lo, hi = g_dirty_hi;
+        g_dirty_lo = SIZE_MAX;
+        g_dirty_hi = 0;
+        stat_add(&g_stats.commits, 1);
+        stat_add(&g_stats.records, g_buf_records);
+        g_buf_records = 0;
+        return history_msync(lo, hi);
+    }
+    if (!g_buf_len) return true;
+    size_t nrec = g_buf_records;
+    size_t len = g_buf_len;
+    g_buf_len = g_buf_records = 0;
+
+    bool created = false;
+    if (g_journal_fd < 0) {
+        g_journal_fd = open(g_journal_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (g_journal_fd < 0 && errno == ENOENT) {
+            g_journal_fd = open(g_journal_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+            created = true;
+        }
+        if (g_journal_fd < 0) {
+            log_line("Failed to open history journal %s: %s\n", g_journal_path, strerror(errno));
+            return false;
+        }
+    }
+    ssize_t r = safe_write(g_journal_fd, g_buf, len);
+    if (r < 0 || (size_t)r != len) {
+        log_line("Failed to write to history journal %s: %s\n", g_journal_path,
+                 r < 0 ? strerror(errno) : "short write");
+        return false;
+    }
+    if (g_durable) {
+        if (!history_sync(g_journal_fd, g_journal_path, true)) return false;
+        // A new journal is not durable until its directory entry is.
+        if (created && !history_sync_dir()) return false;
+    }
+    stat_add(&g_stats.commits, 1);
+    stat_add(&g_stats.records, nrec);
+
+    // Compacting after O(njobs) records keeps both the journal size and
+    // the amortized cost per record bounded.
+    g_journal_records += nrec;
+    if (g_journal_records > 2 * g_njobs + 64) {
+        if (!history_save())
+            log_line("Failed to compact history journal into %s\n", g_path);
+    }
+    return true;
+}
+
+static void history_wake(void)
+{
+    uint64_t one = 1;
+    // EAGAIN means the counter is already nonzero, so the writer will wake.
+    if (write(g_wake_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+        log_line("Failed to wake history writer: %s\n", strerror(errno));
+}
+
+void history_journal(struct Job *const *jobs, size_t njobs)
+{
+    size_t head = g_ring_head;
+    for (size_t i = 0; i < njobs; ++i) {
+        size_t idx = (size_t)(jobs[i] - g_jobs);
+        struct hist_xfer *x = &g_xfer[idx];
+        unsigned int seq = x->seq;
+        __atomic_store_n(&x->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&x->numruns, jobs[i]->numruns_, __ATOMIC_RELAXED);
+        __atomic_store_n(&x->interval, jobs[i]->cur_interval_, __ATOMIC_RELAXED);
+        __atomic_store_n(&x->lasttime, (int64_t)jobs[i]->lasttime_, __ATOMIC_RELAXED);
+        __atomic_store_n(&x->seq, seq + 2, __ATOMIC_RELEASE);
+        // If already queued, the writer has yet to take it and will see
+        // the new values when it does.
+        if (!__atomic_exchange_n(&x->queued, true, __ATOMIC_ACQ_REL))
+            g_ring[head++ & g_ring_mask] = (uint32_t)idx;
+    }
+    if (head != g_ring_head) {
+        __atomic_store_n(&g_ring_head, head, __ATOMIC_RELEASE);
+        history_wake();
+    }
+}
+
+// Moves everything handed over by the scheduler into the commit queue.
+static void history_drain(void)
+{
+    size_t head = __atomic_load_n(&g_ring_head, __ATOMIC_ACQUIRE);
+    for (; g_ring_tail != head; ++g_ring_tail) {
+        uint32_t idx = g_ring[g_ring_tail & g_ring_mask];
+        struct hist_xfer *x = &g_xfer[idx];
+        __atomic_store_n(&x->queued, false, __ATOMIC_SEQ_CST);
+        unsigned int seq, numruns, interval;
+        int64_t lasttime;
+        for (;;) {
+            seq = __atomic_load_n(&x->seq, __ATOMIC_ACQUIRE);
+            numruns = __atomic_load_n(&x->numruns, __ATOMIC_RELAXED);
+            interval = __atomic_load_n(&x->interval, __ATOMIC_RELAXED);
+            lasttime = __atomic_load_n(&x->lasttime, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (!(seq & 1) && __atomic_load_n(&x->seq, __ATOMIC_RELAXED) == seq) break;
+        }
+        g_ents[idx].numruns = numruns;
+        g_ents[idx].interval = interval;
+        g_ents[idx].lasttime = (time_t)lasttime;
+        history_queue(&g_ents[idx]);
+    }
+}
+
+static int history_timeout_ms(const struct timespec *dl)
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_REALTIME, &now))
+        suicide("clock_gettime failed: %s\n", strerror(errno));
+    if (dl->tv_sec < now.tv_sec
+        || (dl->tv_sec == now.tv_sec && dl->tv_nsec <= now.tv_nsec))
+        return 0;
+    long ms = (dl->tv_sec - now.tv_sec) * 1000 + (dl->tv_nsec - now.tv_nsec) / 1000000 + 1;
+    return ms > 60000 ? 60000 : (int)ms;
+}
+
+static void *history_writer(void *arg)
+{
+    (void)arg;
+    bool pending_save = false;
+    for (;;) {
+        // Everything queued before the stop request was made is drained.
+        bool stop = __atomic_load_n(&g_stop, __ATOMIC_ACQUIRE);
+        history_drain();
+        int timeout = -1;
+        struct timespec cdl;
+        if (history_commit_due(&cdl)) {
+            timeout = stop ? 0 : history_timeout_ms(&cdl);
+            if (!timeout) {
+                uint64_t st = mono_ns();
+                if (!history_commit()) pending_save = true;
+                uint64_t el = mono_ns() - st;
+                stat_add(&g_stats.timed_commits, 1);
+                stat_add(&g_stats.commit_ns_total, el);
+                stat_max(&g_stats.commit_ns_max, el);
+            }
+        }
+        if (pending_save) {
+            if (!history_save()) {
+                log_line("Failed to save stack to %s for a journalled job.\n", g_path);
+            } else {
+                pending_save = false;
+            }
+        }
+        if (stop) break;
+        if (timeout && !history_commit_due(&cdl)) timeout = -1;
+        struct pollfd pfd = { .fd = g_wake_fd, .events = POLLIN };
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+            suicide("poll failed: %s\n", strerror(errno));
+        uint64_t cnt;
+        if (pfd.revents & POLLIN && read(g_wake_fd, &cnt, sizeof cnt) < 0 && errno != EAGAIN)
+            suicide("Failed to read history writer eventfd: %s\n", strerror(errno));
+    }
+    return NULL;
+}
+
+// Copies the current history of every job from g_jobs.
+static void history_load_ents(void)
+{
+    if (!g_ents) {
+        g_ents = calloc(g_njobs ? g_njobs : 1, sizeof *g_ents);
+        if (!g_ents) abort();
+    }
+    for (size_t i = 0; i < g_njobs; ++i) {
+        g_ents[i] = (struct hist_ent){ .id = g_jobs[i].id_, .numruns = g_jobs[i].numruns_,
+                                       .interval = g_jobs[i].cur_interval_,
+                                       .lasttime = g_jobs[i].lasttime_,
+                                       .hslot = g_jobs[i].hslot_,
+                                       .user = g_jobs[i].user_ };
+    }
+}
+
+void history_start(void)
+{
+    // When restarted after a reload, g_jobs may have changed.
+    free(g_ents);
+    free(g_ring);
+    free(g_xfer);
+    g_ents = NULL;
+    g_ring_head = g_ring_tail = 0;
+    if (g_wake_fd >= 0) close(g_wake_fd);
+    history_load_ents();
+    size_t cap = 1;
+    while (cap < g_njobs) cap <<= 1;
+    g_ring_mask = cap - 1;
+    g_ring = malloc(cap * sizeof *g_ring);
+    g_xfer = calloc(g_njobs ? g_njobs : 1, sizeof *g_xfer);
+    if (!g_ring || !g_xfer) abort();
+    g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_wake_fd < 0)
+        suicide("eventfd failed: %s\n", strerror(errno));
+
+    // Signals are left to the scheduler thread.
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int r = pthread_create(&g_writer, NULL, history_writer, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (r)
+        suicide("Failed to start history writer thread: %s\n", strerror(r));
+    g_writer_running = true;
+}
+
+void history_stop(void)
+{
+    if (g_writer_running) {
+        __atomic_store_n(&g_stop, true, __ATOMIC_RELEASE);
+        history_wake();
+        pthread_join(g_writer, NULL);
+        g_writer_running = false;
+        g_stop = false;
+    }
+    // Jobs that aren't journalled were never handed over.
+    history_load_ents();
+}
+
+void history_close(void)
+{
+    if (g_map) munmap(g_map, g_map_size);
+    if (g_bin_fd >= 0) close(g_bin_fd);
+    g_map = NULL;
+    g_recs = NULL;
+    g_bin_fd = -1;
+    g_binary = false;
+    if (g_journal_fd >= 0) close(g_journal_fd);
+    g_journal_fd = -1;
+    if (g_wake_fd >= 0) close(g_wake_fd);
+    g_wake_fd = -1;
+    free(g_ring);
+    free(g_xfer);
+    free(g_ents);
+    g_ring = NULL;
+    g_xfer = NULL;
+    g_ents = NULL;
+    g_ring_head = g_ring_tail = 0;
+    free(g_buf);
+    free(g_dir_path);
+    free(g_journal_path);
+    free(g_path_tmp);
+    free(g_path);
+    g_buf = g_dir_path = g_journal_path = g_path_tmp = g_path = NULL;
+    g_buf_size = g_buf_len = g_buf_records = 0;
+}
+
+struct hist_text_rec {
+    int id;
+    unsigned int numruns;
+    unsigned int interval;
+    time_t lasttime;
+};
+
+// Appends the valid records of the text file at path to *recs.
+static void history_read_text(char const *path, struct hist_text_rec **recs,
+                              size_t *n, size_t *cap)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        if (errno != ENOENT)
+            suicide("Failed to open history file '%s' for read: %s\n", path, strerror(errno));
+        return;
+    }
+    char buf[512];
+    size_t linenum = 0;
+    while (fgets(buf, sizeof buf, f)) {
+        size_t llen = strlen(buf);
+        if (llen && buf[llen-1] == '\n') buf[--llen] = 0;
+        if (!llen) continue;
+        ++linenum;
+        if (*n == *cap) {
+            *cap = *cap ? *cap * 2 : 256;
+            *recs = realloc(*recs, *cap * sizeof **recs);
+            if (!*recs) abort();
+        }
+        struct hist_text_rec *r = &(*recs)[*n];
+        if (history_parse_line(buf, llen, &r->id, &r->numruns, &r->lasttime,
+                               &r->interval) < 0) {
+            log_line("Malformed entry at line %zu of '%s'; not converted\n", linenum, path);
+            continue;
+        }
+        ++*n;
+    }
+    if (ferror(f))
+        suicide("IO error reading history file '%s'\n", path);
+    fclose(f);
+}
+
+// Orders indices into g_merge_recs by id, then by position.
+static const struct hist_text_rec *g_merge_recs;
+static int hist_text_cmp(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    int ix = g_merge_recs[x].id, iy = g_merge_recs[y].id;
+    if (ix != iy) return ix < iy ? -1 : 1;
+    return x < y ? -1 : x > y;
+}
+
+static bool history_convert_finish(FILE *f)
+{
+    bool ok = !fflush(f) && (!g_durable || history_sync(fileno(f), g_path_tmp, true));
+    if (fclose(f) || !ok) {
+        log_line("Failed to write to history file %s\n", g_path_tmp);
+        unlink(g_path_tmp);
+        return false;
+    }
+    if (rename(g_path_tmp, g_path)) {
+        log_line("Failed to update history file (%s => %s): %s\n",
+                 g_path_tmp, g_path, strerror(errno));
+        unlink(g_path_tmp);
+        return false;
+    }
+    if (g_durable && !history_sync_dir()) return false;
+    if (unlink(g_journal_path) && errno != ENOENT)
+        log_line("Failed to remove history journal %s: %s\n", g_journal_path, strerror(errno));
+    return true;
+}
+
+// Keeps only the newest record of each id, at the place of the first, so
+// that a journal record supersedes the one it updates.
+static size_t history_merge_text(struct hist_text_rec *recs, size_t n)
+{
+    size_t *ord = malloc((n ? n : 1) * sizeof *ord);
+    bool *keep = malloc(n ? n : 1);
+    if (!ord || !keep) abort();
+    for (size_t i = 0; i < n; ++i) ord[i] = i;
+    g_merge_recs = recs;
+    qsort(ord, n, sizeof *ord, hist_text_cmp);
+    for (size_t i = 0; i < n;) {
+        size_t first = ord[i], w = first, k = i + 1;
+        for (; k < n && recs[ord[k]].id == recs[first].id; ++k) {
+            keep[ord[k]] = false;
+            if (recs[ord[k]].lasttime >= recs[w].lasttime) w = ord[k];
+        }
+        keep[first] = true;
+        recs[first] = recs[w];
+        i = k;
+    }
+    size_t m = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (keep[i]) recs[m++] = recs[i];
+    }
+    free(keep);
+    free(ord);
+    return m;
+}
+
+// Records are converted in order, so converting back and forth yields the
+// original text (less any journal, which is folded in).
+bool history_convert(bool to_binary)
+{
+    int fd = open(g_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_line("Failed to open history file '%s': %s\n", g_path, strerror(errno));
+        return false;
+    }
+    struct hist_hdr hdr;
+    bool is_binary = history_read_hdr(fd, &hdr);
+    if (is_binary == to_binary) {
+        close(fd);
+        log_line("History file '%s' is already in %s format.\n", g_path,
+                 to_binary ? "binary" : "text");
+        return true;
+    }
+
+    FILE *f = fopen(g_path_tmp, "w");
+    if (!f) {
+        close(fd);
+        log_line("Failed to open history file %s for write\n", g_path_tmp);
+        return false;
+    }
+    size_t n = 0;
+    bool ok = true;
+    if (to_binary) {
+        close(fd);
+        struct hist_text_rec *recs = NULL;
+        size_t cap = 0;
+        history_read_text(g_path, &recs, &n, &cap);
+        history_read_text(g_journal_path, &recs, &n, &cap);
+        n = history_merge_text(recs, n);
+        struct hist_rec *brecs = calloc(n ? n : 1, sizeof *brecs);
+        if (!brecs) abort();
+        for (size_t i = 0; i < n; ++i)
+            hist_rec_store(&brecs[i], recs[i].id, recs[i].numruns, recs[i].lasttime,
+                           recs[i].interval);
+        ok = history_write_recs(f, brecs, n);
+        free(brecs);
+        free(recs);
+    } else {
+        struct hist_rec *recs = history_read_recs(fd, &hdr);
+        close(fd);
+        ok = recs != NULL;
+        char buf[HISTORY_RECORD_MAX];
+        for (uint64_t i = 0; ok && i < hdr.nslots; ++i) {
+            const struct hist_rec *r = &recs[i];
+            if (!r->used) continue;
+            hist_fmt(buf, r->id, r->numruns, r->lasttime, r->interval);
+            ok = fputs(buf, f) >= 0;
+            ++n;
+        }
+        free(recs);
+    }
+    if (!ok) {
+        fclose(f);
+        unlink(g_path_tmp);
+        log_line("Failed to convert history file '%s'\n", g_path);
+        return false;
+    }
+    if (!history_convert_finish(f)) return false;
+    log_line("Converted %zu history records in %s to %s format.\n", n, g_path,
+             to_binary ? "binary" : "text");
+    return true;
+}
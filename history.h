@@ -0,0 +1,81 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_HISTORY_H_
+#define NCRON_HISTORY_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+struct Job;
+struct User;
+
+// If readonly, the history file is never modified.  If per_user, path is
+// a directory that holds a text history file for each user, named for the
+// user, and the journal shared by all of them.
+void history_init(char const *path, bool readonly, bool per_user);
+char const *history_path(void);
+char const *history_journal_path(void);
+// Returns the path of the history file of user; free() it when done.
+char *history_user_path(const struct User *user);
+
+// If durable, commits and snapshots are synced to stable storage,
+// including the directory entries.  Journal records are held for up to
+// window_ms so that records from several dispatch batches share a commit.
+void history_set_durable(bool durable, unsigned window_ms);
+
+// Applies a history record to a job unless the job already has a more
+// recent one, and recalculates its exectime.  interval is the cur_interval_
+// of the job when the record was made.  Missed runs are caught up only if
+// the record is loaded at startup.
+bool history_apply(struct Job *j, unsigned int numruns, time_t lasttime,
+                   unsigned int interval, const struct timespec *ts,
+                   bool startup);
+
+// Parses a text "id=numruns:lasttime[:interval]" record; implemented in
+// crontab.rl.  A missing interval is 0.  Returns 1 on success, -1 if
+// malformed, or -2 if incomplete.
+int history_parse_line(const char *p, size_t plen, int *id, unsigned int *numruns,
+                       time_t *lasttime, unsigned int *interval);
+
+// If the history file is in the binary format, applies it to g_jobs and
+// returns true; thereafter all history updates are in-place stores to its
+// records.  Returns false if it is a text history file.
+bool history_load_binary(void);
+
+// Rewrites the history file (and journal) in the binary or text format.
+bool history_convert(bool to_binary);
+
+// Starts the writer thread, which thereafter does all history I/O.  It
+// may be started again after history_stop().
+void history_start(void);
+// Hands records for jobs to the writer thread, to be committed to the
+// journal.  Never blocks; called only from the scheduler thread.
+void history_journal(struct Job *const *jobs, size_t njobs);
+// Commits everything handed to the writer and stops it.
+void history_stop(void);
+// Writes a snapshot of every job and discards the journal.  Must not be
+// called while the writer thread is running.
+bool history_save(void);
+// Gives jobs that a reload has added to g_jobs their history records,
+// reusing any record left by an earlier job with the same id.
+// Must not be called while the writer thread is running.
+void history_reload(void);
+// Releases resources; does not save.
+void history_close(void);
+
+struct history_stats
+{
+    uint64_t commits;
+    uint64_t records;
+    uint64_t syncs;
+    uint64_t sync_ns_total;
+    uint64_t sync_ns_max;
+    uint64_t timed_commits;  // commits by the writer thread
+    uint64_t commit_ns_total;
+    uint64_t commit_ns_max;
+};
+const struct history_stats *history_get_stats(void);
+// Copies the stats while the writer thread may be updating them.
+void history_stats_read(struct history_stats *hs);
+#endif
@@ -0,0 +1,246 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "nk/log.h"
+#include "sched.h"
+#include "proc.h"
+#include "history.h"
+#include "metrics.h"
+#include "users.h"
+
+extern size_t g_njobs;
+extern struct Job *g_jobs;
+
+struct Metrics g_metrics;
+
+static bool g_per_job;
+static uint64_t g_late_warn_ns;
+
+static char *g_path;
+static int g_tfd = -1;
+static const struct JobHeap *g_heap;
+
+uint64_t metrics_ns(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts)) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_hist_add(struct MetricsHist *h, uint64_t ns)
+{
+    ++h->b[metrics_hist_bucket(ns)];
+    ++h->count;
+    h->sum += ns;
+}
+
+void metrics_config(bool per_job, unsigned late_warn_ms)
+{
+    g_per_job = per_job;
+    g_late_warn_ns = (uint64_t)late_warn_ms * 1000000ULL;
+}
+
+static struct JobLatency *job_latency(struct Job *job)
+{
+    if (!g_per_job) return NULL;
+    if (!job->latency_) {
+        job->latency_ = calloc(1, sizeof *job->latency_);
+        if (!job->latency_) abort();
+    }
+    return job->latency_;
+}
+
+void metrics_dispatch(struct Job *job, uint64_t late_ns)
+{
+    ++g_metrics.dispatches;
+    metrics_hist_add(&g_metrics.lateness, late_ns);
+    struct JobLatency *jl = job_latency(job);
+    if (jl) metrics_hist_add(&jl->lateness, late_ns);
+    if (g_late_warn_ns && late_ns > g_late_warn_ns)
+        log_warn("Job %d dispatched %" PRIu64 ".%03" PRIu64 " s late\n", job->id_,
+                 late_ns / 1000000000, late_ns % 1000000000 / 1000000);
+}
+
+void metrics_spawn(struct Job *job, uint64_t ns)
+{
+    metrics_hist_add(&g_metrics.spawn, ns);
+    struct JobLatency *jl = job_latency(job);
+    if (jl) metrics_hist_add(&jl->spawn, ns);
+}
+
+// labels is either empty or a label list to go within braces.
+static void page_hist_series(FILE *f, char const *name, char const *labels,
+                             const struct MetricsHist *h)
+{
+    char const *sep = *labels ? "," : "";
+    uint64_t n = 0;
+    for (unsigned i = 0; i < METRICS_HIST_BUCKETS - 1; ++i) {
+        n += h->b[i];
+        fprintf(f, "%s_bucket{%s%sle=\"%g\"} %" PRIu64 "\n", name, labels, sep,
+                (double)(1ULL << (i + 10)) / 1e9, n);
+    }
+    fprintf(f, "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n", name, labels, sep, h->count);
+    if (*labels) {
+        fprintf(f, "%s_sum{%s} %.9f\n%s_count{%s} %" PRIu64 "\n",
+                name, labels, (double)h->sum / 1e9, name, labels, h->count);
+    } else {
+        fprintf(f, "%s_sum %.9f\n%s_count %" PRIu64 "\n", name, (double)h->sum / 1e9, name, h->count);
+    }
+}
+
+static void page_hist(FILE *f, char const *name, char const *help, const struct MetricsHist *h)
+{
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    page_hist_series(f, name, "", h);
+}
+
+// With --users, ids are only unique within a user, who is then a label too.
+#define JOB_LABELS_MAX (LOGIN_NAME_MAX + 32)
+
+static void job_labels(char *buf, size_t size, const struct Job *j)
+{
+    if (j->user_) snprintf(buf, size, "user=\"%s\",job=\"%d\"", j->user_->name, j->id_);
+    else snprintf(buf, size, "job=\"%d\"", j->id_);
+}
+
+static void page_job_hists(FILE *f, char const *name, char const *help, bool spawn)
+{
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (size_t i = 0; i < g_njobs; ++i) {
+        const struct Job *j = &g_jobs[i];
+        if (!j->latency_) continue;
+        char labels[JOB_LABELS_MAX];
+        job_labels(labels, sizeof labels, j);
+        page_hist_series(f, name, labels, spawn ? &j->latency_->spawn : &j->latency_->lateness);
+    }
+}
+
+static void page_val(FILE *f, char const *name, char const *type, char const *help, uint64_t v)
+{
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n%s %" PRIu64 "\n", name, help, name, type, name, v);
+}
+
+char *metrics_page(const struct JobHeap *heap, size_t *len)
+{
+    char *buf;
+    FILE *f = open_memstream(&buf, len);
+    if (!f) abort();
+    page_val(f, "ncron_dispatches_total", "counter", "Job runs started by the schedule.",
+             g_metrics.dispatches);
+    page_val(f, "ncron_spawn_failures_total", "counter", "Job runs that could not be started.",
+             g_metrics.spawn_failures);
+    page_val(f, "ncron_skipped_runs_total", "counter", "Job runs skipped as past their deadline.",
+             g_metrics.skipped_runs);
+    page_hist(f, "ncron_dispatch_lateness_seconds",
+              "Time from when a job was due to when it was dispatched.", &g_metrics.lateness);
+    page_hist(f, "ncron_spawn_seconds", "Time taken to start the process of a run.",
+              &g_metrics.spawn);
+    if (g_per_job) {
+        page_job_hists(f, "ncron_job_dispatch_lateness_seconds",
+                       "Dispatch lateness of each job.", false);
+        page_job_hists(f, "ncron_job_spawn_seconds",
+                       "Process start time of each job.", true);
+    }
+    page_hist(f, "ncron_solver_seconds", "Time taken to compute the next run time of a job.",
+              &g_metrics.solver);
+    page_val(f, "ncron_queue_depth", "gauge", "Jobs in the schedule.",
+             heap->n - heap->ntimers);
+    page_val(f, "ncron_running_children", "gauge", "Job runs that have not exited.",
+             proc_running());
+
+    struct history_stats hs;
+    history_stats_read(&hs);
+    page_val(f, "ncron_history_records_total", "counter", "History records committed.",
+             hs.records);
+    fprintf(f, "# HELP ncron_history_commit_seconds Time taken to commit history records.\n"
+               "# TYPE ncron_history_commit_seconds summary\n"
+               "ncron_history_commit_seconds_sum %.9f\n"
+               "ncron_history_commit_seconds_count %" PRIu64 "\n",
+            (double)hs.commit_ns_total / 1e9, hs.timed_commits);
+    fprintf(f, "# HELP ncron_history_commit_max_seconds Longest history commit.\n"
+               "# TYPE ncron_history_commit_max_seconds gauge\n"
+               "ncron_history_commit_max_seconds %.9f\n", (double)hs.commit_ns_max / 1e9);
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts))
+        suicide("clock_gettime failed: %s\n", strerror(errno));
+    fprintf(f, "# HELP ncron_job_last_run_age_seconds Time since each job last ran.\n"
+               "# TYPE ncron_job_last_run_age_seconds gauge\n");
+    for (size_t i = 0; i < g_njobs; ++i) {
+        const struct Job *j = &g_jobs[i];
+        if (!j->lasttime_) continue;
+        char labels[JOB_LABELS_MAX];
+        job_labels(labels, sizeof labels, j);
+        fprintf(f, "ncron_job_last_run_age_seconds{%s} %ld\n", labels,
+                (long)(ts.tv_sec - j->lasttime_));
+    }
+    if (fclose(f)) abort();
+    return buf;
+}
+
+static bool metrics_save(void)
+{
+    size_t len, l = strlen(g_path);
+    char *page = metrics_page(g_heap, &len);
+    char *tmp = malloc(l + 2);
+    if (!tmp) abort();
+    memcpy(tmp, g_path, l);
+    memcpy(tmp + l, "~", 2);
+    bool ok = false;
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        log_line("Failed to open metrics file %s for write\n", tmp);
+        goto out;
+    }
+    bool wok = fwrite(page, 1, len, f) == len;
+    if (fclose(f) || !wok) {
+        log_line("Failed to write to metrics file %s\n", tmp);
+        unlink(tmp);
+        goto out;
+    }
+    if (rename(tmp, g_path)) {
+        log_line("Failed to update metrics file (%s => %s): %s\n", tmp, g_path, strerror(errno));
+        unlink(tmp);
+        goto out;
+    }
+    ok = true;
+out:
+    free(tmp);
+    free(page);
+    return ok;
+}
+
+void metrics_init(char const *path, unsigned interval, int epfd, const struct JobHeap *heap)
+{
+    g_path = strdup(path);
+    if (!g_path) abort();
+    g_heap = heap;
+    g_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_tfd < 0)
+        suicide("timerfd_create failed: %s\n", strerror(errno));
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = interval }, .it_value = { .tv_sec = interval },
+    };
+    if (timerfd_settime(g_tfd, 0, &its, NULL))
+        suicide("timerfd_settime failed: %s\n", strerror(errno));
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = METRICS_EV_TIMER };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, g_tfd, &ev))
+        suicide("epoll_ctl failed: %s\n", strerror(errno));
+    metrics_save();
+}
+
+void metrics_event(void)
+{
+    uint64_t cnt;
+    if (read(g_tfd, &cnt, sizeof cnt) < 0) return;
+    metrics_save();
+}
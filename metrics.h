@@ -0,0 +1,68 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_METRICS_H_
+#define NCRON_METRICS_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct JobHeap;
+
+// epoll data value of the timer that saves the metrics file.
+#define METRICS_EV_TIMER (UINT64_MAX - 2)
+
+// Durations in ns; bucket i counts values of at most 2^(i + 10) ns that are
+// not in an earlier bucket, and the last bucket counts everything else.
+#define METRICS_HIST_BUCKETS 30
+struct MetricsHist
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t b[METRICS_HIST_BUCKETS];
+};
+
+static inline unsigned metrics_hist_bucket(uint64_t ns)
+{
+    unsigned i = ns <= 1024 ? 0 : 54u - (unsigned)__builtin_clzll(ns - 1);
+    return i < METRICS_HIST_BUCKETS ? i : METRICS_HIST_BUCKETS - 1;
+}
+
+// Updated only by the main thread, so plain increments suffice.
+struct Metrics
+{
+    uint64_t dispatches;
+    uint64_t spawn_failures;
+    uint64_t skipped_runs;        // dispatches past the job's deadline
+    struct MetricsHist lateness;  // dispatch time past the scheduled time
+    struct MetricsHist spawn;     // starting the process of a run
+    struct MetricsHist solver;    // computing the next run time of a job
+};
+extern struct Metrics g_metrics;
+
+// Per-job breakdown of the dispatch histograms.
+struct JobLatency
+{
+    struct MetricsHist lateness;
+    struct MetricsHist spawn;
+};
+
+struct Job;
+
+uint64_t metrics_ns(void);
+void metrics_hist_add(struct MetricsHist *h, uint64_t ns);
+// Dispatches that are more than late_warn_ms late are logged, if it is not
+// zero; per_job keeps the dispatch histograms for each job as well.
+void metrics_config(bool per_job, unsigned late_warn_ms);
+// Records a dispatch of job that started a run late_ns past its scheduled
+// time.
+void metrics_dispatch(struct Job *job, uint64_t late_ns);
+// Records a spawn of a process for job that took ns.
+void metrics_spawn(struct Job *job, uint64_t ns);
+// Returns the metrics in the Prometheus text format; heap gives the
+// queue depth.  The caller frees it.
+char *metrics_page(const struct JobHeap *heap, size_t *len);
+// Saves the metrics to path every interval seconds, using epfd to wake.
+void metrics_init(char const *path, unsigned interval, int epfd, const struct JobHeap *heap);
+// Handles an expiry of the metrics timer.
+void metrics_event(void);
+#endif
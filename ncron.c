@@ -10,6 +10,8 @@
 #include <sys/time.h>
 #include <time.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
@@ -24,18 +26,53 @@
 #include "nk/io.h"
 #include "strconv.h"
 #include "sched.h"
+#include "cache.h"
+#include "forecast.h"
+#include "history.h"
+#include "proc.h"
+#include "affinity.h"
+#include "cgroup.h"
+#include "watch.h"
+#include "control.h"
+#include "metrics.h"
+#include "users.h"
+#include "trace.h"
 
 #define CONFIG_FILE_DEFAULT "/var/lib/ncron/crontab"
 #define HISTORY_FILE_DEFAULT "/var/lib/ncron/history"
 
 #define NCRON_VERSION "4.0"
 
+// Exit status of a child that has parsed the crontab without error.
+#define RELOAD_CHECK_OK 3
+
 int gflags_debug;
 static volatile sig_atomic_t pending_save_and_exit;
+static volatile sig_atomic_t pending_reload;
+static volatile sig_atomic_t pending_report;
 
 static char const *g_ncron_conf = CONFIG_FILE_DEFAULT;
 static char const *g_ncron_history = HISTORY_FILE_DEFAULT;
-static char const *g_ncron_history_tmp = HISTORY_FILE_DEFAULT "~";
+static char const *g_ncron_conf_dir;
+static char const *g_ncron_cache; // Defaults to crontab (or dir) + ".cache"
+static bool g_ncron_compile;
+static unsigned g_ncron_forecast_days;
+static bool g_ncron_durable;
+static unsigned g_ncron_commit_window_ms;
+static char const *g_ncron_convert_history; // "binary" or "text"
+static char const *g_ncron_cpus; // housekeeping CPU list
+static char const *g_ncron_cgroup; // delegated cgroup v2 directory
+static bool g_ncron_watch;
+static char const *g_ncron_socket; // control socket path
+static char const *g_ncron_metrics; // metrics file path
+static unsigned g_ncron_metrics_interval = 15;
+static bool g_ncron_job_latency;
+static unsigned g_ncron_late_warn_ms;
+static char const *g_ncron_users; // directory of per-user crontabs
+static unsigned g_ncron_user_jobs;
+static unsigned g_ncron_user_procs;
+static enum JobCatchup g_ncron_catchup = JOB_CATCHUP_ONCE;
+static unsigned g_ncron_catchup_window = JOB_CATCHUP_WINDOW;
 enum Execmode
 {
     Execmode_normal = 0,
@@ -46,56 +83,58 @@ static enum Execmode g_ncron_execmode = Execmode_normal;
 
 size_t g_njobs;
 struct Job *g_jobs;
-static struct Job * stackl;
-static struct Job * deadstackl;
-
-static bool do_save_stack(FILE *f, struct Job *j)
+static struct JobHeap jobq;
+static char *g_ncron_stats; // history file + ".stats"
+static int g_epfd = -1;     // the timer and the pidfds of running jobs
+static int g_timerfd = -1;
+static struct Job **g_retired; // removed by a reload while still running
+static size_t g_nretired;
+
+// The history writer thread must be stopped.
+static void save_history(void)
 {
-    for (; j; j = j->next_) {
-        if (fprintf(f, "%d=%u:%lu\n", j->id_, j->numruns_, j->lasttime_) < 0) {
-            log_line("Failed to write to history file %s\n", g_ncron_history_tmp);
-            return false;
-        }
+    if (g_ncron_execmode == Execmode_nosave) return;
+    if (history_save()) {
+        log_line("Saved stack to %s.\n", g_ncron_history);
+    } else {
+        log_line("Failed to save stack to %s; some jobs may run again.\n",
+                 g_ncron_history);
     }
-    return true;
+    if (proc_stats_save(g_ncron_stats))
+        log_line("Saved job stats to %s.\n", g_ncron_stats);
 }
 
-static bool save_stack(void)
+static void flush_history(void)
 {
-    FILE *f = fopen(g_ncron_history_tmp, "w");
-    if (!f) {
-        log_line("Failed to open history file %s for write\n", g_ncron_history_tmp);
-        return false;
-    }
-    if (!do_save_stack(f, stackl)) goto err1;
-    if (!do_save_stack(f, deadstackl)) goto err1;
-    fclose(f);
-
-    if (rename(g_ncron_history_tmp, g_ncron_history)) {
-        log_line("Failed to update history file (%s => %s): %s\n",
-                 g_ncron_history_tmp, g_ncron_history, strerror(errno));
-        goto err0;
-    }
-    return true;
-err1:
-    fclose(f);
-err0:
-    unlink(g_ncron_history_tmp);
-    return false;
+    history_stop();
+    save_history();
+    history_start();
 }
 
 static void save_and_exit(void)
 {
-    if (g_ncron_execmode != Execmode_nosave) {
-        if (save_stack()) {
-            log_line("Saved stack to %s.\n", g_ncron_history);
-        } else {
-            log_line("Failed to save stack to %s; some jobs may run again.\n",
-                     g_ncron_history);
-        }
+    history_stop();
+    save_history();
+    control_close();
+    if (g_ncron_durable) {
+        const struct history_stats *hs = history_get_stats();
+        log_line("History: %lu commits of %lu records, %lu syncs, avg %lu us, max %lu us\n",
+                 hs->commits, hs->records, hs->syncs,
+                 hs->syncs ? hs->sync_ns_total / hs->syncs / 1000 : 0,
+                 hs->sync_ns_max / 1000);
     }
     // Get rid of leak sanitizer noise.
+    free(g_ncron_stats);
     for (size_t i = 0; i < g_njobs; ++i) job_destroy(&g_jobs[i]);
+    for (size_t i = 0; i < g_nretired; ++i) {
+        job_destroy(g_retired[i]);
+        free(g_retired[i]);
+    }
+    free(g_retired);
+    job_heap_destroy(&jobq);
+    job_cst_intern_destroy();
+    users_destroy();
+    history_close();
     log_line("Exited.\n");
     exit(EXIT_SUCCESS);
 }
@@ -103,8 +142,12 @@ static void save_and_exit(void)
 static void signal_handler(int sig)
 {
     int serrno = errno;
-    if (sig == SIGTERM || sig == SIGINT || sig == SIGHUP) {
+    if (sig == SIGTERM || sig == SIGINT) {
         pending_save_and_exit = 1;
+    } else if (sig == SIGHUP) {
+        pending_reload = 1;
+    } else if (sig == SIGUSR1) {
+        pending_report = 1;
     }
     errno = serrno;
 }
@@ -112,7 +155,7 @@ static void signal_handler(int sig)
 static void fix_signals(void)
 {
     static const int ss[] = {
-        SIGHUP, SIGINT, SIGTERM, SIGPIPE, SIGKILL
+        SIGHUP, SIGINT, SIGTERM, SIGPIPE, SIGUSR1, SIGCHLD, SIGKILL
     };
     sigset_t mask;
     if (sigprocmask(0, 0, &mask) < 0)
@@ -129,10 +172,9 @@ static void fix_signals(void)
     for (int i = 0; ss[i] != SIGKILL; ++i)
         if (sigaction(ss[i], &sa, NULL))
             suicide("sigaction failed\n");
-    sa.sa_handler = SIG_IGN;
-    sa.sa_flags = SA_NOCLDWAIT;
-    if (sigaction(SIGCHLD, &sa, NULL))
-        suicide("sigaction failed\n");
+    // Children are reaped by proc_reap() so that their usage is recorded;
+    // SIGCHLD just interrupts the wait so that orphaned descendants are
+    // reaped promptly.
 }
 
 static void fail_on_fdne(char const *file, int mode)
@@ -142,28 +184,249 @@ static void fail_on_fdne(char const *file, int mode)
                 file, (mode & W_OK) ? "writable" : "readable");
 }
 
+// Nothing can run any more once no job is queued and no run is going, as
+// a job that waits on upstreams is only queued when one of them exits.
+// Jobs may still be run through the control socket, though.
+static bool jobs_done(void)
+{
+    return jobq.n == jobq.ntimers && !proc_running() && !g_ncron_socket;
+}
+
+// Sleeps until ts, or indefinitely if ts is zero, reaping jobs as they exit.
+// Returns early, with ts set to the current time, if a job that completes
+// or a control request queues an earlier dispatch or a reload is requested.
 static void sleep_or_die(struct timespec *ts)
 {
+    struct itimerspec its = { .it_value = *ts };
+    if (timerfd_settime(g_timerfd, TFD_TIMER_ABSTIME, &its, NULL))
+        suicide("timerfd_settime failed: %s\n", strerror(errno));
     for (;;) {
-        int r = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, ts, NULL);
-        if (r) {
-            if (r == EINTR) {
+        if (pending_reload) {
+            if (clock_gettime(CLOCK_REALTIME, ts))
+                suicide("clock_gettime failed: %s\n", strerror(errno));
+            break;
+        }
+        struct epoll_event evs[64];
+        int n = epoll_wait(g_epfd, evs, sizeof evs / sizeof *evs, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
                 if (pending_save_and_exit) save_and_exit();
+                proc_reap();
+                if (pending_report) {
+                    pending_report = 0;
+                    proc_report();
+                }
                 continue;
             }
-            suicide("clock_nanosleep failed: %s\n", strerror(r));
+            suicide("epoll_wait failed: %s\n", strerror(errno));
+        }
+        bool expired = false;
+        for (int i = 0; i < n; ++i) {
+            uint64_t ev = evs[i].data.u64;
+            if (ev == WATCH_EV_NOTIFY || ev == WATCH_EV_DEBOUNCE) {
+                if (watch_event(ev)) pending_reload = 1;
+            } else if (ev == METRICS_EV_TIMER) {
+                metrics_event();
+            } else if (ev >= CONTROL_EV_LISTEN && ev <= CONTROL_EV_LAST) {
+                control_event(ev, evs[i].events);
+            } else if (evs[i].data.u64) {
+                proc_exited((pid_t)evs[i].data.u64);
+            } else {
+                uint64_t cnt;
+                if (read(g_timerfd, &cnt, sizeof cnt) < 0 && errno != EAGAIN)
+                    suicide("Failed to read timerfd: %s\n", strerror(errno));
+                expired = true;
+            }
+        }
+        proc_reap();
+        if (expired || jobs_done()) break;
+        if (jobq.n && (!ts->tv_sec || timespec_before(&jobq.v[0].exectime, ts))) {
+            if (clock_gettime(CLOCK_REALTIME, ts))
+                suicide("clock_gettime failed: %s\n", strerror(errno));
+            break;
+        }
+    }
+}
+
+// Parses the crontab in a child, so that a crontab with errors, which
+// would make the parser exit, leaves the current jobs in place.  The child
+// sends back the jobs as a cache image, so the crontab is parsed only once.
+static bool reload_parse(char const *conf, struct Job **jobs, size_t *njobs)
+{
+    int fds[2];
+    if (pipe(fds)) {
+        log_line("pipe failed: %s\n", strerror(errno));
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        log_line("fork failed: %s\n", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (!pid) {
+        close(fds[0]);
+        parse_config_defs(g_ncron_conf, g_ncron_conf_dir, g_ncron_cache);
+        _exit(cache_send(fds[1], g_jobs, g_njobs) ? RELOAD_CHECK_OK : EXIT_FAILURE);
+    }
+    close(fds[1]);
+    // Read before waiting, as the image may not fit in the pipe.
+    bool ok = cache_recv(fds[0], jobs, njobs);
+    close(fds[0]);
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            log_line("waitpid failed: %s\n", strerror(errno));
+            status = 0;
+            break;
+        }
+    }
+    if (ok && !(WIFEXITED(status) && WEXITSTATUS(status) == RELOAD_CHECK_OK)) {
+        for (size_t i = 0; i < *njobs; ++i) job_destroy(&(*jobs)[i]);
+        free(*jobs);
+        ok = false;
+    }
+    if (!ok) log_line("Failed to load '%s'; keeping the current jobs.\n", conf);
+    return ok;
+}
+
+static void retired_collect(void)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < g_nretired; ++i) {
+        if (proc_job_running(g_retired[i])) {
+            g_retired[n++] = g_retired[i];
+            continue;
+        }
+        job_destroy(g_retired[i]);
+        free(g_retired[i]);
+    }
+    g_nretired = n;
+}
+
+static bool job_queued(const struct Job *j)
+{
+    return j->exectime_ && !j->paused_ && (j->maxruns_ == 0 || j->numruns_ < j->maxruns_);
+}
+
+// Replaces the jobs with those now in the crontab.  Jobs that keep their
+// id keep their run history, stats and pending dependencies, and if their
+// definition is unchanged, their next dispatch time.  Runs of removed jobs
+// that are still going are reaped as usual but no longer recorded.
+static void reload_config(const struct timespec *ts)
+{
+    char const *conf = g_ncron_conf_dir ? g_ncron_conf_dir : g_ncron_conf;
+    log_line("Reloading '%s'.\n", conf);
+    history_stop();
+    struct Job *jobs;
+    size_t njobs;
+    if (!reload_parse(conf, &jobs, &njobs)) {
+        history_start();
+        return;
+    }
+    struct Job *old = g_jobs;
+    size_t nold = g_njobs;
+    g_jobs = jobs;
+    g_njobs = njobs;
+    job_deps_resolve(g_jobs, g_njobs);
+    if (g_ncron_execmode == Execmode_journal) {
+        for (size_t i = 0; i < g_njobs; ++i) g_jobs[i].journal_ = true;
+    }
+
+    struct Job **map = calloc(nold ? nold : 1, sizeof *map);
+    if (!map) abort();
+    struct Job **byid = job_index_by_id(old, nold);
+    size_t nadded = 0, nchanged = 0;
+    for (size_t i = 0; i < g_njobs; ++i) {
+        struct Job *j = &g_jobs[i];
+        struct Job *o = job_index_find(byid, nold, j->user_, j->id_);
+        if (!o) {
+            ++nadded;
+            continue;
+        }
+        bool same = job_same_def(j, o);
+        job_inherit(j, o, same);
+        if (!same) {
+            ++nchanged;
+            // Rescheduled from its history, but without the catch-up of
+            // a restart: no runs were missed while ncron was running.
+            if (!j->nafter_ && (o->exectime_ || o->lasttime_))
+                job_set_initial_exectime(j, ts);
         }
-        break;
+        map[o - old] = j;
     }
+    free(byid);
+    history_reload();
+
+    // Queued jobs that remain keep their entries, which are moved only if
+    // their dispatch time has changed; the rest are removed or pushed.
+    for (size_t i = 0; i < nold; ++i) {
+        if (!job_heap_contains(&jobq, &old[i])) continue;
+        if (map[i] && job_queued(map[i]))
+            job_heap_replace(&jobq, old[i].heapidx_, map[i]);
+        else
+            job_heap_remove(&jobq, &old[i]);
+    }
+    for (struct Job *j = g_jobs, *jend = g_jobs + g_njobs; j != jend; ++j) {
+        if (job_queued(j) && !job_heap_contains(&jobq, j)) job_heap_push(&jobq, j);
+    }
+
+    size_t nremoved = 0;
+    for (size_t i = 0; i < nold; ++i) {
+        if (map[i]) continue;
+        ++nremoved;
+        if (!proc_job_running(&old[i])) continue;
+        struct Job *r = malloc(sizeof *r);
+        if (!r) abort();
+        *r = old[i];
+        r->journal_ = false;
+        free(r->dependents_);
+        r->dependents_ = NULL;
+        r->ndependents_ = 0;
+        job_init(&old[i]);
+        struct Job **nr = realloc(g_retired, (g_nretired + 1) * sizeof *nr);
+        if (!nr) abort();
+        g_retired = nr;
+        g_retired[g_nretired++] = r;
+        map[i] = r;
+    }
+    proc_remap(old, nold, map);
+    free(map);
+    for (size_t i = 0; i < nold; ++i) job_destroy(&old[i]);
+    free(old);
+    retired_collect();
+    control_jobs_changed();
+    history_start();
+    log_line("Reloaded %zu jobs: %zu added, %zu changed, %zu removed.\n",
+             g_njobs, nadded, nchanged, nremoved);
+}
+
+// The loop takes ts to be the scheduled time, but the wakeup and earlier
+// dispatches in the same batch make each dispatch somewhat later.
+static uint64_t dispatch_lateness(const struct Job *j)
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_REALTIME, &now)) return 0;
+    int64_t ns = ((int64_t)now.tv_sec - (int64_t)j->exectime_) * 1000000000LL
+                 + now.tv_nsec - j->exectime_nsec_;
+    return ns > 0 ? (uint64_t)ns : 0;
 }
 
 static void debug_stack_print(const struct timespec *ts) {
     if (!gflags_debug)
         return;
-    if (stackl)
-        log_line("ts.tv_sec = %lu  stack.front().exectime = %lu\n", ts->tv_sec, stackl->exectime_);
-    for (struct Job *j = stackl; j; j = j->next_)
-        log_line("job %d exectime = %lu\n", j->id_, j->exectime_);
+    if (jobq.n)
+        log_debug("ts = %lu.%09ld  stack.front().exectime = %lu.%09ld\n", ts->tv_sec, ts->tv_nsec,
+                  jobq.v[0].exectime.tv_sec, jobq.v[0].exectime.tv_nsec);
+    for (size_t i = 0; i < jobq.n; ++i) {
+        if (jobq.v[i].pid)
+            log_debug("job %d pid %d deadline = %lu\n", jobq.v[i].id, jobq.v[i].pid,
+                      jobq.v[i].exectime.tv_sec);
+        else
+            log_debug("job %d exectime = %lu.%09ld\n", jobq.v[i].id, jobq.v[i].exectime.tv_sec,
+                      jobq.v[i].exectime.tv_nsec);
+    }
 }
 
 static void do_work(void)
@@ -174,51 +437,69 @@ static void do_work(void)
         exit(EXIT_FAILURE);
     }
 
-    bool pending_save = false;
+    // Journalled jobs dispatched in one batch are handed to the history
+    // writer thread together, which commits them once the commit window
+    // has passed.
+    struct Job **jbatch = malloc(g_njobs * sizeof *jbatch);
+    if (!jbatch) abort();
+    size_t njbatch = 0;
+
     for (;;) {
-        if (pending_save) {
-            if (!save_stack()) {
-                log_line("Failed to save stack to %s for a journalled job.\n",
-                         g_ncron_history);
-            } else {
-                pending_save = false;
-            }
+        if (jobs_done()) {
+            log_line("No jobs left to run.\n");
+            save_and_exit();
         }
         sleep_or_die(&ts);
 
-        while (stackl->exectime_ <= ts.tv_sec) {
-            struct Job *j = stackl;
-            if (gflags_debug)
-                log_line("DISPATCH %d (%lu <= %lu)\n", j->id_, j->exectime_, ts.tv_sec);
-
-            job_exec(j, &ts);
-            if (j->journal_ || g_ncron_execmode == Execmode_journal)
-                pending_save = true;
+        if (pending_reload) {
+            pending_reload = 0;
+            reload_config(&ts);
+            struct Job **nb = realloc(jbatch, (g_njobs ? g_njobs : 1) * sizeof *nb);
+            if (!nb) abort();
+            jbatch = nb;
+        }
 
-            if (j->exectime_ && (j->numruns_ < j->maxruns_ || j->maxruns_ == 0)) {
-                if (stackl->next_) {
-                    struct Job *t = stackl;
-                    stackl = stackl->next_;
-                    job_insert(&stackl, t);
-                }
-            } else {
-                struct Job *t = stackl;
-                stackl = stackl->next_;
-                job_insert(&deadstackl, t);
+        while (jobq.n && !timespec_before(&ts, &jobq.v[0].exectime)) {
+            if (jobq.v[0].pid) {
+                struct JobHeapEnt t = jobq.v[0];
+                job_heap_pop(&jobq);
+                proc_deadline(t.pid, t.job, t.exectime.tv_sec);
+                continue;
+            }
+            struct Job *j = jobq.v[0].job;
+            if (gflags_debug)
+                log_debug("DISPATCH %d (%lu.%09ld <= %lu.%09ld)\n", j->id_, j->exectime_,
+                          j->exectime_nsec_, ts.tv_sec, ts.tv_nsec);
+            if (!job_skip_late(j, &ts)) {
+                TRACE3(dispatch, j->id_, j->exectime_, ts.tv_sec);
+                // Deferred runs and runs that fail to spawn are not counted.
+                uint64_t late = dispatch_lateness(j);
+                if (job_exec(j, &ts)) metrics_dispatch(j, late);
+                if (j->journal_)
+                    jbatch[njbatch++] = j;
             }
-            if (!stackl)
-                save_and_exit();
+
+            if (job_queued(j))
+                job_heap_fix(&jobq, j);
+            else
+                job_heap_remove(&jobq, j);
+            if (njbatch == g_njobs) break;
         }
+        if (njbatch) history_journal(jbatch, njbatch);
+        njbatch = 0;
 
         debug_stack_print(&ts);
-        {
-            struct Job *j = stackl;
-            if (ts.tv_sec <= j->exectime_) {
-                time_t tdelta = j->exectime_ - ts.tv_sec;
-                ts.tv_sec = j->exectime_;
-                ts.tv_nsec = 0;
+        if (!jobq.n) {
+            // Nothing is scheduled; a zero time disarms the timer.
+            ts = (struct timespec){0};
+        } else {
+            struct timespec next = jobq.v[0].exectime;
+            if (!timespec_before(&next, &ts)) {
+                int64_t tdelta = ((int64_t)next.tv_sec - ts.tv_sec) * 1000
+                                 + (next.tv_nsec - ts.tv_nsec) / 1000000;
+                ts = next;
                 if (gflags_debug)
-                    log_line("SLEEP %zu seconds\n", tdelta);
+                    log_debug("SLEEP %lld ms\n", (long long)tdelta);
             }
         }
     }
@@ -234,8 +515,30 @@ static void usage(void)
            "--sleep        -s [] Initial sleep time in seconds.\n"
            "--noexecsave   -0    Don't save execution history at all.\n"
            "--journal      -j    Save exectimes at each job invocation.\n"
+           "--durable      -D    Sync history updates to stable storage.\n"
+           "--commit-window -w [] Milliseconds to batch history updates.\n"
            "--crontab      -t [] Path to crontab file.\n"
+           "--crontab-dir  -d [] Path to directory of crontab files.\n"
            "--history      -H [] Path to execution history file.\n"
+           "--compile      -C    Compile crontab to the cache file and exit.\n"
+           "--cache        -k [] Path to compiled crontab cache file.\n"
+           "--forecast     -f [] Print the dispatch load for the next [] days and exit.\n"
+           "--convert-history -X [] Convert history file to 'binary' or 'text' and exit.\n"
+           "--cpus         -a [] CPUs for ncron and jobs without a cpus= list.\n"
+           "--cgroup       -g [] Delegated cgroup v2 directory for job cgroups.\n"
+           "--watch        -W    Reload the crontab when it changes.\n"
+           "--socket       -S [] Path to the control socket.\n"
+           "--metrics      -m [] Path to write Prometheus metrics to.\n"
+           "--metrics-interval -M [] Seconds between metrics file updates.\n"
+           "--job-latency  -L    Keep dispatch latency histograms for each job.\n"
+           "--late-warn    -l [] Log dispatches more than [] ms late.\n"
+           "--log-level    -e [] Log 'error', 'warn', 'info' or 'debug' messages.\n"
+           "--log-format   -o [] Log as 'plain' text, 'kv' pairs or 'json'.\n"
+           "--users        -u [] Directory of crontabs named for the users they run as.\n"
+           "--user-jobs    -J [] Most jobs that a user may have with --users.\n"
+           "--user-procs   -P [] Most runs that a user may have going with --users.\n"
+           "--catchup      -y [] Run overdue jobs 'once', 'skip' them or 'stagger' them.\n"
+           "--catchup-window -Y [] Seconds over which overdue jobs are staggered.\n"
            "--verbose      -V    Log diagnostic information.\n"
     );
 }
@@ -270,33 +573,112 @@ static void process_options(int ac, char *av[])
         {"version", 0, NULL, 'v'},
         {"noexecsave", 0, NULL, '0'},
         {"journal", 0, NULL, 'j'},
+        {"durable", 0, NULL, 'D'},
+        {"commit-window", 1, NULL, 'w'},
         {"crontab", 1, NULL, 't'},
+        {"crontab-dir", 1, NULL, 'd'},
         {"history", 1, NULL, 'H'},
+        {"compile", 0, NULL, 'C'},
+        {"cache", 1, NULL, 'k'},
+        {"forecast", 1, NULL, 'f'},
+        {"convert-history", 1, NULL, 'X'},
+        {"cpus", 1, NULL, 'a'},
+        {"cgroup", 1, NULL, 'g'},
+        {"watch", 0, NULL, 'W'},
+        {"socket", 1, NULL, 'S'},
+        {"metrics", 1, NULL, 'm'},
+        {"metrics-interval", 1, NULL, 'M'},
+        {"job-latency", 0, NULL, 'L'},
+        {"late-warn", 1, NULL, 'l'},
+        {"log-level", 1, NULL, 'e'},
+        {"log-format", 1, NULL, 'o'},
+        {"users", 1, NULL, 'u'},
+        {"user-jobs", 1, NULL, 'J'},
+        {"user-procs", 1, NULL, 'P'},
+        {"catchup", 1, NULL, 'y'},
+        {"catchup-window", 1, NULL, 'Y'},
         {"verbose", 0, NULL, 'V'},
         {NULL, 0, NULL, 0 }
     };
     for (;;) {
-        int c = getopt_long(ac, av, "hvb0jt:H:d:V", long_options, NULL);
+        int c = getopt_long(ac, av, "hvb0jDw:t:H:d:Ck:f:X:a:g:WS:m:M:Ll:e:o:u:J:P:y:Y:V", long_options, NULL);
         if (c == -1) break;
         switch (c) {
             case 'h': usage(); exit(EXIT_SUCCESS); break;
             case 'v': print_version(); exit(EXIT_SUCCESS); break;
             case '0': g_ncron_execmode = Execmode_nosave; break;
             case 'j': g_ncron_execmode = Execmode_journal; break;
+            case 'D': g_ncron_durable = true; break;
+            case 'w':
+                if (!strconv_to_u32(optarg, optarg + strlen(optarg), &g_ncron_commit_window_ms))
+                    suicide("Invalid --commit-window: '%s'\n", optarg);
+                break;
             case 't': g_ncron_conf = strdup(optarg); if (!g_ncron_conf) abort(); break;
-            case 'H': {
-                size_t l = strlen(optarg);
-                g_ncron_history = strdup(optarg);
-                if (!g_ncron_history) abort();
-                char *tmpf = malloc(l + 2);
-                if (!tmpf) abort();
-                memcpy(tmpf, optarg, l);
-                tmpf[l] = '~';
-                tmpf[l+1] = 0;
-                g_ncron_history_tmp = tmpf;
+            case 'd': g_ncron_conf_dir = strdup(optarg); if (!g_ncron_conf_dir) abort(); break;
+            case 'H': g_ncron_history = strdup(optarg); if (!g_ncron_history) abort(); break;
+            case 'C': g_ncron_compile = true; break;
+            case 'k': g_ncron_cache = strdup(optarg); if (!g_ncron_cache) abort(); break;
+            case 'f':
+                if (!strconv_to_u32(optarg, optarg + strlen(optarg), &g_ncron_forecast_days)
+                    || !g_ncron_forecast_days)
+                    suicide("Invalid number of days for --forecast: '%s'\n", optarg);
+                break;
+            case 'X':
+                if (strcmp(optarg, "binary") && strcmp(optarg, "text"))
+                    suicide("Invalid --convert-history format: '%s'\n", optarg);
+                g_ncron_convert_history = optarg;
+                break;
+            case 'a':
+                if (!cpu_list_valid(optarg))
+                    suicide("Invalid CPU list for --cpus: '%s'\n", optarg);
+                g_ncron_cpus = optarg;
+                break;
+            case 'g': g_ncron_cgroup = optarg; break;
+            case 'W': g_ncron_watch = true; break;
+            case 'S': g_ncron_socket = optarg; break;
+            case 'm': g_ncron_metrics = optarg; break;
+            case 'M':
+                if (!strconv_to_u32(optarg, optarg + strlen(optarg), &g_ncron_metrics_interval)
+                    || !g_ncron_metrics_interval)
+                    suicide("Invalid --metrics-interval: '%s'\n", optarg);
+                break;
+            case 'L': g_ncron_job_latency = true; break;
+            case 'l':
+                if (!strconv_to_u32(optarg, optarg + strlen(optarg), &g_ncron_late_warn_ms))
+                    suicide("Invalid --late-warn: '%s'\n", optarg);
+                break;
+            case 'e': {
+                enum nk_log_level lv;
+                if (!nk_log_parse_level(optarg, &lv))
+                    suicide("Invalid --log-level: '%s'\n", optarg);
+                nk_log_set_level(lv);
+                gflags_debug = lv == NK_LOG_DEBUG;
                 break;
             }
-            case 'V': gflags_debug = 1; break;
+            case 'o':
+                if (!strcmp(optarg, "plain")) nk_log_set_format(NK_LOG_PLAIN);
+                else if (!strcmp(optarg, "kv")) nk_log_set_format(NK_LOG_KV);
+                else if (!strcmp(optarg, "json")) nk_log_set_format(NK_LOG_JSON);
+                else suicide("Invalid --log-format: '%s'\n", optarg);
+                break;
+            case 'u': g_ncron_users = optarg; break;
+            case 'J':
+                if (!strconv_to_u32(optarg, optarg + strlen(optarg), &g_ncron_user_jobs))
+                    suicide("Invalid --user-jobs: '%s'\n", optarg);
+                break;
+            case 'P':
+                if (!strconv_to_u32(optarg, optarg + strlen(optarg), &g_ncron_user_procs))
+                    suicide("Invalid --user-procs: '%s'\n", optarg);
+                break;
+            case 'y':
+                if (!job_catchup_parse(optarg, &g_ncron_catchup))
+                    suicide("Invalid --catchup: '%s'\n", optarg);
+                break;
+            case 'Y':
+                if (!strconv_to_u32(optarg, optarg + strlen(optarg), &g_ncron_catchup_window))
+                    suicide("Invalid --catchup-window: '%s'\n", optarg);
+                break;
+            case 'V': gflags_debug = 1; nk_log_set_level(NK_LOG_DEBUG); break;
             default: break;
         }
     }
@@ -305,15 +687,101 @@ static void process_options(int ac, char *av[])
 int main(int argc, char* argv[])
 {
     process_options(argc, argv);
-    fail_on_fdne(g_ncron_conf, R_OK);
+    job_catchup_config(g_ncron_catchup, g_ncron_catchup_window);
+    if (g_ncron_users) {
+        if (g_ncron_conf_dir)
+            suicide("--users and --crontab-dir can't be used together\n");
+        if (g_ncron_convert_history)
+            suicide("Per-user history files are always in the text format\n");
+        g_ncron_conf_dir = g_ncron_users;
+        users_init(g_ncron_user_jobs, g_ncron_user_procs);
+    }
+    char const *conf = g_ncron_conf_dir ? g_ncron_conf_dir : g_ncron_conf;
+    if (!g_ncron_cache) {
+        size_t l = strlen(conf);
+        char *cachef = malloc(l + sizeof ".cache");
+        if (!cachef) abort();
+        memcpy(cachef, conf, l);
+        memcpy(cachef + l, ".cache", sizeof ".cache");
+        g_ncron_cache = cachef;
+    }
+    history_init(g_ncron_history, g_ncron_forecast_days > 0, g_ncron_users != NULL);
+    history_set_durable(g_ncron_durable, g_ncron_commit_window_ms);
+    if (g_ncron_convert_history) {
+        fail_on_fdne(g_ncron_history, R_OK | W_OK);
+        bool ok = history_convert(!strcmp(g_ncron_convert_history, "binary"));
+        exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    fail_on_fdne(conf, R_OK);
+    if (g_ncron_compile) {
+        if (!g_ncron_conf_dir)
+            exit(cache_compile(g_ncron_cache, g_ncron_conf) ? EXIT_SUCCESS : EXIT_FAILURE);
+        // Each crontab file gets its own image within the cache directory.
+        if (mkdir(g_ncron_cache, 0700) && errno != EEXIST)
+            suicide("Failed to create cache directory '%s': %s\n",
+                    g_ncron_cache, strerror(errno));
+        parse_config_dir(g_ncron_conf_dir, g_ncron_cache);
+        log_line("Compiled %zu jobs to %s.\n", g_njobs, g_ncron_cache);
+        exit(EXIT_SUCCESS);
+    }
+    if (g_ncron_forecast_days) {
+        fail_on_fdne(g_ncron_history, R_OK);
+        parse_config(g_ncron_conf, g_ncron_conf_dir, g_ncron_history, g_ncron_cache,
+                     &jobq);
+        struct timespec ts;
+        if (clock_gettime(CLOCK_REALTIME, &ts))
+            suicide("clock_gettime failed: %s\n", strerror(errno));
+        forecast(&jobq, &ts, g_ncron_forecast_days);
+        exit(EXIT_SUCCESS);
+    }
     fail_on_fdne(g_ncron_history, R_OK | W_OK);
-    parse_config(g_ncron_conf, g_ncron_history, &stackl, &deadstackl);
+    if (g_ncron_users) {
+        struct stat st;
+        if (stat(g_ncron_history, &st) || !S_ISDIR(st.st_mode))
+            suicide("With --users, the history path '%s' must be a directory\n", g_ncron_history);
+        // Jobs are run as their users, which only root can do.
+        if (geteuid())
+            suicide("--users requires ncron to run as root\n");
+    }
+    parse_config(g_ncron_conf, g_ncron_conf_dir, g_ncron_history, g_ncron_cache,
+                 &jobq);
 
-    if (!stackl)
+    if (!jobq.n)
         suicide("No jobs, exiting.\n");
+    if (g_ncron_execmode == Execmode_journal) {
+        for (size_t i = 0; i < g_njobs; ++i) g_jobs[i].journal_ = true;
+    }
+
+    {
+        // With --users, it is kept in the history directory.
+        char const *sfx = g_ncron_users ? "/.stats" : ".stats";
+        size_t l = strlen(g_ncron_history), sl = strlen(sfx);
+        g_ncron_stats = malloc(l + sl + 1);
+        if (!g_ncron_stats) abort();
+        memcpy(g_ncron_stats, g_ncron_history, l);
+        memcpy(g_ncron_stats + l, sfx, sl + 1);
+    }
+    proc_stats_load(g_ncron_stats);
+    g_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_epfd < 0)
+        suicide("epoll_create1 failed: %s\n", strerror(errno));
+    g_timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_timerfd < 0)
+        suicide("timerfd_create failed: %s\n", strerror(errno));
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = 0 };
+    if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, g_timerfd, &ev))
+        suicide("epoll_ctl failed: %s\n", strerror(errno));
+    proc_init(g_epfd, &jobq);
+    affinity_init(g_ncron_cpus);
+    if (g_ncron_cgroup) cgroup_init(g_ncron_cgroup);
+    if (g_ncron_watch) watch_init(conf, g_ncron_conf_dir != NULL, g_epfd);
 
     umask(077);
     fix_signals();
+    if (g_ncron_socket) control_init(g_ncron_socket, g_epfd, &jobq, flush_history);
+    metrics_config(g_ncron_job_latency, g_ncron_late_warn_ms);
+    if (g_ncron_metrics)
+        metrics_init(g_ncron_metrics, g_ncron_metrics_interval, g_epfd, &jobq);
 
 #ifdef __linux__
     prctl(PR_SET_DUMPABLE, 0, 0, 0, 0);
@@ -321,6 +789,10 @@ int main(int argc, char* argv[])
     prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0);
 #endif
 
+    // Started after affinity_init() so that the writer thread shares the
+    // housekeeping CPUs.
+    nk_log_start();
+    history_start();
     do_work();
     exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,363 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "nk/io.h"
+#include "nk/log.h"
+
+// The ring is a bounded multi-producer queue in which each slot carries a
+// sequence number that tells producers and the consumer whose turn it is,
+// so logging never takes a lock.  A producer that finds the ring full
+// waits for the writer rather than dropping the message.  The writer is
+// only woken through the eventfd when it has said that it is going to
+// sleep, so a busy daemon makes one write(2) per batch of messages.
+
+#define NK_LOG_SLOTS 256          // power of two
+#define NK_LOG_MSG_MAX 1024
+
+// At most NK_LOG_RATE_BURST warnings with the same format string are
+// logged in each NK_LOG_RATE_WINDOW seconds; the rest are counted and
+// reported when the next window begins.
+#define NK_LOG_RATE_BURST 5
+#define NK_LOG_RATE_WINDOW 10
+#define NK_LOG_RATE_SLOTS 64
+
+struct nk_log_slot
+{
+    size_t seq;
+    enum nk_log_level level;
+    struct timespec ts;
+    size_t len;
+    char msg[NK_LOG_MSG_MAX];
+};
+
+struct nk_log_rate
+{
+    const char *fmt;
+    time_t start;
+    unsigned count;
+    unsigned suppressed;
+};
+
+static enum nk_log_level g_level = NK_LOG_INFO;
+static enum nk_log_format g_format = NK_LOG_PLAIN;
+static bool g_async;
+static struct nk_log_slot *g_ring;
+static size_t g_head;               // next slot for producers
+static size_t g_tail;               // next slot for the writer
+static int g_wake_fd = -1;
+static int g_sleeping;              // writer is about to block
+static int g_stop;
+static pthread_t g_writer;
+static pthread_mutex_t g_rate_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct nk_log_rate g_rate[NK_LOG_RATE_SLOTS];
+
+static char const *const level_names[] = { "error", "warn", "info", "debug" };
+
+void nk_log_set_level(enum nk_log_level level) { __atomic_store_n(&g_level, level, __ATOMIC_RELAXED); }
+enum nk_log_level nk_log_get_level(void) { return __atomic_load_n(&g_level, __ATOMIC_RELAXED); }
+void nk_log_set_format(enum nk_log_format format) { g_format = format; }
+
+bool nk_log_parse_level(const char *name, enum nk_log_level *level)
+{
+    for (size_t i = 0; i < sizeof level_names / sizeof *level_names; ++i) {
+        if (!strcmp(name, level_names[i])) {
+            *level = (enum nk_log_level)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends s[0, n) to out for the structured formats, escaped as a JSON
+// string, which also suits the quoted key=value form.  The trailing newline
+// of the message is dropped.
+static size_t escape(char *out, const char *s, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+    if (n && s[n - 1] == '\n') --n;
+    size_t o = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') {
+            out[o++] = '\\';
+            out[o++] = (char)c;
+        } else if (c == '\n') {
+            out[o++] = '\\';
+            out[o++] = 'n';
+        } else if (c == '\t') {
+            out[o++] = '\\';
+            out[o++] = 't';
+        } else if (c < 0x20) {
+            memcpy(out + o, "\\u00", 4);
+            out[o + 4] = hex[c >> 4];
+            out[o + 5] = hex[c & 15];
+            o += 6;
+        } else {
+            out[o++] = (char)c;
+        }
+    }
+    return o;
+}
+
+// Bytes that render() may produce for a message of length n.
+#define RENDER_MAX(n) (6 * (n) + 96)
+
+static size_t render(char *out, enum nk_log_level level, const struct timespec *ts,
+                     const char *msg, size_t n)
+{
+    if (g_format == NK_LOG_PLAIN) {
+        memcpy(out, msg, n);
+        return n;
+    }
+    int r = g_format == NK_LOG_JSON
+        ? snprintf(out, 96, "{\"ts\":%ld.%03ld,\"level\":\"%s\",\"msg\":\"",
+                   (long)ts->tv_sec, ts->tv_nsec / 1000000, level_names[level])
+        : snprintf(out, 96, "ts=%ld.%03ld level=%s msg=\"",
+                   (long)ts->tv_sec, ts->tv_nsec / 1000000, level_names[level]);
+    size_t o = (size_t)r;
+    o += escape(out + o, msg, n);
+    out[o++] = '"';
+    if (g_format == NK_LOG_JSON) out[o++] = '}';
+    out[o++] = '\n';
+    return o;
+}
+
+static void write_now(enum nk_log_level level, const struct timespec *ts,
+                      const char *msg, size_t n)
+{
+    char out[RENDER_MAX(NK_LOG_MSG_MAX)];
+    size_t o = render(out, level, ts, msg, n);
+    safe_write(2, out, o);
+}
+
+static void emit_now(enum nk_log_level level, const struct timespec *ts,
+                     const char *fmt, va_list ap)
+{
+    char msg[NK_LOG_MSG_MAX];
+    int r = vsnprintf(msg, sizeof msg, fmt, ap);
+    if (r < 0) return;
+    write_now(level, ts, msg, (size_t)r < sizeof msg ? (size_t)r : sizeof msg - 1);
+}
+
+static bool ring_empty(void)
+{
+    const struct nk_log_slot *s = &g_ring[g_tail & (NK_LOG_SLOTS - 1)];
+    return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != g_tail + 1;
+}
+
+static void writer_wake(void)
+{
+    uint64_t one = 1;
+    if (write(g_wake_fd, &one, sizeof one) < 0) return;
+}
+
+static void *log_writer(void *arg)
+{
+    (void)arg;
+    size_t cap = 64 * 1024;
+    char *buf = malloc(cap);
+    if (!buf) abort();
+    for (;;) {
+        size_t len = 0;
+        while (!ring_empty()) {
+            struct nk_log_slot *s = &g_ring[g_tail & (NK_LOG_SLOTS - 1)];
+            if (cap - len < RENDER_MAX(s->len)) {
+                safe_write(2, buf, len);
+                len = 0;
+            }
+            len += render(buf + len, s->level, &s->ts, s->msg, s->len);
+            __atomic_store_n(&s->seq, g_tail + NK_LOG_SLOTS, __ATOMIC_RELEASE);
+            ++g_tail;
+        }
+        if (len) safe_write(2, buf, len);
+        __atomic_store_n(&g_sleeping, 1, __ATOMIC_SEQ_CST);
+        if (!ring_empty()) {
+            __atomic_store_n(&g_sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        if (__atomic_load_n(&g_stop, __ATOMIC_ACQUIRE)) break;
+        struct pollfd pfd = { .fd = g_wake_fd, .events = POLLIN };
+        if (poll(&pfd, 1, -1) < 0) continue;
+        uint64_t cnt;
+        if (read(g_wake_fd, &cnt, sizeof cnt) < 0) continue;
+    }
+    free(buf);
+    return NULL;
+}
+
+static void emit(enum nk_log_level level, const char *fmt, va_list ap)
+{
+    struct timespec ts = {0};
+    if (g_format != NK_LOG_PLAIN) clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (!__atomic_load_n(&g_async, __ATOMIC_ACQUIRE)) {
+        emit_now(level, &ts, fmt, ap);
+        return;
+    }
+    size_t pos = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+    struct nk_log_slot *s;
+    for (;;) {
+        s = &g_ring[pos & (NK_LOG_SLOTS - 1)];
+        size_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&g_head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((ptrdiff_t)(seq - pos) < 0) {
+            // Full; the writer is behind, or has been stopped.
+            if (!__atomic_load_n(&g_async, __ATOMIC_ACQUIRE)) {
+                emit_now(level, &ts, fmt, ap);
+                return;
+            }
+            writer_wake();
+            sched_yield();
+            pos = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+        }
+    }
+    int r = vsnprintf(s->msg, sizeof s->msg, fmt, ap);
+    s->len = r < 0 ? 0 : (size_t)r < sizeof s->msg ? (size_t)r : sizeof s->msg - 1;
+    s->level = level;
+    s->ts = ts;
+    __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+    if (__atomic_exchange_n(&g_sleeping, 0, __ATOMIC_SEQ_CST)) writer_wake();
+}
+
+static void emitf(enum nk_log_level level, const char *fmt, ...)
+    __attribute__((format (printf, 2, 3)));
+static void emitf(enum nk_log_level level, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    emit(level, fmt, ap);
+    va_end(ap);
+}
+
+// Returns the entry of fmt, probing from its hash.  Entries are never
+// emptied, so a probe can stop at the first empty one.  If fmt has no entry
+// and there is no room, the entry with the oldest window is given to it,
+// and what it held is stored in evicted so that its count is not lost.
+static struct nk_log_rate *rate_entry(const char *fmt, time_t now, struct nk_log_rate *evicted)
+{
+    size_t h = ((uintptr_t)fmt >> 3) % NK_LOG_RATE_SLOTS;
+    struct nk_log_rate *victim = NULL;
+    for (size_t k = 0; k < NK_LOG_RATE_SLOTS; ++k) {
+        struct nk_log_rate *r = &g_rate[(h + k) % NK_LOG_RATE_SLOTS];
+        if (r->fmt == fmt) return r;
+        if (!r->fmt) {
+            victim = r;
+            break;
+        }
+        if (!victim || r->start < victim->start) victim = r;
+    }
+    *evicted = *victim;
+    *victim = (struct nk_log_rate){ .fmt = fmt, .start = now };
+    return victim;
+}
+
+// Returns false if a message with format fmt is to be suppressed.  Stores
+// in suppressed a count of suppressed messages to report before it, and in
+// sfmt their format, which is fmt unless another format lost its entry.
+static bool rate_ok(const char *fmt, unsigned *suppressed, const char **sfmt)
+{
+    *suppressed = 0;
+    *sfmt = fmt;
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts)) return true;
+    bool ok = true;
+    pthread_mutex_lock(&g_rate_lock);
+    struct nk_log_rate ev = {0};
+    struct nk_log_rate *r = rate_entry(fmt, ts.tv_sec, &ev);
+    if (ev.suppressed) {
+        *suppressed = ev.suppressed;
+        *sfmt = ev.fmt;
+    } else if (ts.tv_sec - r->start >= NK_LOG_RATE_WINDOW) {
+        *suppressed = r->suppressed;
+        *r = (struct nk_log_rate){ .fmt = fmt, .start = ts.tv_sec };
+    }
+    if (r->count < NK_LOG_RATE_BURST) {
+        ++r->count;
+    } else {
+        ++r->suppressed;
+        ok = false;
+    }
+    pthread_mutex_unlock(&g_rate_lock);
+    return ok;
+}
+
+void nk_log(enum nk_log_level level, const char *fmt, ...)
+{
+    if (level > nk_log_get_level()) return;
+    if (level == NK_LOG_WARN) {
+        unsigned suppressed;
+        const char *sfmt;
+        bool ok = rate_ok(fmt, &suppressed, &sfmt);
+        if (suppressed && sfmt == fmt)
+            emitf(NK_LOG_INFO, "(%u similar messages were suppressed)\n", suppressed);
+        else if (suppressed)
+            emitf(NK_LOG_INFO, "(%u messages like \"%.*s\" were suppressed)\n", suppressed,
+                  (int)strcspn(sfmt, "\n"), sfmt);
+        if (!ok) return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    emit(level, fmt, ap);
+    va_end(ap);
+}
+
+void nk_log_die(const char *fmt, ...)
+{
+    nk_log_stop();
+    va_list ap;
+    va_start(ap, fmt);
+    emit(NK_LOG_ERROR, fmt, ap);
+    va_end(ap);
+    exit(EXIT_FAILURE);
+}
+
+// A forked child has no writer thread; what it logs is written directly,
+// and what its parent had queued is left to the parent.
+static void log_atfork_child(void)
+{
+    g_async = false;
+}
+
+void nk_log_stop(void)
+{
+    if (!__atomic_exchange_n(&g_async, false, __ATOMIC_ACQ_REL)) return;
+    __atomic_store_n(&g_stop, 1, __ATOMIC_RELEASE);
+    writer_wake();
+    pthread_join(g_writer, NULL);
+    // Messages from threads that saw the ring just before it was stopped.
+    for (; !ring_empty(); ++g_tail) {
+        struct nk_log_slot *s = &g_ring[g_tail & (NK_LOG_SLOTS - 1)];
+        write_now(s->level, &s->ts, s->msg, s->len);
+        __atomic_store_n(&s->seq, g_tail + NK_LOG_SLOTS, __ATOMIC_RELEASE);
+    }
+}
+
+void nk_log_start(void)
+{
+    g_ring = calloc(NK_LOG_SLOTS, sizeof *g_ring);
+    if (!g_ring) abort();
+    for (size_t i = 0; i < NK_LOG_SLOTS; ++i) g_ring[i].seq = i;
+    g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_wake_fd < 0) return;
+    if (pthread_create(&g_writer, NULL, log_writer, NULL)) {
+        close(g_wake_fd);
+        g_wake_fd = -1;
+        return;
+    }
+    pthread_atfork(NULL, NULL, log_atfork_child);
+    atexit(nk_log_stop);
+    __atomic_store_n(&g_async, true, __ATOMIC_RELEASE);
+}
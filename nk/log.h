@@ -1,18 +1,49 @@
-// Copyright 2003-2024 Nicholas J. Kain <njkain at gmail dot com>
+// Copyright 2003-2026 Nicholas J. Kain <njkain at gmail dot com>
 // SPDX-License-Identifier: MIT
 #ifndef NCM_LOG_H_
 #define NCM_LOG_H_
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 
-#define log_line(...) do { \
-    dprintf(2, __VA_ARGS__); \
-    } while (0)
+enum nk_log_level
+{
+    NK_LOG_ERROR = 0,
+    NK_LOG_WARN,
+    NK_LOG_INFO,
+    NK_LOG_DEBUG,
+};
 
-#define suicide(...) do { \
-    dprintf(2, __VA_ARGS__); \
-    exit(EXIT_FAILURE); } while (0)
+enum nk_log_format
+{
+    NK_LOG_PLAIN = 0,
+    NK_LOG_KV,   // ts=... level=... msg="..."
+    NK_LOG_JSON, // one object per line
+};
 
-#endif
+// Messages go to stderr.  Until nk_log_start() is called, and after
+// nk_log_stop(), each message is written as it is logged; in between, they
+// are formatted into a ring and written in batches by a writer thread.
+void nk_log(enum nk_log_level level, const char *fmt, ...)
+    __attribute__((format (printf, 2, 3)));
+// Logs at NK_LOG_ERROR, writes out everything that is queued, and exits.
+void nk_log_die(const char *fmt, ...)
+    __attribute__((format (printf, 1, 2), noreturn));
+// Messages above level are discarded.  May be called at any time.
+void nk_log_set_level(enum nk_log_level level);
+enum nk_log_level nk_log_get_level(void);
+// Returns false if name is not a level name.
+bool nk_log_parse_level(const char *name, enum nk_log_level *level);
+void nk_log_set_format(enum nk_log_format format);
+// Starts the writer thread; queued messages are written at exit.
+void nk_log_start(void);
+// Writes out everything that is queued and stops the writer thread.
+void nk_log_stop(void);
+
+#define log_line(...) nk_log(NK_LOG_INFO, __VA_ARGS__)
+#define log_warn(...) nk_log(NK_LOG_WARN, __VA_ARGS__)
+#define log_debug(...) nk_log(NK_LOG_DEBUG, __VA_ARGS__)
+#define suicide(...) nk_log_die(__VA_ARGS__)
 
+#endif
@@ -1,7 +1,17 @@
 // Copyright 2022 Nicholas J. Kain <njkain at gmail dot com>
 // SPDX-License-Identifier: MIT
+#define _GNU_SOURCE
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,19 +34,12 @@
         argbuf += SL + 1; argbuflen -= SL + 1; \
     } while (0)
 
-int nk_pspawn(pid_t *pid, const char *command,
-          const posix_spawn_file_actions_t *restrict file_actions,
-          const posix_spawnattr_t *restrict attrp,
-          const char *args, char * const envp[])
+// Fills argv (of MAX_ARGS) from command and the space-separated args,
+// storing the strings in argbuf (of MAX_ARGBUF).
+static void nk_pspawn_argv(char *argv[], char *argbuf, const char *command, const char *args)
 {
-    char *argv[MAX_ARGS];
-    char argbuf_s[MAX_ARGBUF];
-    char *argbuf = argbuf_s;
     size_t curv = 0;
-    size_t argbuflen = sizeof argbuf_s;
-
-    if (!command)
-        _Exit(EXIT_SUCCESS);
+    size_t argbuflen = MAX_ARGBUF;
 
     // strip the path from the command name and set argv[0]
     const char *p = strrchr(command, '/');
@@ -68,6 +71,181 @@ int nk_pspawn(pid_t *pid, const char *command,
                 break;
         }
     }
+}
+
+int nk_pspawn(pid_t *pid, const char *command,
+          const posix_spawn_file_actions_t *restrict file_actions,
+          const posix_spawnattr_t *restrict attrp,
+          const char *args, char * const envp[])
+{
+    char *argv[MAX_ARGS];
+    char argbuf[MAX_ARGBUF];
+
+    if (!command)
+        _Exit(EXIT_SUCCESS);
+    nk_pspawn_argv(argv, argbuf, command, args);
     return posix_spawnp(pid, command, file_actions, attrp, argv, envp);
 }
 
+// The child runs on a stack of its own, but in the memory of the parent,
+// which is suspended until the child has executed the command or exited.
+// A page below the stack is left inaccessible to catch an overflow.
+#define NK_PSPAWN_STACK (64 * 1024)
+
+struct nk_pspawn_child {
+    const char *command;
+    char **argv;
+    char * const *envp;
+    const struct nk_pspawn_opts *opts;
+    sigset_t mask; // of the parent, restored before the exec
+    int err; // set by a child that fails: > 0 for exec, < 0 for the cgroup
+};
+
+// The child shares the thread of the parent, errno included, so errno is
+// cleared before each call whose failure is reported; a value left over
+// from before can't be mistaken for the cause.
+static int nk_pspawn_errno(void)
+{
+    return errno ? errno : EIO;
+}
+
+static int nk_pspawn_child(void *arg)
+{
+    // Only raw syscalls and async-signal-safe calls from here on, and
+    // nothing that writes to memory but *c, errno and the stack.
+    struct nk_pspawn_child *c = arg;
+    const struct nk_pspawn_opts *o = c->opts;
+    // Handlers of the parent would run against its memory; signals are
+    // blocked until the exec, which resets the others anyway.
+    for (int sig = 1; sig < _NSIG; ++sig) {
+        struct sigaction sa;
+        if (sigaction(sig, NULL, &sa) || sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL)
+            continue;
+        sa.sa_handler = SIG_DFL;
+        sa.sa_flags = 0;
+        sigaction(sig, &sa, NULL);
+    }
+    if (o->cgroup_fd >= 0) {
+        errno = 0;
+        int fd = openat(o->cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (fd >= 0) errno = 0;
+        if (fd < 0 || safe_write(fd, "0", 1) != 1) {
+            c->err = -nk_pspawn_errno();
+            _Exit(127);
+        }
+        close(fd);
+    }
+    setpgid(0, 0);
+    if (o->outfd >= 0) {
+        if (o->outfd == STDOUT_FILENO || o->outfd == STDERR_FILENO)
+            fcntl(o->outfd, F_SETFD, 0);
+        dup2(o->outfd, STDOUT_FILENO);
+        dup2(o->outfd, STDERR_FILENO);
+    }
+    // Best effort, as the CPUs may have gone offline since they were chosen.
+    if (o->cpus)
+        syscall(SYS_sched_setaffinity, 0, o->cpus_size, o->cpus);
+    // The libc wrappers would try to change the credentials of every
+    // thread of the parent; the raw syscalls change just this one.
+    const struct nk_pspawn_cred *cred = o->cred;
+    errno = 0;
+    if (cred && (syscall(SYS_setgroups, cred->ngroups, cred->groups)
+                 || syscall(SYS_setresgid, cred->gid, cred->gid, cred->gid)
+                 || syscall(SYS_setresuid, cred->uid, cred->uid, cred->uid)))
+        goto fail;
+    if (cred && cred->dir && chdir(cred->dir)) {
+        // Not fatal, as for cron; the job starts in the root instead.
+        errno = 0;
+        if (chdir("/")) goto fail;
+    }
+    pthread_sigmask(SIG_SETMASK, &c->mask, NULL);
+    errno = 0;
+    execvpe(c->command, c->argv, c->envp);
+fail:
+    c->err = nk_pspawn_errno();
+    _Exit(127);
+}
+
+// The child is created with vfork semantics, as by posix_spawn(), so the
+// cost of a spawn does not grow with the size of the parent.
+static int nk_pspawn_clone(pid_t *pid, const char *command, const struct nk_pspawn_opts *opts,
+                           const char *args, char * const envp[])
+{
+    char *argv[MAX_ARGS];
+    char argbuf[MAX_ARGBUF];
+
+    if (!command)
+        _Exit(EXIT_SUCCESS);
+    nk_pspawn_argv(argv, argbuf, command, args);
+    struct nk_pspawn_child c = { .command = command, .argv = argv, .envp = envp,
+                                 .opts = opts };
+    size_t guard = (size_t)sysconf(_SC_PAGESIZE);
+    size_t len = guard + NK_PSPAWN_STACK;
+    char *stack = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED)
+        return -errno;
+    if (mprotect(stack, guard, PROT_NONE)) {
+        int e = errno;
+        munmap(stack, len);
+        return -e;
+    }
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &c.mask);
+    pid_t r = clone(nk_pspawn_child, stack + len, CLONE_VM | CLONE_VFORK | SIGCHLD, &c);
+    int e = errno;
+    pthread_sigmask(SIG_SETMASK, &c.mask, NULL);
+    munmap(stack, len);
+    if (r < 0)
+        return -e;
+    if (c.err) {
+        while (waitpid(r, NULL, 0) < 0 && errno == EINTR) {}
+        return c.err;
+    }
+    *pid = r;
+    return 0;
+}
+
+// Without a cgroup, credentials or CPUs to set in the child, posix_spawn()
+// does all that is needed.
+static int nk_pspawn_plain(pid_t *pid, const char *command, int outfd,
+                           const char *args, char * const envp[])
+{
+    static posix_spawnattr_t attr;
+    static bool attr_init;
+    if (!attr_init) {
+        int r = posix_spawnattr_init(&attr);
+        if (!r) r = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        if (!r) r = posix_spawnattr_setpgroup(&attr, 0);
+        if (r) return -r;
+        attr_init = true;
+    }
+    posix_spawn_file_actions_t fa, *fap = NULL;
+    if (outfd >= 0) {
+        int r = posix_spawn_file_actions_init(&fa);
+        if (r) return -r;
+        fap = &fa;
+        r = posix_spawn_file_actions_adddup2(&fa, outfd, STDOUT_FILENO);
+        if (!r) r = posix_spawn_file_actions_adddup2(&fa, outfd, STDERR_FILENO);
+        if (r) {
+            posix_spawn_file_actions_destroy(&fa);
+            return -r;
+        }
+    }
+    int r = nk_pspawn(pid, command, fap, &attr, args, envp);
+    if (fap) posix_spawn_file_actions_destroy(fap);
+    return r;
+}
+
+int nk_pspawn_opts(pid_t *pid, const char *command, const struct nk_pspawn_opts *opts,
+                   const char *args, char * const envp[])
+{
+    if (opts->cgroup_fd < 0 && !opts->cred && !opts->cpus)
+        return nk_pspawn_plain(pid, command, opts->outfd, args, envp);
+    // errno is left as the child set it, so it is kept here.
+    int serrno = errno;
+    int r = nk_pspawn_clone(pid, command, opts, args, envp);
+    errno = serrno;
+    return r;
+}
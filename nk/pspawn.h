@@ -11,5 +11,30 @@ int nk_pspawn(pid_t *pid, const char *command,
           const posix_spawnattr_t *attrp,
           const char *args, char * const envp[]);
 
-#endif
+struct nk_pspawn_cred {
+    uid_t uid;
+    gid_t gid;
+    const gid_t *groups; // supplementary groups
+    size_t ngroups;
+    const char *dir; // working directory, or NULL
+};
+
+struct nk_pspawn_opts {
+    int cgroup_fd; // cgroup v2 group for the child, or -1
+    int outfd; // stdout and stderr of the child, or -1
+    const struct nk_pspawn_cred *cred; // credentials to take on, or NULL
+    const void *cpus; // CPU mask as for sched_setaffinity(), or NULL
+    size_t cpus_size;
+};
 
+// Like nk_pspawn(), but the child is in a new process group and takes on
+// the settings in opts before it executes the command: it joins the
+// cgroup, then the credentials are changed.  Returns 0, a positive errno
+// value if the command could not be executed or the credentials could not
+// be taken on, or a negative errno value if the child could not be created
+// or could not join the cgroup.  If there is no cgroup, credentials or CPU
+// mask, the child is created by posix_spawn().
+int nk_pspawn_opts(pid_t *pid, const char *command, const struct nk_pspawn_opts *opts,
+                   const char *args, char * const envp[]);
+
+#endif
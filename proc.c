@@ -0,0 +1,499 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "nk/log.h"
+#include "strconv.h"
+#include "sched.h"
+#include "proc.h"
+#include "history.h"
+#include "affinity.h"
+#include "users.h"
+
+extern int gflags_debug;
+extern size_t g_njobs;
+extern struct Job *g_jobs;
+
+// Running processes, open-addressed by pid.  pid 0 marks an empty slot.
+struct ProcEnt
+{
+    pid_t pid;
+    int pidfd;
+    struct Job *job;
+    uint64_t start_ns;
+    time_t deadline;  // of the pending timeout stage, if any
+    size_t heapidx;   // of the deadline in g_heap, or SIZE_MAX
+    int outfd;        // output log, or -1
+    off_t outsize;    // size of the output log at spawn
+    int cpu;          // bound CPU, or -1
+    bool terminating; // SIGTERM has been sent
+};
+static struct ProcEnt *g_procs;
+static size_t g_procs_size; // power of two
+static size_t g_procs_count;
+static int g_epfd = -1;
+static struct JobHeap *g_heap;
+
+void proc_init(int epfd, struct JobHeap *heap)
+{
+    g_epfd = epfd;
+    g_heap = heap;
+}
+
+size_t proc_running(void) { return g_procs_count; }
+
+bool proc_job_running(const struct Job *job)
+{
+    for (size_t i = 0; i < g_procs_size; ++i) {
+        if (g_procs[i].pid && g_procs[i].job == job) return true;
+    }
+    return false;
+}
+
+void proc_remap(const struct Job *old, size_t nold, struct Job *const *map)
+{
+    for (size_t i = 0; i < g_procs_size; ++i) {
+        struct ProcEnt *e = &g_procs[i];
+        if (!e->pid || e->job < old || e->job >= old + nold) continue;
+        e->job = map[e->job - old];
+        // The deadline of the run follows it.
+        if (e->job && e->heapidx != SIZE_MAX) job_heap_replace(g_heap, e->heapidx, e->job);
+    }
+}
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts)) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t proc_slot(pid_t pid)
+{
+    return ((size_t)pid * 0x9e3779b1u) & (g_procs_size - 1);
+}
+
+static struct ProcEnt *proc_find(pid_t pid)
+{
+    if (!g_procs_count) return NULL;
+    for (size_t i = proc_slot(pid);; i = (i + 1) & (g_procs_size - 1)) {
+        if (g_procs[i].pid == pid) return &g_procs[i];
+        if (!g_procs[i].pid) return NULL;
+    }
+}
+
+static void proc_insert(struct ProcEnt *tab, size_t size, const struct ProcEnt *e)
+{
+    size_t i = ((size_t)e->pid * 0x9e3779b1u) & (size - 1);
+    while (tab[i].pid) i = (i + 1) & (size - 1);
+    tab[i] = *e;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones.
+static void proc_remove(struct ProcEnt *e)
+{
+    size_t mask = g_procs_size - 1;
+    size_t i = (size_t)(e - g_procs), j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!g_procs[j].pid) break;
+        size_t k = proc_slot(g_procs[j].pid);
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            g_procs[i] = g_procs[j];
+            i = j;
+        }
+    }
+    g_procs[i].pid = 0;
+    --g_procs_count;
+}
+
+// path -> path.1 -> path.2 ... up to JOB_OUTPUT_KEEP.
+static void proc_output_rotate(const char *path)
+{
+    char from[PATH_MAX], to[PATH_MAX];
+    for (int i = JOB_OUTPUT_KEEP; i > 0; --i) {
+        if (i > 1) snprintf(from, sizeof from, "%s.%d", path, i - 1);
+        else snprintf(from, sizeof from, "%s", path);
+        snprintf(to, sizeof to, "%s.%d", path, i);
+        if (rename(from, to) && errno != ENOENT)
+            log_line("Failed to rotate output log (%s => %s): %s\n", from, to, strerror(errno));
+    }
+}
+
+static int proc_output_open_fd(const struct Job *job, off_t *size)
+{
+    for (int rotated = 0;; ++rotated) {
+        int fd = open(job->output_, O_WRONLY | O_APPEND | O_CREAT | O_NOCTTY | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            log_line("Failed to open output log '%s' for job %d: %s\n",
+                     job->output_, job->id_, strerror(errno));
+            return -1;
+        }
+        struct stat st;
+        if (fstat(fd, &st)) {
+            log_line("Failed to stat output log '%s': %s\n", job->output_, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        if (rotated || !job->output_max_kb_ || !S_ISREG(st.st_mode)
+            || st.st_size < (off_t)job->output_max_kb_ * 1024) {
+            *size = st.st_size;
+            return fd;
+        }
+        close(fd);
+        proc_output_rotate(job->output_);
+    }
+}
+
+// The log of a user's job is opened and rotated with the user's
+// credentials, so that a crontab can't be used to write where its user
+// could not.
+int proc_output_open(const struct Job *job, off_t *size)
+{
+    if (!job->user_) return proc_output_open_fd(job, size);
+    if (!users_fs_enter(job->user_)) {
+        log_line("Failed to take on the credentials of user %s for job %d\n",
+                 job->user_->name, job->id_);
+        return -1;
+    }
+    int fd = proc_output_open_fd(job, size);
+    users_fs_leave();
+    return fd;
+}
+
+void proc_track(struct Job *job, pid_t pid, int outfd, off_t outsize, int cpu)
+{
+    if ((g_procs_count + 1) * 2 > g_procs_size) {
+        size_t nsize = g_procs_size ? g_procs_size * 2 : 64;
+        struct ProcEnt *ntab = calloc(nsize, sizeof *ntab);
+        if (!ntab) abort();
+        for (size_t i = 0; i < g_procs_size; ++i) {
+            if (g_procs[i].pid) proc_insert(ntab, nsize, &g_procs[i]);
+        }
+        free(g_procs);
+        g_procs = ntab;
+        g_procs_size = nsize;
+    }
+    struct ProcEnt e = { .pid = pid, .pidfd = -1, .job = job, .start_ns = mono_ns(),
+                         .heapidx = SIZE_MAX, .outfd = outfd, .outsize = outsize, .cpu = cpu };
+    // Without a pidfd, the process is still reaped by proc_reap() at the
+    // next wakeup.
+    e.pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (e.pidfd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = (uint64_t)pid };
+        if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, e.pidfd, &ev)) {
+            log_line("epoll_ctl failed for pid %d: %s\n", pid, strerror(errno));
+            close(e.pidfd);
+            e.pidfd = -1;
+        }
+    } else if (gflags_debug) {
+        log_debug("pidfd_open failed for pid %d: %s\n", pid, strerror(errno));
+    }
+    if (job->timeout_) {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_REALTIME, &ts))
+            suicide("clock_gettime failed: %s\n", strerror(errno));
+        // Deadlines have second granularity; round up so a job always
+        // gets at least its full timeout.
+        e.deadline = ts.tv_sec + (ts.tv_nsec > 0) + (time_t)job->timeout_;
+    }
+    proc_insert(g_procs, g_procs_size, &e);
+    ++g_procs_count;
+    if (e.deadline) job_heap_push_timer(g_heap, job, pid, e.deadline);
+    if (job->user_) ++job->user_->running;
+}
+
+void proc_timer_moved(pid_t pid, size_t i)
+{
+    struct ProcEnt *e = proc_find(pid);
+    if (e) e->heapidx = i;
+}
+
+// Undoes the accounting of proc_track(); e is then removed.
+static void proc_release(struct ProcEnt *e)
+{
+    if (e->heapidx != SIZE_MAX) {
+        job_heap_remove_timer(g_heap, e->heapidx);
+        e->heapidx = SIZE_MAX;
+    }
+    affinity_release(e->cpu);
+    if (e->job->user_ && e->job->user_->running) --e->job->user_->running;
+}
+
+void proc_deadline(pid_t pid, const struct Job *job, time_t when)
+{
+    struct ProcEnt *e = proc_find(pid);
+    // Deadlines are removed when their process exits, so a mismatch would
+    // be a pid that has since been reused.  Otherwise, the group can't have
+    // been reused as its leader is unreaped.
+    if (!e || e->job != job || e->deadline != when) return;
+    e->heapidx = SIZE_MAX; // popped by the caller
+    if (!e->terminating) {
+        log_line("Job %d (pid %d) exceeded its timeout of %u s; sending SIGTERM\n",
+                 e->job->id_, pid, e->job->timeout_);
+        if (kill(-pid, SIGTERM) && errno != ESRCH)
+            log_line("Failed to signal process group %d: %s\n", pid, strerror(errno));
+        e->terminating = true;
+        e->deadline = when + JOB_KILL_GRACE;
+        job_heap_push_timer(g_heap, e->job, pid, e->deadline);
+    } else {
+        log_line("Job %d (pid %d) ignored SIGTERM; sending SIGKILL\n", e->job->id_, pid);
+        if (kill(-pid, SIGKILL) && errno != ESRCH)
+            log_line("Failed to signal process group %d: %s\n", pid, strerror(errno));
+        e->deadline = 0;
+    }
+}
+
+static unsigned wall_bucket(uint64_t ms)
+{
+    unsigned b = 0;
+    for (uint64_t v = ms + 1; v > 1 && b < JOB_WALL_BUCKETS - 1; v >>= 1) ++b;
+    return b;
+}
+
+uint64_t job_stats_wall_pct(const struct JobStats *st, unsigned pct)
+{
+    uint64_t n = 0;
+    for (size_t i = 0; i < JOB_WALL_BUCKETS; ++i) n += st->wall_ms_hist[i];
+    if (!n) return 0;
+    uint64_t want = (n * pct + 99) / 100, seen = 0;
+    if (!want) want = 1;
+    for (unsigned i = 0; i < JOB_WALL_BUCKETS; ++i) {
+        seen += st->wall_ms_hist[i];
+        if (seen >= want) return ((uint64_t)1 << (i + 1)) - 1;
+    }
+    return UINT64_MAX;
+}
+
+struct JobStats *job_stats(struct Job *job)
+{
+    if (!job->stats_) {
+        job->stats_ = calloc(1, sizeof *job->stats_);
+        if (!job->stats_) abort();
+    }
+    return job->stats_;
+}
+
+static void proc_finish(struct ProcEnt *e, int status, const struct rusage *ru)
+{
+    struct Job *j = e->job;
+    struct JobStats *st = job_stats(j);
+    uint64_t cpu = (uint64_t)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000
+                 + (uint64_t)(ru->ru_utime.tv_usec + ru->ru_stime.tv_usec);
+    uint64_t wall = (mono_ns() - e->start_ns) / 1000000;
+    bool ok = WIFEXITED(status) && !WEXITSTATUS(status);
+    ++st->runs;
+    if (!ok) ++st->failures;
+    st->cpu_us_total += cpu;
+    if (cpu > st->cpu_us_max) st->cpu_us_max = cpu;
+    if ((uint64_t)ru->ru_maxrss > st->maxrss_kb) st->maxrss_kb = (uint64_t)ru->ru_maxrss;
+    st->last_status = status;
+    ++st->wall_ms_hist[wall_bucket(wall)];
+    // If runs of a job overlap, each also counts the output of the others.
+    if (e->outfd >= 0) {
+        struct stat ost;
+        if (!fstat(e->outfd, &ost) && ost.st_size > e->outsize)
+            st->output_bytes += (uint64_t)(ost.st_size - e->outsize);
+        close(e->outfd);
+    }
+    if (gflags_debug)
+        log_debug("EXIT %d pid %d status %d cpu %lu us rss %ld kB wall %lu ms\n",
+                 j->id_, e->pid, status, cpu, ru->ru_maxrss, wall);
+
+    if (e->pidfd >= 0) close(e->pidfd); // Also removes it from the epoll set.
+    proc_release(e);
+    proc_remove(e);
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts))
+        suicide("clock_gettime failed: %s\n", strerror(errno));
+    if (job_finish(j, ok, g_heap, &ts)) {
+        if (gflags_debug)
+            log_debug("INTERVAL %d now %u s\n", j->id_,
+                     j->cur_interval_ ? j->cur_interval_ : j->interval_);
+        if (j->journal_) history_journal(&j, 1);
+    }
+}
+
+// Reaps pid, which must have exited.
+static void proc_collect(pid_t pid)
+{
+    struct ProcEnt *e = proc_find(pid);
+    // Descendants left in the group of a job that timed out are killed
+    // while the zombie leader still keeps the group id from being reused.
+    if (e && e->terminating && kill(-pid, SIGKILL) && errno != ESRCH)
+        log_line("Failed to signal process group %d: %s\n", pid, strerror(errno));
+    int status;
+    struct rusage ru;
+    pid_t r = wait4(pid, &status, WNOHANG, &ru);
+    if (!e) return;
+    if (r == pid) {
+        proc_finish(e, status, &ru);
+    } else if (r < 0) {
+        log_line("wait4 failed for pid %d: %s\n", pid, strerror(errno));
+        if (e->pidfd >= 0) close(e->pidfd);
+        if (e->outfd >= 0) close(e->outfd);
+        proc_release(e);
+        proc_remove(e);
+    }
+}
+
+void proc_exited(pid_t pid)
+{
+    if (proc_find(pid)) proc_collect(pid);
+}
+
+void proc_reap(void)
+{
+    for (;;) {
+        siginfo_t si = { .si_pid = 0 };
+        if (waitid(P_ALL, 0, &si, WEXITED | WNOHANG | WNOWAIT)) {
+            if (errno != ECHILD)
+                log_line("waitid failed: %s\n", strerror(errno));
+            break;
+        }
+        if (!si.si_pid) break;
+        proc_collect(si.si_pid);
+    }
+}
+
+void proc_report(void)
+{
+    log_line("Job stats: %zu running\n", g_procs_count);
+    for (size_t i = 0; i < g_njobs; ++i) {
+        const struct Job *j = &g_jobs[i];
+        const struct JobStats *st = j->stats_;
+        if (!st || (!st->runs && !st->spawn_failures)) continue;
+        log_line("job %d: runs %lu failed %lu unspawned %lu cpu avg %lu us max %lu us"
+                 " rss max %lu kB wall p50 <%lu p90 <%lu p99 <%lu ms output %lu B\n",
+                 j->id_, st->runs, st->failures, st->spawn_failures,
+                 st->runs ? st->cpu_us_total / st->runs : 0,
+                 st->cpu_us_max, st->maxrss_kb, job_stats_wall_pct(st, 50),
+                 job_stats_wall_pct(st, 90), job_stats_wall_pct(st, 99),
+                 st->output_bytes);
+    }
+}
+
+bool proc_stats_save(char const *path)
+{
+    size_t l = strlen(path);
+    char *tmp = malloc(l + 2);
+    if (!tmp) abort();
+    memcpy(tmp, path, l);
+    memcpy(tmp + l, "~", 2);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        log_line("Failed to open stats file %s for write\n", tmp);
+        free(tmp);
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i < g_njobs; ++i) {
+        const struct Job *j = &g_jobs[i];
+        const struct JobStats *st = j->stats_;
+        if (!st || (!st->runs && !st->spawn_failures)) continue;
+        if (j->user_) ok = fprintf(f, "%s:", j->user_->name) >= 0;
+        ok = ok && fprintf(f, "%d %lu %lu %lu %lu %lu %d", j->id_, st->runs, st->failures,
+                           st->cpu_us_total, st->cpu_us_max, st->maxrss_kb,
+                           st->last_status) >= 0;
+        for (size_t k = 0; ok && k < JOB_WALL_BUCKETS; ++k)
+            ok = fprintf(f, " %u", st->wall_ms_hist[k]) >= 0;
+        ok = ok && fprintf(f, " %lu %lu\n", st->output_bytes, st->spawn_failures) >= 0;
+    }
+    if (fclose(f) || !ok) {
+        log_line("Failed to write to stats file %s\n", tmp);
+        unlink(tmp);
+        free(tmp);
+        return false;
+    }
+    if (rename(tmp, path)) {
+        log_line("Failed to update stats file (%s => %s): %s\n", tmp, path, strerror(errno));
+        unlink(tmp);
+        free(tmp);
+        return false;
+    }
+    free(tmp);
+    return true;
+}
+
+// Returns the next space-delimited field of the line at *p.
+static bool next_field(char **p, const char **fb, const char **fe)
+{
+    char *s = *p;
+    while (*s == ' ') ++s;
+    if (!*s) return false;
+    *fb = s;
+    while (*s && *s != ' ') ++s;
+    *fe = s;
+    *p = s;
+    return true;
+}
+
+// The key of the job, "ID" or "USER:ID", is left at [*kb, *ke).
+static bool parse_stats_line(char *p, const char **kb, const char **ke, struct JobStats *st)
+{
+    const char *b, *e;
+    int32_t v32;
+    uint64_t *u64s[] = { &st->runs, &st->failures, &st->cpu_us_total,
+                         &st->cpu_us_max, &st->maxrss_kb };
+    if (!next_field(&p, kb, ke)) return false;
+    for (size_t i = 0; i < sizeof u64s / sizeof *u64s; ++i) {
+        if (!next_field(&p, &b, &e) || !strconv_to_u64(b, e, u64s[i])) return false;
+    }
+    if (!next_field(&p, &b, &e) || !strconv_to_i32(b, e, &v32)) return false;
+    st->last_status = v32;
+    for (size_t i = 0; i < JOB_WALL_BUCKETS; ++i) {
+        if (!next_field(&p, &b, &e) || !strconv_to_u32(b, e, &st->wall_ms_hist[i]))
+            return false;
+    }
+    if (!next_field(&p, &b, &e) || !strconv_to_u64(b, e, &st->output_bytes)) return false;
+    if (!next_field(&p, &b, &e) || !strconv_to_u64(b, e, &st->spawn_failures)) return false;
+    return !next_field(&p, &b, &e);
+}
+
+void proc_stats_load(char const *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        if (errno != ENOENT)
+            log_line("Failed to open stats file '%s' for read: %s\n", path, strerror(errno));
+        return;
+    }
+    struct Job **byid = job_index_by_id(g_jobs, g_njobs);
+    char buf[1024];
+    size_t linenum = 0;
+    while (fgets(buf, sizeof buf, f)) {
+        size_t llen = strlen(buf);
+        if (llen && buf[llen-1] == '\n') buf[--llen] = 0;
+        ++linenum;
+        if (!llen) continue;
+        const char *kb, *ke;
+        struct JobStats st = {0};
+        if (!parse_stats_line(buf, &kb, &ke, &st)) {
+            log_line("Malformed stats entry at line %zu of '%s'; ignoring\n", linenum, path);
+            continue;
+        }
+        struct Job *j = job_index_find_key(byid, g_njobs, kb, (size_t)(ke - kb));
+        if (!j) continue;
+        if (!j->stats_) {
+            j->stats_ = malloc(sizeof *j->stats_);
+            if (!j->stats_) abort();
+        }
+        *j->stats_ = st;
+    }
+    free(byid);
+    fclose(f);
+}
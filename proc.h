@@ -0,0 +1,73 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_PROC_H_
+#define NCRON_PROC_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+struct Job;
+struct JobHeap;
+
+// Seconds between SIGTERM and SIGKILL for a job that has timed out.
+#define JOB_KILL_GRACE 10
+
+#define JOB_WALL_BUCKETS 32
+
+// Resource usage aggregated over every completed run of a job.
+struct JobStats
+{
+    uint64_t runs;          // completed runs
+    uint64_t failures;      // runs that exited nonzero or were killed
+    uint64_t cpu_us_total;  // user + system
+    uint64_t cpu_us_max;
+    uint64_t maxrss_kb;
+    int last_status;        // as returned by wait4()
+    uint64_t output_bytes;  // written to the output log
+    uint64_t spawn_failures; // runs that could not be started
+    // Bucket i counts runs whose wall time in ms was in [2^i - 1, 2^(i+1) - 1).
+    uint32_t wall_ms_hist[JOB_WALL_BUCKETS];
+};
+
+// Spawned processes are tracked with pidfds registered in epfd, using the
+// pid as the epoll data; epoll data 0 is reserved for the caller.  Run
+// deadlines are queued in heap.
+void proc_init(int epfd, struct JobHeap *heap);
+// Opens the output log of job for appending, rotating it first if it has
+// reached its size limit.  Returns -1 on failure; otherwise, the size of the
+// log is stored in size.
+int proc_output_open(const struct Job *job, off_t *size);
+// If outfd is not -1, it is the output log of the process, opened at size
+// outsize; the process then owns it.  cpu is the CPU that affinity_pick()
+// counted the process against, or -1.
+void proc_track(struct Job *job, pid_t pid, int outfd, off_t outsize, int cpu);
+// Called when a deadline queued for pid, a run of job, expires.  Sends
+// SIGTERM to the process group of a job that is still running, and SIGKILL
+// if it is still running after the grace period.
+void proc_deadline(pid_t pid, const struct Job *job, time_t when);
+// Called by the heap when the deadline of pid is stored at index i.
+void proc_timer_moved(pid_t pid, size_t i);
+// Reaps pid if it has exited; called when its pidfd becomes readable.
+void proc_exited(pid_t pid);
+// Reaps every child that has exited, including orphans that were
+// reparented to us as subreaper.
+void proc_reap(void);
+size_t proc_running(void);
+// Returns true if a run of job is still being tracked.
+bool proc_job_running(const struct Job *job);
+// Repoints the processes of the jobs in old[0, nold) to map[i], the job that
+// replaces old[i], along with their deadlines; every job with a running
+// process must have one.
+void proc_remap(const struct Job *old, size_t nold, struct Job *const *map);
+
+// Returns the stats of job, allocating them if needed.
+struct JobStats *job_stats(struct Job *job);
+// Returns the upper bound in ms of the wall-time percentile pct (0-100).
+uint64_t job_stats_wall_pct(const struct JobStats *st, unsigned pct);
+// Logs the aggregates of every job that has completed a run.
+void proc_report(void);
+// The stats file lives alongside the history file.
+bool proc_stats_save(char const *path);
+void proc_stats_load(char const *path);
+#endif
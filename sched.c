@@ -10,10 +10,19 @@
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
+#include <pthread.h>
 #include "nk/log.h"
 #include "nk/pspawn.h"
 #include "nk/io.h"
+#include "hash.h"
+#include "strconv.h"
 #include "sched.h"
+#include "proc.h"
+#include "affinity.h"
+#include "cgroup.h"
+#include "users.h"
+#include "metrics.h"
+#include "trace.h"
 
 extern char **environ;
 
@@ -21,45 +30,225 @@ extern char **environ;
 // it probably won't run in the uptime of the machine.
 #define MAX_YEARS 5
 
-void job_init(struct Job *self)
+void job_cst_init(struct JobCst *self)
 {
-    *self = (struct Job){ .id_ = -1 };
     // Allowed by default.
-    memset(&self->cst_hhmm_, 1, sizeof self->cst_hhmm_);
-    memset(&self->cst_mday_, 1, sizeof self->cst_mday_);
-    memset(&self->cst_wday_, 1, sizeof self->cst_wday_);
-    memset(&self->cst_mon_, 1, sizeof self->cst_mon_);
+    memset(self, 1, sizeof *self);
+}
+
+// Open-addressed set of all distinct constraint blocks.
+static struct JobCst **cst_tab;
+static size_t cst_tab_size; // power of two
+static size_t cst_tab_count;
+static pthread_mutex_t cst_tab_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t cst_slot(struct JobCst **tab, size_t size, const struct JobCst *c)
+{
+    size_t i = (size_t)fnv1a64(FNV1A64_INIT, c, sizeof *c) & (size - 1);
+    while (tab[i] && memcmp(tab[i], c, sizeof *c))
+        i = (i + 1) & (size - 1);
+    return i;
+}
+
+const struct JobCst *job_cst_intern(const struct JobCst *cst)
+{
+    struct JobCst all, cc = *cst;
+    const struct JobCst *c = &cc;
+    job_cst_init(&all);
+    all.any_ = cc.any_ = false;
+    cc.any_ = !memcmp(&cc, &all, sizeof cc);
+
+    pthread_mutex_lock(&cst_tab_mtx);
+    if ((cst_tab_count + 1) * 2 > cst_tab_size) {
+        size_t nsize = cst_tab_size ? cst_tab_size * 2 : 16;
+        struct JobCst **ntab = calloc(nsize, sizeof *ntab);
+        if (!ntab) abort();
+        for (size_t i = 0; i < cst_tab_size; ++i) {
+            if (cst_tab[i])
+                ntab[cst_slot(ntab, nsize, cst_tab[i])] = cst_tab[i];
+        }
+        free(cst_tab);
+        cst_tab = ntab;
+        cst_tab_size = nsize;
+    }
+    size_t i = cst_slot(cst_tab, cst_tab_size, c);
+    if (!cst_tab[i]) {
+        cst_tab[i] = malloc(sizeof *c);
+        if (!cst_tab[i]) abort();
+        memcpy(cst_tab[i], c, sizeof *c);
+        ++cst_tab_count;
+    }
+    const struct JobCst *r = cst_tab[i];
+    pthread_mutex_unlock(&cst_tab_mtx);
+    return r;
+}
+
+void job_cst_intern_destroy(void)
+{
+    for (size_t i = 0; i < cst_tab_size; ++i) free(cst_tab[i]);
+    free(cst_tab);
+    cst_tab = NULL;
+    cst_tab_size = cst_tab_count = 0;
+}
+
+void job_init(struct Job *self)
+{
+    *self = (struct Job){ .id_ = -1, .output_max_kb_ = JOB_OUTPUT_MAX_KB, .backoff_ = 1,
+                          .hslot_ = UINT32_MAX, .cgroup_fd_ = -1 };
+}
+
+// Orders the job with id of the user named by the len bytes at name, or
+// with no user if name is NULL, against j.  Jobs without a user sort first.
+static int job_key_cmp(const char *name, size_t len, int id, const struct Job *j)
+{
+    const char *jn = j->user_ ? j->user_->name : NULL;
+    if (!name != !jn) return name ? 1 : -1;
+    if (name) {
+        int c = strncmp(name, jn, len);
+        if (!c && jn[len]) c = -1;
+        if (c) return c;
+    }
+    return (id > j->id_) - (id < j->id_);
+}
+
+static int job_id_cmp(const void *a, const void *b)
+{
+    const struct Job *x = *(struct Job * const *)a, *y = *(struct Job * const *)b;
+    const char *n = x->user_ ? x->user_->name : NULL;
+    return job_key_cmp(n, n ? strlen(n) : 0, x->id_, y);
+}
+
+struct Job **job_index_by_id(struct Job *jobs, size_t njobs)
+{
+    struct Job **r = malloc((njobs + 1) * sizeof *r);
+    if (!r) abort();
+    for (size_t i = 0; i < njobs; ++i) r[i] = &jobs[i];
+    qsort(r, njobs, sizeof *r, job_id_cmp);
+    return r;
+}
+
+struct Job *job_index_find_name(struct Job *const *idx, size_t njobs,
+                                const char *name, size_t len, int id)
+{
+    size_t lo = 0, hi = njobs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = job_key_cmp(name, len, id, idx[mid]);
+        if (!c) return idx[mid];
+        if (c < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+struct Job *job_index_find(struct Job *const *idx, size_t njobs,
+                           const struct User *user, int id)
+{
+    const char *n = user ? user->name : NULL;
+    return job_index_find_name(idx, njobs, n, n ? strlen(n) : 0, id);
+}
+
+struct Job *job_index_find_key(struct Job *const *idx, size_t njobs,
+                               const char *key, size_t len)
+{
+    const char *c = memchr(key, ':', len);
+    const char *ib = c ? c + 1 : key;
+    int id;
+    if (!strconv_to_i32(ib, key + len, &id)) return NULL;
+    return job_index_find_name(idx, njobs, c ? key : NULL, c ? (size_t)(c - key) : 0, id);
 }
 
 void job_destroy(struct Job *self)
 {
     if (self->command_) { free(self->command_); self->command_ = NULL; }
     if (self->args_) { free(self->args_); self->args_ = NULL; }
+    if (self->output_) { free(self->output_); self->output_ = NULL; }
+    if (self->cpus_) { free(self->cpus_); self->cpus_ = NULL; }
+    if (self->cgroup_) { free(self->cgroup_); self->cgroup_ = NULL; }
+    if (self->cgroup_fd_ >= 0) close(self->cgroup_fd_);
+    self->cgroup_fd_ = -1;
+    free(self->after_);
+    free(self->dependents_);
+    self->after_ = NULL;
+    self->dependents_ = NULL;
+    self->nafter_ = self->ndependents_ = 0;
+    free(self->stats_);
+    self->stats_ = NULL;
+    free(self->latency_);
+    self->latency_ = NULL;
+}
+
+static bool str_eq(const char *a, const char *b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+bool job_same_def(const struct Job *a, const struct Job *b)
+{
+    // Constraints are interned, whether parsed or loaded from an image.
+    return a->id_ == b->id_ && a->user_ == b->user_ && a->cst_ == b->cst_
+        && a->interval_ == b->interval_ && a->interval_ms_ == b->interval_ms_
+        && a->maxruns_ == b->maxruns_
+        && a->timeout_ == b->timeout_ && a->output_max_kb_ == b->output_max_kb_
+        && a->fail_interval_ == b->fail_interval_ && a->backoff_ == b->backoff_
+        && a->cpu_weight_ == b->cpu_weight_ && a->io_weight_ == b->io_weight_
+        && a->memory_high_kb_ == b->memory_high_kb_ && a->journal_ == b->journal_
+        && a->deadline_ == b->deadline_ && a->catchup_ == b->catchup_
+        && str_eq(a->command_, b->command_) && str_eq(a->args_, b->args_)
+        && str_eq(a->output_, b->output_) && str_eq(a->cpus_, b->cpus_)
+        && str_eq(a->cgroup_, b->cgroup_) && a->nafter_ == b->nafter_
+        && (!a->nafter_ || !memcmp(a->after_, b->after_, a->nafter_ * sizeof *a->after_));
+}
+
+void job_inherit(struct Job *self, struct Job *old, bool unchanged)
+{
+    self->numruns_ = old->numruns_;
+    self->lasttime_ = old->lasttime_;
+    self->hslot_ = old->hslot_;
+    self->spawn_fails_ = old->spawn_fails_;
+    self->paused_ = old->paused_;
+    if (self->fail_interval_ || self->backoff_ > 1) self->cur_interval_ = old->cur_interval_;
+    self->stats_ = old->stats_;
+    old->stats_ = NULL;
+    self->latency_ = old->latency_;
+    old->latency_ = NULL;
+    // Upstream jobs that have completed still count if they remain upstream.
+    for (unsigned i = 0; i < self->nafter_; ++i) {
+        for (unsigned k = 0; k < old->nafter_; ++k) {
+            if (old->after_[k] == self->after_[i] && (old->after_done_ >> k & 1))
+                self->after_done_ |= (uint64_t)1 << i;
+        }
+    }
+    if (!unchanged) return;
+    self->exectime_ = old->exectime_;
+    self->exectime_nsec_ = old->exectime_nsec_;
+    self->cgroup_fd_ = old->cgroup_fd_;
+    old->cgroup_fd_ = -1;
 }
 
 static bool job_in_month(const struct Job *self, int v)
 {
     assert(v > 0 && v < 13);
-    return self->cst_mon_[v - 1];
+    return self->cst_->mon_[v - 1];
 }
 
 static bool job_in_mday(const struct Job *self, int v)
 {
     assert(v > 0 && v < 32);
-    return self->cst_mday_[v - 1];
+    return self->cst_->mday_[v - 1];
 }
 
 static bool job_in_wday(const struct Job *self, int v)
 {
     assert(v > 0 && v < 8);
-    return self->cst_wday_[v - 1];
+    return self->cst_->wday_[v - 1];
 }
 
 static bool job_in_hhmm(const struct Job *self, int h, int m)
 {
     assert(h >= 0 && h < 24);
     assert(m >= 0 && h < 60);
-    return self->cst_hhmm_[h * 60 + m];
+    return self->cst_->hhmm_[h * 60 + m];
 }
 
 static bool is_leap_year(int year)
@@ -95,7 +284,7 @@ struct day_sieve
     uint8_t filter[366];
 };
 
-static bool day_sieve_day_ok(struct day_sieve *self, int i) { return self->filter[i] == 7; }
+static bool day_sieve_day_ok(const struct day_sieve *self, int i) { return self->filter[i] == 7; }
 
 static bool day_sieve_build(struct day_sieve *self, struct Job const *entry, int year)
 {
@@ -138,6 +327,29 @@ static bool day_sieve_build(struct day_sieve *self, struct Job const *entry, int
     return false;
 }
 
+// A sieve depends only on the constraints and the year, and a handful of
+// distinct constraint blocks typically cover every job, so recently
+// built sieves are kept.  Only used from the dispatch thread.
+#define DAY_SIEVE_CACHE_SIZE 64
+static struct day_sieve_cache_ent {
+    const struct JobCst *cst;
+    int year;
+    bool ok;
+    struct day_sieve ds;
+} day_sieve_cache[DAY_SIEVE_CACHE_SIZE];
+
+static const struct day_sieve *day_sieve_get(struct Job const *entry, int year)
+{
+    size_t i = (((uintptr_t)entry->cst_ >> 4) ^ (unsigned)year) % DAY_SIEVE_CACHE_SIZE;
+    struct day_sieve_cache_ent *e = &day_sieve_cache[i];
+    if (e->cst != entry->cst_ || e->year != year) {
+        e->ok = day_sieve_build(&e->ds, entry, year);
+        e->cst = entry->cst_;
+        e->year = year;
+    }
+    return e->ok ? &e->ds : NULL;
+}
+
 #define ADVANCE_YEAR_OR_STOP() \
     rtime->tm_mday = 1;\
     rtime->tm_mon = 0;\
@@ -148,29 +360,39 @@ static bool day_sieve_build(struct day_sieve *self, struct Job const *entry, int
 
 /* stime is the time we're constraining
  * returns a time value that has been appropriately constrained */
-static time_t job_constrain_time(struct Job *self, time_t stime)
+static time_t job_constrain_search(struct Job *self, time_t stime, unsigned *iters)
 {
     struct tm *rtime;
     time_t t;
 
+    if (self->cst_->any_) return stime;
+
     rtime = localtime(&stime);
 
+    // Common case: stime itself is allowed, so skip building a sieve.
+    if (job_in_month(self, rtime->tm_mon + 1)
+        && job_in_mday(self, rtime->tm_mday)
+        && job_in_wday(self, rtime->tm_wday + 1)
+        && job_in_hhmm(self, rtime->tm_hour, rtime->tm_min))
+        return stime;
+
     int syear = rtime->tm_year;
     int cyear = syear - 1; // force sieve to be built
-    struct day_sieve ds;
+    const struct day_sieve *ds = NULL;
 
     for (;;) {
+        ++*iters;
         t = mktime(rtime);
         rtime = localtime(&t);
         if (rtime->tm_year != cyear) {
             cyear = rtime->tm_year;
-            if (!day_sieve_build(&ds, self, rtime->tm_year)) {
+            if (!(ds = day_sieve_get(self, rtime->tm_year))) {
                 // Year has no permitted days, try the next.
                 ADVANCE_YEAR_OR_STOP();
             }
         }
 
-        if (!day_sieve_day_ok(&ds, rtime->tm_yday)) {
+        if (!day_sieve_day_ok(ds, rtime->tm_yday)) {
             // Day isn't allowed.  Advance to the start of
             // the next allowed day.
             rtime->tm_min = 0;
@@ -178,7 +400,7 @@ static time_t job_constrain_time(struct Job *self, time_t stime)
             rtime->tm_mday++;
             int ndays = is_leap_year(rtime->tm_year) ? 365 : 364;
             for (int i = rtime->tm_yday + 1; i < ndays; ++i) {
-                if (day_sieve_day_ok(&ds, i))
+                if (day_sieve_day_ok(ds, i))
                     goto day_ok;
                 rtime->tm_mday++;
             }
@@ -186,9 +408,27 @@ static time_t job_constrain_time(struct Job *self, time_t stime)
             ADVANCE_YEAR_OR_STOP();
         }
     day_ok:
+        {
+            // If no later minute of this day is allowed, and no DST change
+            // could bring an earlier hour around again, skip to the next day.
+            int cur = rtime->tm_hour * 60 + rtime->tm_min;
+            if (!memchr(&self->cst_->hhmm_[cur], true, (size_t)(1440 - cur))) {
+                struct tm nt = {
+                    .tm_year = rtime->tm_year, .tm_mon = rtime->tm_mon,
+                    .tm_mday = rtime->tm_mday + 1, .tm_isdst = -1,
+                };
+                if (mktime(&nt) != -1 && nt.tm_isdst == rtime->tm_isdst) {
+                    rtime->tm_min = 0;
+                    rtime->tm_hour = 0;
+                    rtime->tm_mday++;
+                    continue;
+                }
+            }
+        }
         for (;;) {
             if (job_in_hhmm(self, rtime->tm_hour, rtime->tm_min))
                 return mktime(rtime);
+            ++*iters;
             ++rtime->tm_min;
             if (rtime->tm_min == 60) {
                 // Advance to next hour.
@@ -211,52 +451,496 @@ static time_t job_constrain_time(struct Job *self, time_t stime)
     return 0;
 }
 
-/* Used when jobs are first loaded. */
-void job_set_initial_exectime(struct Job *self, const struct timespec *ts)
+static time_t job_constrain_time(struct Job *self, time_t stime)
+{
+    unsigned iters = 0;
+    TRACE2(constrain__entry, self->id_, stime);
+    time_t r = job_constrain_search(self, stime, &iters);
+    TRACE4(constrain__return, self->id_, stime, r, iters);
+    return r;
+}
+
+// The interval in effect, which is longer than interval_ after failures.
+static unsigned int job_interval(const struct Job *self)
 {
-    self->exectime_ = ts->tv_sec;
+    return self->cur_interval_ ? self->cur_interval_ : self->interval_;
+}
+
+static void job_set_exectime(struct Job *self, time_t t)
+{
+    self->exectime_ = t;
+    self->exectime_nsec_ = 0;
+}
+
+static enum JobCatchup g_catchup = JOB_CATCHUP_ONCE;
+static unsigned int g_catchup_window = JOB_CATCHUP_WINDOW;
+
+bool job_catchup_parse(char const *s, enum JobCatchup *c)
+{
+    if (!strcmp(s, "once")) *c = JOB_CATCHUP_ONCE;
+    else if (!strcmp(s, "skip")) *c = JOB_CATCHUP_SKIP;
+    else if (!strcmp(s, "stagger")) *c = JOB_CATCHUP_STAGGER;
+    else return false;
+    return true;
+}
+
+void job_catchup_config(enum JobCatchup policy, unsigned int window)
+{
+    g_catchup = policy;
+    g_catchup_window = window;
+}
+
+// The first time after now on the grid of intervals from the last run, so
+// that the runs that are skipped don't shift the phase of the job.
+static time_t job_next_unmissed(struct Job *self, time_t now)
+{
+    unsigned int intv = job_interval(self);
+    time_t t = now + 1;
+    if (intv && self->lasttime_ > 0 && self->lasttime_ <= now)
+        t = self->lasttime_ + ((now - self->lasttime_) / intv + 1) * (time_t)intv;
+    return job_constrain_time(self, t);
+}
+
+// Called for a job that has run before and is due at ts, when it is
+// loaded; due is the time it would run at now.  Returns when it is to run.
+static time_t job_catchup(struct Job *self, const struct timespec *ts, time_t due)
+{
+    enum JobCatchup c = self->catchup_ ? (enum JobCatchup)self->catchup_ : g_catchup;
+    bool late = false;
+    unsigned int intv = job_interval(self);
+    if (self->deadline_ && intv) {
+        time_t missed = job_constrain_time(self, self->lasttime_ + intv);
+        late = missed && ts->tv_sec - missed > (time_t)self->deadline_;
+    }
+    if (c == JOB_CATCHUP_SKIP || late) return job_next_unmissed(self, ts->tv_sec);
+    if (c == JOB_CATCHUP_STAGGER) self->overdue_ = true;
+    return due;
+}
+
+static void job_initial_exectime(struct Job *self, const struct timespec *ts,
+                                 bool catchup)
+{
+    uint64_t st = metrics_ns();
+    job_set_exectime(self, ts->tv_sec);
     time_t ttm = job_constrain_time(self, ts->tv_sec);
     time_t ttd = ttm - self->lasttime_;
-    if (ttd < self->interval_) {
-        ttm += self->interval_ - ttd;
+    unsigned int intv = job_interval(self);
+    if (ttd < intv) {
+        ttm += intv - ttd;
         ttm = job_constrain_time(self, ttm);
+    } else if (catchup && ttm == ts->tv_sec && self->lasttime_ > 0) {
+        ttm = job_catchup(self, ts, ttm);
     }
-    self->exectime_ = ttm;
+    job_set_exectime(self, ttm);
+    metrics_hist_add(&g_metrics.solver, metrics_ns() - st);
 }
 
-// Advances to next time of execution; performs constraint
-static void job_set_next_time(struct Job *self, const struct timespec *ts)
+void job_set_initial_exectime(struct Job *self, const struct timespec *ts)
 {
-    time_t etime = job_constrain_time(self, ts->tv_sec + self->interval_);
-    self->exectime_ = etime > ts->tv_sec ? etime : 0;
+    job_initial_exectime(self, ts, false);
 }
 
-void job_exec(struct Job *self, const struct timespec *ts)
+void job_load_exectime(struct Job *self, const struct timespec *ts)
 {
-    pid_t pid;
-    int ret = nk_pspawn(&pid, self->command_, NULL, NULL, self->args_, environ);
-    if (ret) {
-        log_line("posix_spawn failed for '%s': %s\n", self->command_, strerror(ret));
+    self->overdue_ = false;
+    job_initial_exectime(self, ts, true);
+}
+
+void job_catchup_stagger(struct Job *jobs, size_t njobs, const struct timespec *ts)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < njobs; ++i) n += jobs[i].overdue_;
+    if (!n) return;
+    size_t k = 0;
+    for (size_t i = 0; i < njobs; ++i) {
+        struct Job *j = &jobs[i];
+        if (!j->overdue_) continue;
+        j->overdue_ = false;
+        time_t off = (time_t)((uint64_t)g_catchup_window * k++ / n);
+        job_set_exectime(j, job_constrain_time(j, ts->tv_sec + off));
+    }
+    log_line("Staggering %zu overdue jobs over %u s.\n", n, g_catchup_window);
+}
+
+bool job_skip_late(struct Job *self, const struct timespec *ts)
+{
+    if (!self->deadline_ || ts->tv_sec - self->exectime_ <= (time_t)self->deadline_)
+        return false;
+    log_warn("Job %d is %ld s late, past its deadline of %u s; skipping the run\n",
+             self->id_, (long)(ts->tv_sec - self->exectime_), self->deadline_);
+    ++g_metrics.skipped_runs;
+    job_set_exectime(self, job_next_unmissed(self, ts->tv_sec));
+    return true;
+}
+
+// Advances to next time of execution; performs constraint
+static void job_set_next_time(struct Job *self, const struct timespec *ts)
+{
+    // Jobs with upstreams wait to be queued by job_deps_done().
+    if (self->nafter_) {
+        job_set_exectime(self, 0);
         return;
     }
+    if (!self->interval_ms_ || self->cur_interval_) {
+        time_t etime = job_constrain_time(self, ts->tv_sec + job_interval(self));
+        job_set_exectime(self, etime > ts->tv_sec ? etime : 0);
+        return;
+    }
+    // Sub-second intervals follow on from the time the run was due rather
+    // than when it was dispatched, so that they keep their phase; a run
+    // that was due more than an interval ago starts over from ts.
+    struct timespec due = job_exectime(self), next;
+    if (!timespec_before(&due, ts)) due = *ts;
+    for (int i = 0; i < 2; ++i) {
+        next.tv_sec = due.tv_sec + self->interval_;
+        next.tv_nsec = due.tv_nsec + (long)self->interval_ms_ * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            ++next.tv_sec;
+            next.tv_nsec -= 1000000000L;
+        }
+        if (timespec_before(ts, &next)) break;
+        due = *ts;
+    }
+    // Calendar constraints have a resolution of a minute, so a run that
+    // they move starts on the second.
+    time_t etime = job_constrain_time(self, next.tv_sec);
+    job_set_exectime(self, etime);
+    if (etime == next.tv_sec) self->exectime_nsec_ = next.tv_nsec;
+}
+
+// Records a run at ts and schedules the next one.
+void job_mark_run(struct Job *self, const struct timespec *ts)
+{
     ++self->numruns_;
     self->lasttime_ = ts->tv_sec;
+    uint64_t st = metrics_ns();
     job_set_next_time(self, ts);
+    metrics_hist_add(&g_metrics.solver, metrics_ns() - st);
 }
 
-void job_insert(struct Job **head, struct Job *elt)
+bool job_exec(struct Job *self, const struct timespec *ts)
 {
-    elt->next_ = NULL;
+    TRACE2(exec__start, self->id_, ts->tv_sec);
+    if (self->user_ && !users_may_run(self->user_)) {
+        // Tried again each second until a run of the user's has exited.
+        job_set_exectime(self, job_constrain_time(self, ts->tv_sec + 1));
+        log_debug("DEFER %d: user %s has %u runs going\n", self->id_,
+                  self->user_->name, self->user_->running);
+        TRACE3(exec__done, self->id_, 0, self->exectime_);
+        return false;
+    }
+    // Each job runs in its own process group so that a timeout can take
+    // down everything it started, and its output goes straight to the log
+    // file; the daemon never touches it.
+    off_t outsize = 0;
+    int outfd = self->output_ ? proc_output_open(self, &outsize) : -1;
+    struct nk_pspawn_opts opts = { .cgroup_fd = cgroup_job_fd(self), .outfd = outfd };
+    int cpu = affinity_pick(self->cpus_, &opts.cpus, &opts.cpus_size);
+    char * const *envp = environ;
+    struct nk_pspawn_cred cred;
+    if (self->user_) {
+        const struct User *u = self->user_;
+        cred = (struct nk_pspawn_cred){ .uid = u->uid, .gid = u->gid, .groups = u->groups,
+                                        .ngroups = u->ngroups, .dir = u->home };
+        opts.cred = &cred;
+        envp = u->env;
+    }
+    pid_t pid;
+    uint64_t st = metrics_ns();
+    TRACE2(spawn__start, self->id_, opts.cgroup_fd >= 0);
+    int ret = nk_pspawn_opts(&pid, self->command_, &opts, self->args_, envp);
+    if (ret < 0 && opts.cgroup_fd >= 0) {
+        cgroup_spawn_failed(self, -ret);
+        opts.cgroup_fd = -1;
+        ret = nk_pspawn_opts(&pid, self->command_, &opts, self->args_, envp);
+    }
+    if (ret < 0) ret = -ret;
+    metrics_spawn(self, metrics_ns() - st);
+    TRACE3(spawn__done, self->id_, ret ? 0 : pid, ret);
+    if (ret) {
+        if (outfd >= 0) close(outfd);
+        affinity_release(cpu);
+        // Retry after 1, 2, 4, ... seconds, but no later than a normal run.
+        ++job_stats(self)->spawn_failures;
+        ++g_metrics.spawn_failures;
+        unsigned int cap = job_interval(self) ? job_interval(self) : 1;
+        unsigned int delay = self->spawn_fails_ < 31 ? 1u << self->spawn_fails_ : cap;
+        if (delay > cap) delay = cap;
+        ++self->spawn_fails_;
+        job_set_exectime(self, job_constrain_time(self, ts->tv_sec + delay));
+        log_warn("posix_spawn failed for '%s': %s; retrying in %u s\n",
+                 self->command_, strerror(ret), delay);
+        TRACE3(exec__done, self->id_, 0, self->exectime_);
+        return false;
+    }
+    self->spawn_fails_ = 0;
+    proc_track(self, pid, outfd, outsize, cpu);
+    job_mark_run(self, ts);
+    TRACE3(exec__done, self->id_, pid, self->exectime_);
+    return true;
+}
+
+// Ties are broken by id so that dispatch order is deterministic.
+static bool job_before(const struct JobHeapEnt *a, const struct JobHeapEnt *b)
+{
+    if (a->exectime.tv_sec != b->exectime.tv_sec) return a->exectime.tv_sec < b->exectime.tv_sec;
+    if (a->exectime.tv_nsec != b->exectime.tv_nsec) return a->exectime.tv_nsec < b->exectime.tv_nsec;
+    if (a->id != b->id) return a->id < b->id;
+    return a->pid < b->pid;
+}
+
+static void job_heap_set(struct JobHeap *self, size_t i, struct JobHeapEnt e)
+{
+    self->v[i] = e;
+    if (!e.pid) e.job->heapidx_ = i;
+    else proc_timer_moved(e.pid, i);
+}
+
+static void job_heap_sift_up(struct JobHeap *self, size_t i)
+{
+    struct JobHeapEnt e = self->v[i];
+    while (i > 0) {
+        size_t p = (i - 1) / 2;
+        if (!job_before(&e, &self->v[p])) break;
+        job_heap_set(self, i, self->v[p]);
+        i = p;
+    }
+    job_heap_set(self, i, e);
+}
+
+static void job_heap_sift_down(struct JobHeap *self, size_t i)
+{
+    struct JobHeapEnt e = self->v[i];
     for (;;) {
-        if (!*head) {
-            *head = elt;
-            return;
+        size_t c = 2 * i + 1;
+        if (c >= self->n) break;
+        if (c + 1 < self->n && job_before(&self->v[c + 1], &self->v[c])) ++c;
+        if (!job_before(&self->v[c], &e)) break;
+        job_heap_set(self, i, self->v[c]);
+        i = c;
+    }
+    job_heap_set(self, i, e);
+}
+
+static void job_heap_fix_at(struct JobHeap *self, size_t i)
+{
+    if (i > 0 && job_before(&self->v[i], &self->v[(i - 1) / 2]))
+        job_heap_sift_up(self, i);
+    else
+        job_heap_sift_down(self, i);
+}
+
+static void job_heap_add(struct JobHeap *self, struct JobHeapEnt e)
+{
+    if (self->n == self->cap) {
+        self->cap = self->cap ? self->cap * 2 : 64;
+        self->v = realloc(self->v, self->cap * sizeof *self->v);
+        if (!self->v) abort();
+    }
+    job_heap_set(self, self->n, e);
+    job_heap_sift_up(self, self->n++);
+}
+
+static void job_heap_remove_at(struct JobHeap *self, size_t i)
+{
+    if (self->v[i].pid) --self->ntimers;
+    struct JobHeapEnt last = self->v[--self->n];
+    if (i == self->n) return;
+    job_heap_set(self, i, last);
+    job_heap_fix_at(self, i);
+}
+
+void job_heap_push(struct JobHeap *self, struct Job *j)
+{
+    job_heap_add(self, (struct JobHeapEnt){ .exectime = job_exectime(j), .id = j->id_, .job = j });
+}
+
+void job_heap_push_timer(struct JobHeap *self, struct Job *j, pid_t pid, time_t when)
+{
+    job_heap_add(self, (struct JobHeapEnt){ .exectime = { .tv_sec = when }, .id = j->id_, .pid = pid, .job = j });
+    ++self->ntimers;
+}
+
+void job_heap_remove(struct JobHeap *self, struct Job *j)
+{
+    size_t i = j->heapidx_;
+    assert(i < self->n && self->v[i].job == j && !self->v[i].pid);
+    job_heap_remove_at(self, i);
+}
+
+void job_heap_remove_timer(struct JobHeap *self, size_t i)
+{
+    assert(i < self->n && self->v[i].pid);
+    job_heap_remove_at(self, i);
+}
+
+void job_heap_replace(struct JobHeap *self, size_t i, struct Job *j)
+{
+    struct JobHeapEnt e = self->v[i];
+    e.job = j;
+    e.id = j->id_;
+    if (!e.pid) e.exectime = job_exectime(j);
+    job_heap_set(self, i, e);
+    job_heap_fix_at(self, i);
+}
+
+void job_heap_pop(struct JobHeap *self)
+{
+    assert(self->n);
+    job_heap_remove_at(self, 0);
+}
+
+void job_heap_fix(struct JobHeap *self, struct Job *j)
+{
+    size_t i = j->heapidx_;
+    self->v[i].exectime = job_exectime(j);
+    job_heap_fix_at(self, i);
+}
+
+void job_heap_destroy(struct JobHeap *self)
+{
+    free(self->v);
+    *self = (struct JobHeap){0};
+}
+
+bool job_deps_link(struct Job *jobs, size_t njobs)
+{
+    struct Job **byid = job_index_by_id(jobs, njobs);
+    unsigned int *indeg = calloc(njobs ? njobs : 1, sizeof *indeg);
+    if (!indeg) abort();
+    bool ok = true;
+    for (size_t i = 0; i < njobs; ++i) jobs[i].ndependents_ = 0;
+    for (size_t i = 0; ok && i < njobs; ++i) {
+        struct Job *j = &jobs[i];
+        // An upstream is always a job of the same user.
+        for (unsigned k = 0; k < j->nafter_; ++k) {
+            struct Job *u = job_index_find(byid, njobs, j->user_, j->after_[k]);
+            if (!u) {
+                log_line("ERROR IN CRONTAB: job %d is after job %d, which does not exist\n",
+                         j->id_, j->after_[k]);
+                ok = false;
+                break;
+            }
+            ++u->ndependents_;
         }
-        if (elt->exectime_ < (*head)->exectime_) {
-            elt->next_ = *head;
-            *head = elt;
-            return;
+        indeg[i] = j->nafter_;
+    }
+    if (!ok) goto out;
+    for (size_t i = 0; i < njobs; ++i) {
+        struct Job *j = &jobs[i];
+        free(j->dependents_);
+        j->dependents_ = NULL;
+        if (j->ndependents_) {
+            j->dependents_ = malloc(j->ndependents_ * sizeof *j->dependents_);
+            if (!j->dependents_) abort();
+            j->ndependents_ = 0;
+        }
+    }
+    for (size_t i = 0; i < njobs; ++i) {
+        struct Job *j = &jobs[i];
+        for (unsigned k = 0; k < j->nafter_; ++k) {
+            struct Job *u = job_index_find(byid, njobs, j->user_, j->after_[k]);
+            u->dependents_[u->ndependents_++] = j;
         }
-        head = &(*head)->next_;
     }
+
+    // Cycles are found by a single pass of Kahn's algorithm: the jobs that
+    // are never queued are in a cycle or wait on one.
+    size_t *queue = malloc((njobs ? njobs : 1) * sizeof *queue);
+    if (!queue) abort();
+    size_t qh = 0, qt = 0;
+    for (size_t i = 0; i < njobs; ++i) {
+        if (!indeg[i]) queue[qt++] = i;
+    }
+    while (qh < qt) {
+        struct Job *u = &jobs[queue[qh++]];
+        for (unsigned k = 0; k < u->ndependents_; ++k) {
+            size_t d = (size_t)(u->dependents_[k] - jobs);
+            if (!--indeg[d]) queue[qt++] = d;
+        }
+    }
+    if (qt != njobs) {
+        // Every job left has an upstream that is also left, so following
+        // those links njobs times ends up inside a cycle.
+        size_t i = 0;
+        while (!indeg[i]) ++i;
+        for (size_t n = 0; n < njobs; ++n) {
+            struct Job *j = &jobs[i];
+            for (unsigned k = 0; k < j->nafter_; ++k) {
+                struct Job *u = job_index_find(byid, njobs, j->user_, j->after_[k]);
+                if (indeg[u - jobs]) {
+                    i = (size_t)(u - jobs);
+                    break;
+                }
+            }
+        }
+        log_line("ERROR IN CRONTAB: 'after' dependencies of job %d form a cycle\n", jobs[i].id_);
+        ok = false;
+    }
+    free(queue);
+out:
+    free(indeg);
+    free(byid);
+    return ok;
+}
+
+void job_deps_resolve(struct Job *jobs, size_t njobs)
+{
+    if (!job_deps_link(jobs, njobs)) exit(EXIT_FAILURE);
+}
+
+bool job_heap_contains(const struct JobHeap *heap, const struct Job *j)
+{
+    size_t i = j->heapidx_;
+    return i < heap->n && heap->v[i].job == j && !heap->v[i].pid;
+}
+
+static void job_deps_done(struct Job *self, struct JobHeap *heap, const struct timespec *ts)
+{
+    for (unsigned i = 0; i < self->ndependents_; ++i) {
+        struct Job *d = self->dependents_[i];
+        for (unsigned k = 0; k < d->nafter_; ++k) {
+            if (d->after_[k] == self->id_) d->after_done_ |= (uint64_t)1 << k;
+        }
+        uint64_t all = d->nafter_ == 64 ? UINT64_MAX : ((uint64_t)1 << d->nafter_) - 1;
+        if (d->after_done_ != all) continue;
+        if (d->maxruns_ && d->numruns_ >= d->maxruns_) continue;
+        d->after_done_ = 0;
+        if (d->paused_) continue;
+        // Already waiting on its interval or constraints.
+        if (job_heap_contains(heap, d)) continue;
+        job_set_initial_exectime(d, ts);
+        job_heap_push(heap, d);
+    }
+}
+
+// The first failure switches to fail_interval_ and each further one
+// multiplies the interval by backoff_.
+static unsigned int job_fail_interval(const struct Job *self)
+{
+    // Sub-second intervals back off from a second.
+    uint64_t base = self->interval_ms_ && !self->interval_ ? 1 : self->interval_;
+    uint64_t first = self->fail_interval_ ? self->fail_interval_ : base * self->backoff_;
+    uint64_t r = self->cur_interval_ ? (uint64_t)self->cur_interval_ * self->backoff_ : first;
+    uint64_t cap = first > JOB_FAIL_INTERVAL_MAX ? first : JOB_FAIL_INTERVAL_MAX;
+    if (r > cap) r = cap;
+    return r > UINT_MAX ? UINT_MAX : (unsigned int)r;
+}
+
+bool job_finish(struct Job *self, bool ok, struct JobHeap *heap, const struct timespec *ts)
+{
+    unsigned int old = self->cur_interval_;
+    if (ok) {
+        self->cur_interval_ = 0;
+        job_deps_done(self, heap, ts);
+    } else if (self->fail_interval_ || self->backoff_ > 1) {
+        self->cur_interval_ = job_fail_interval(self);
+    }
+    if (self->cur_interval_ == old) return false;
+    // The next run was scheduled by the old interval when this one began.
+    if (job_heap_contains(heap, self) && !self->nafter_) {
+        job_set_initial_exectime(self, ts);
+        job_heap_fix(heap, self);
+    }
+    return true;
 }
@@ -5,33 +5,203 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/time.h>
+#include <sys/types.h>
+
+// Calendar constraints.  These are interned, so jobs with identical
+// constraints share a single copy.
+struct JobCst
+{
+    bool hhmm_[1440]; // If corresponding bit is set, time is allowed.
+    bool mday_[31];
+    bool wday_[7];
+    bool mon_[12];
+    bool any_; // Nothing is constrained; set by job_cst_intern().
+};
+
+// Output logs are rotated once they reach this size, by default; the
+// previous JOB_OUTPUT_KEEP logs are kept with suffixes .1, .2, ...
+#define JOB_OUTPUT_MAX_KB 10240
+#define JOB_OUTPUT_KEEP 3
+
+// Most upstream jobs that a job may depend on with after=.
+#define JOB_AFTER_MAX 64
+
+// Repeated failures never stretch the interval of a job beyond this many
+// seconds, or beyond its on_failure_interval= if that is longer.
+#define JOB_FAIL_INTERVAL_MAX 86400
+
+// What is done about a job that came due while ncron was not running.
+enum JobCatchup
+{
+    JOB_CATCHUP_DEFAULT = 0, // as given to ncron with --catchup
+    JOB_CATCHUP_ONCE,        // run it once, right away
+    JOB_CATCHUP_SKIP,        // wait for its first run that is not yet due
+    JOB_CATCHUP_STAGGER,     // run it once, spread over the catch-up window
+};
+
+// Window over which staggered jobs are spread, by default.
+#define JOB_CATCHUP_WINDOW 300
+
+struct User;
 
 struct Job
 {
-    struct Job *next_;
+    size_t heapidx_;         /* position in the JobHeap, if queued */
     char *command_;
     char *args_;
+    char *output_;           /* file receiving stdout and stderr, or NULL */
+    char *cpus_;             /* CPU list that runs may be bound to, or NULL */
+    char *cgroup_;           /* name of the job's cgroup, or NULL for the default */
     time_t exectime_;        /* time at which we will execute in the future */
+    long exectime_nsec_;     /* sub-second part of exectime_ */
     time_t lasttime_;        /* time that the job last ran */
     int id_;
     unsigned int interval_;  /* min interval between executions in seconds */
+    unsigned int interval_ms_; /* sub-second part of interval_, in ms */
     unsigned int numruns_;   /* number of times a job has run */
     unsigned int maxruns_;   /* max # of times a job will run, 0 = nolim */
+    unsigned int timeout_;   /* max run time in seconds, 0 = nolim */
+    unsigned int output_max_kb_; /* rotate output_ at this size, 0 = never */
+    unsigned int spawn_fails_; /* consecutive failures to spawn */
+    unsigned int fail_interval_; /* interval after a failed run, 0 = interval_ */
+    unsigned int backoff_;   /* multiplier for each further failed run */
+    unsigned int cur_interval_; /* interval in effect after failures, or 0 */
+    unsigned int cpu_weight_;  /* cgroup settings, 0 = unset */
+    unsigned int io_weight_;
+    unsigned int memory_high_kb_;
+    unsigned int deadline_;  /* skip runs this late, in seconds, 0 = never */
+    unsigned char catchup_;  /* enum JobCatchup */
+    bool overdue_;           /* to be staggered by job_catchup_stagger() */
+    int cgroup_fd_;          /* -1 until opened, -2 if unusable */
+    uint32_t hslot_;         /* record index in a binary history file, or UINT32_MAX */
     bool journal_;
+    bool paused_;            /* taken out of the schedule by the control socket */
 
-    bool cst_hhmm_[1440]; // If corresponding bit is set, time is allowed.
-    bool cst_mday_[31];
-    bool cst_wday_[7];
-    bool cst_mon_[12];
+    const struct JobCst *cst_;
+    struct User *user_;      /* owner of the crontab with --users, else NULL */
+    struct JobStats *stats_; /* resource usage; NULL until a run completes */
+    struct JobLatency *latency_; /* with --job-latency; NULL until dispatched */
+
+    // A job with upstreams is not run by time; it is queued once all of
+    // its upstream jobs have exited successfully since its last run.
+    int *after_;             /* ids of upstream jobs */
+    unsigned int nafter_;
+    uint64_t after_done_;    /* bit i set if after_[i] has completed */
+    struct Job **dependents_; /* jobs that have this job as an upstream */
+    unsigned int ndependents_;
 };
 
+void job_cst_init(struct JobCst *);
+const struct JobCst *job_cst_intern(const struct JobCst *);
+void job_cst_intern_destroy(void);
+
 void job_init(struct Job *);
 void job_destroy(struct Job *);
-void job_insert(struct Job **head, struct Job *elt);
 
+// Returns an array of pointers to jobs sorted by the name of their user and
+// then by id; free() it when done.  Ids are only unique within a user, and
+// jobs without a user come first.
+struct Job **job_index_by_id(struct Job *jobs, size_t njobs);
+// Finds the job with id of user, which is NULL for jobs without one.
+struct Job *job_index_find(struct Job *const *idx, size_t njobs,
+                           const struct User *user, int id);
+// As job_index_find(), for the user named by the len bytes at name.
+struct Job *job_index_find_name(struct Job *const *idx, size_t njobs,
+                                const char *name, size_t len, int id);
+// Finds the job with the len bytes at key, which are "ID", or "USER:ID" for
+// a job of a user; these keys are used in files and control commands.
+struct Job *job_index_find_key(struct Job *const *idx, size_t njobs,
+                               const char *key, size_t len);
+
+// Binary min-heap of jobs ordered by exectime_.  The sort keys are
+// copied into the entries to keep sifting within the heap array.
+//
+// The heap also holds run deadlines for the processes of jobs that have a
+// timeout; these have a nonzero pid.  Their positions are reported to
+// proc_timer_moved() so that they can be removed when the process exits.
+struct JobHeapEnt
+{
+    struct timespec exectime;
+    int id;
+    pid_t pid;
+    struct Job *job;
+};
+struct JobHeap
+{
+    struct JobHeapEnt *v;
+    size_t n;
+    size_t cap;
+    size_t ntimers; // entries that are deadlines
+};
+
+static inline bool timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec != b->tv_sec ? a->tv_sec < b->tv_sec : a->tv_nsec < b->tv_nsec;
+}
+
+static inline struct timespec job_exectime(const struct Job *j)
+{
+    return (struct timespec){ .tv_sec = j->exectime_, .tv_nsec = j->exectime_nsec_ };
+}
+
+void job_heap_push(struct JobHeap *, struct Job *);
+void job_heap_push_timer(struct JobHeap *, struct Job *, pid_t pid, time_t when);
+void job_heap_remove(struct JobHeap *, struct Job *);
+// Removes the deadline at index i, which proc_timer_moved() reported.
+void job_heap_remove_timer(struct JobHeap *, size_t i);
+// Points the entry at i, a job or a deadline, at j, which takes the place
+// of its job after a reload, and restores heap order.
+void job_heap_replace(struct JobHeap *, size_t i, struct Job *j);
+// Removes the earliest entry, which may be a job or a deadline.
+void job_heap_pop(struct JobHeap *);
+// Restores heap order after the exectime_ of a queued job has changed.
+void job_heap_fix(struct JobHeap *, struct Job *);
+bool job_heap_contains(const struct JobHeap *, const struct Job *);
+void job_heap_destroy(struct JobHeap *);
+
+// Links every job to its dependents, which are jobs of the same user.
+// Returns false, having logged why, if an upstream job does not exist or
+// the dependencies have a cycle.
+bool job_deps_link(struct Job *jobs, size_t njobs);
+// As job_deps_link(), but exits on failure.
+void job_deps_resolve(struct Job *jobs, size_t njobs);
+// Called when a run of job exits.  Adapts its interval to the outcome and,
+// if ok, queues the dependents for which it was the last upstream to
+// complete.  Returns true if the interval in effect has changed.
+bool job_finish(struct Job *, bool ok, struct JobHeap *, const struct timespec *ts);
+
+// Returns true if a and b are defined identically by the crontab.
+bool job_same_def(const struct Job *a, const struct Job *b);
+// Moves the run history, stats and, if unchanged, the schedule of old to
+// self, its new definition.  old may then be destroyed.
+void job_inherit(struct Job *self, struct Job *old, bool unchanged);
+
+bool job_catchup_parse(char const *s, enum JobCatchup *c);
+// Sets the policy of jobs that don't have one of their own and the window
+// in seconds over which staggered jobs are spread.
+void job_catchup_config(enum JobCatchup policy, unsigned int window);
+// Spreads the jobs that are overdue and to be staggered evenly over the
+// catch-up window that starts at ts.
+void job_catchup_stagger(struct Job *jobs, size_t njobs, const struct timespec *ts);
+// If a dispatch of job at ts would be past its deadline, reschedules it to
+// its first run that is not yet due and returns true.
+bool job_skip_late(struct Job *, const struct timespec *ts);
+
+// Schedules a job that is queued while ncron runs: when it is released by
+// its upstreams, its interval changes, it is resumed or it is reloaded.
 void job_set_initial_exectime(struct Job *, const struct timespec *ts);
-void job_exec(struct Job *, const struct timespec *ts);
+// Schedules a job whose history was loaded at startup; a run that was
+// missed while ncron was down is handled by the catch-up policy.
+void job_load_exectime(struct Job *, const struct timespec *ts);
+void job_mark_run(struct Job *, const struct timespec *ts);
+// Starts a run of job and returns true, or reschedules it if the run is
+// deferred or can't be started.
+bool job_exec(struct Job *, const struct timespec *ts);
 
-void parse_config(char const *path, char const *execfile,
-                  struct Job **stack, struct Job **deadstack);
+void parse_config_jobs(char const *path);
+void parse_config_dir(char const *dir, char const *cachedir);
+// Replaces g_jobs with the jobs defined by the crontab, without history.
+void parse_config_defs(char const *path, char const *dir, char const *cachefile);
+void parse_config(char const *path, char const *dir, char const *execfile,
+                  char const *cachefile, struct JobHeap *heap);
 #endif
@@ -0,0 +1,43 @@
+# Helpers shared by the tests; sourced with $T and $NCRON set by run.sh.
+
+fail() { echo "$*"; [ -f "$T/log" ] && cat "$T/log"; exit 1; }
+
+# run_ncron SECS ARGS...: runs the daemon for up to SECS seconds, after
+# which it is sent SIGTERM and saves its history.  Output goes to $T/log.
+run_ncron() {
+    secs=$1
+    shift
+    timeout "$secs" "$NCRON" "$@" > "$T/log" 2>&1
+    return 0
+}
+
+# job ID COMMAND KEY=VALUE...: appends a job to $T/crontab.
+job() {
+    printf '!%s\ncommand=%s\n' "$1" "$2" >> "$T/crontab"
+    shift 2
+    for kv; do printf '%s\n' "$kv" >> "$T/crontab"; done
+}
+
+# A command that appends its argument and the time to $T/runs.
+mark() {
+    cat > "$T/mark" <<MARK
+#!/bin/sh
+echo "\$1 \$(date +%s.%N)" >> "$T/runs"
+MARK
+    chmod +x "$T/mark"
+}
+
+runs_of() {
+    if [ -f "$T/runs" ]; then grep -c "^$1 " "$T/runs"; else echo 0; fi
+}
+
+now() { date +%s; }
+
+# ctl SOCKET COMMAND: sends a command to the control socket and prints the
+# reply.
+ctl() {
+    perl -MIO::Socket::UNIX -e '
+        my $s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or exit 1;
+        print $s "$ARGV[1]\n";
+        print while <$s>;' "$1" "$2"
+}
@@ -0,0 +1,24 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+// Checks that each power of two from 2^10 ns up is counted in the bucket
+// that it bounds, and the next nanosecond in the one after.
+#include <stdio.h>
+#include "metrics.h"
+
+int main(void)
+{
+    int bad = 0;
+    if (metrics_hist_bucket(0) != 0 || metrics_hist_bucket(1) != 0) bad = 1;
+    for (unsigned i = 0; i < METRICS_HIST_BUCKETS - 1; ++i) {
+        uint64_t edge = 1024ULL << i;
+        unsigned next = i + 1 < METRICS_HIST_BUCKETS - 1 ? i + 1 : METRICS_HIST_BUCKETS - 1;
+        if (metrics_hist_bucket(edge) != i || metrics_hist_bucket(edge + 1) != next) {
+            printf("%llu ns is in bucket %u, %llu ns in bucket %u\n",
+                   (unsigned long long)edge, metrics_hist_bucket(edge),
+                   (unsigned long long)edge + 1, metrics_hist_bucket(edge + 1));
+            bad = 1;
+        }
+    }
+    if (metrics_hist_bucket(UINT64_MAX) != METRICS_HIST_BUCKETS - 1) bad = 1;
+    return bad;
+}
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Runs each tests/t_*.sh against the ncron in the top directory.  Each test
+# gets an empty scratch directory in $T and fails by exiting nonzero.
+cd "$(dirname "$0")/.." || exit 1
+NCRON=$PWD/ncron
+export NCRON
+fails=0
+for t in tests/t_*.sh; do
+    T=$(mktemp -d)
+    export T
+    if sh "$t" > "$T/.out" 2>&1; then
+        echo "PASS $t"
+    else
+        echo "FAIL $t"
+        sed 's/^/    /' "$T/.out"
+        fails=$((fails + 1))
+    fi
+    rm -rf "$T"
+done
+[ "$fails" -eq 0 ]
@@ -0,0 +1,12 @@
+# A run is bound to its cpus= list by the new process.
+. tests/lib.sh
+cat > "$T/cpus" <<CPUS
+#!/bin/sh
+grep Cpus_allowed_list: /proc/self/status > "$T/out"
+CPUS
+chmod +x "$T/cpus"
+job 1 "$T/cpus" interval=1h maxruns=1 cpus=0
+printf '1=0:1\n' > "$T/hist"
+run_ncron 5 -t "$T/crontab" -H "$T/hist"
+grep -q 'Cpus_allowed_list:[[:space:]]*0$' "$T/out" 2>/dev/null \
+    || fail "the run was not bound to CPU 0: $(cat "$T/out" 2>/dev/null)"
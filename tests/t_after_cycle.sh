@@ -0,0 +1,10 @@
+# An 'after' cycle is rejected and reported by a job that is in it, not by
+# one that only waits on it.
+. tests/lib.sh
+job 4 /bin/true after=3
+job 1 /bin/true after=2
+job 2 /bin/true after=3
+job 3 /bin/true after=1
+: > "$T/hist"
+run_ncron 5 -t "$T/crontab" -H "$T/hist"
+grep -q "dependencies of job [123] form a cycle" "$T/log" || fail "the cycle was not reported"
@@ -0,0 +1,19 @@
+# A job that waits on one that is still running keeps the daemon alive,
+# and is queued as soon as its upstream exits.
+. tests/lib.sh
+cat > "$T/slow" <<SLOW
+#!/bin/sh
+sleep 1
+echo "\$1 \$(date +%s.%N)" >> "$T/runs"
+SLOW
+chmod +x "$T/slow"
+job 1 "$T/slow a" interval=1h maxruns=1
+job 2 "$T/slow b" after=1
+printf '1=0:1\n' > "$T/hist"
+run_ncron 10 -t "$T/crontab" -H "$T/hist"
+[ "$(runs_of a)" = 1 ] || fail "job 1 did not run"
+[ "$(runs_of b)" = 1 ] || fail "job 2 did not run after job 1"
+grep -q "No jobs left to run" "$T/log" || fail "the daemon did not exit by itself"
+# Each takes a second, so the dependent should start right after its upstream.
+awk '{ t[$1] = $2 } END { d = t["b"] - t["a"]; exit !(d >= 0.9 && d < 1.5) }' "$T/runs" \
+    || fail "job 2 was not started when job 1 exited: $(cat "$T/runs")"
@@ -0,0 +1,52 @@
+# The compiled cache is used only while it matches the crontab, and a
+# stale or damaged cache is ignored in favour of parsing.
+. tests/lib.sh
+mark
+job 1 "$T/mark a" interval=1h maxruns=1
+printf '1=0:1\n' > "$T/hist"
+"$NCRON" -t "$T/crontab" -C > "$T/log" 2>&1 || fail "the crontab did not compile"
+[ -s "$T/crontab.cache" ] || fail "no cache file was written"
+run_ncron 3 -V -t "$T/crontab" -H "$T/hist"
+grep -q "Loaded 1 jobs from cache file $T/crontab.cache" "$T/log" || fail "the cache was not used"
+[ "$(runs_of a)" = 1 ] || fail "the job from the cache did not run"
+
+# A changed crontab makes the cache stale until it is compiled again.
+sed -i "s|mark a|mark b|" "$T/crontab"
+printf '1=0:1\n' > "$T/hist"
+run_ncron 3 -V -t "$T/crontab" -H "$T/hist"
+grep -q "Cache file '$T/crontab.cache' is stale" "$T/log" || fail "the stale cache was not detected"
+[ "$(runs_of b)" = 1 ] && [ "$(runs_of a)" = 1 ] || fail "the stale cache was run"
+"$NCRON" -t "$T/crontab" -C > "$T/log" 2>&1 || fail "the crontab did not compile again"
+printf '1=0:1\n' > "$T/hist"
+run_ncron 3 -V -t "$T/crontab" -H "$T/hist"
+grep -q "Loaded 1 jobs from cache file" "$T/log" || fail "the rebuilt cache was not used"
+[ "$(runs_of b)" = 2 ] || fail "the rebuilt cache did not run the new command"
+
+# A truncated cache doesn't match the size recorded in its header.
+size=$(stat -c %s "$T/crontab.cache")
+truncate -s $((size - 8)) "$T/crontab.cache"
+printf '1=0:1\n' > "$T/hist"
+run_ncron 3 -t "$T/crontab" -H "$T/hist"
+grep -q "is stale or invalid" "$T/log" || fail "the truncated cache was used"
+[ "$(runs_of b)" = 3 ] || fail "the crontab was not parsed instead of the truncated cache"
+
+# With a crontab directory, only the file that changed is parsed again,
+# and its cache is rewritten.
+mkdir "$T/d" "$T/d.cache"
+: > "$T/crontab"
+job 1 "$T/mark c" interval=1h maxruns=1
+mv "$T/crontab" "$T/d/one"
+job 2 "$T/mark d" interval=1h maxruns=1
+mv "$T/crontab" "$T/d/two"
+printf '1=0:1\n2=0:1\n' > "$T/hist"
+run_ncron 3 -V -d "$T/d" -H "$T/hist"
+[ -s "$T/d.cache/one.cache" ] && [ -s "$T/d.cache/two.cache" ] || fail "the directory caches were not written"
+sed -i "s|mark d|mark e|" "$T/d/two"
+printf '1=0:1\n2=0:1\n' > "$T/hist"
+run_ncron 3 -V -d "$T/d" -H "$T/hist"
+grep -q "Loaded 1 jobs from cache file $T/d.cache/one.cache" "$T/log" || fail "the unchanged file was parsed"
+grep -q "Cache file '$T/d.cache/two.cache' is stale" "$T/log" || fail "the changed file's cache was used"
+[ "$(runs_of e)" = 1 ] || fail "the changed file did not run its new command"
+printf '1=0:1\n2=0:1\n' > "$T/hist"
+run_ncron 3 -V -d "$T/d" -H "$T/hist"
+grep -q "Loaded 1 jobs from cache file $T/d.cache/two.cache" "$T/log" || fail "the changed file's cache was not rewritten"
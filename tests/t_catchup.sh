@@ -0,0 +1,62 @@
+# Each catch-up policy applies to the runs missed before startup, but not
+# to jobs that are queued while the daemon runs.
+. tests/lib.sh
+mark
+old=$(($(now) - 7200))
+
+# once, the default: an overdue job runs at startup.
+job 1 "$T/mark once" interval=1h
+printf '1=1:%s\n' "$old" > "$T/hist"
+run_ncron 2 -t "$T/crontab" -H "$T/hist"
+[ "$(runs_of once)" = 1 ] || fail "the overdue job did not run once at startup"
+
+# skip: it waits for its next time, unless it has a policy of its own.  A
+# dependent released at runtime runs at once even though its own last run
+# is older than its interval.
+: > "$T/crontab"
+job 1 "$T/mark skip" interval=1h
+job 2 "$T/mark own" interval=1h catchup=once
+job 3 "$T/mark dep" interval=1h after=2
+printf '1=1:%s\n2=1:%s\n3=1:%s\n' "$old" "$old" "$old" > "$T/hist"
+run_ncron 2 -t "$T/crontab" -H "$T/hist" --catchup skip
+[ "$(runs_of skip)" = 0 ] || fail "the skipped job ran at startup"
+[ "$(runs_of own)" = 1 ] || fail "the job's own catchup=once was not used"
+[ "$(runs_of dep)" = 1 ] || fail "the dependent was caught up instead of run"
+
+# stagger: the overdue jobs are spread over the window.
+: > "$T/crontab"
+: > "$T/hist"
+for i in 1 2 3; do
+    job $i "$T/mark st$i" interval=1h
+    printf '%s=1:%s\n' $i "$old" >> "$T/hist"
+done
+run_ncron 5 -t "$T/crontab" -H "$T/hist" --catchup stagger --catchup-window 3
+grep -q "Staggering 3 overdue jobs over 3 s" "$T/log" || fail "the jobs were not staggered"
+[ "$(grep -c '^st' "$T/runs")" = 3 ] || fail "not every staggered job ran"
+awk '/^st/ { t[n++] = $2 } END { lo = hi = t[0]
+     for (i in t) { if (t[i] < lo) lo = t[i]; if (t[i] > hi) hi = t[i] }
+     exit !(hi - lo >= 0.9) }' "$T/runs" || fail "the staggered jobs all started at once"
+
+# A deadline overrides the policy for a run missed by longer than it.
+: > "$T/crontab"
+job 1 "$T/mark late" interval=1h deadline=60s
+printf '1=1:%s\n' "$old" > "$T/hist"
+run_ncron 2 -t "$T/crontab" -H "$T/hist"
+[ "$(runs_of late)" = 0 ] || fail "the job ran past its deadline"
+
+# A job that is changed by a reload is rescheduled from its history as
+# before, without being caught up: it is due now, so it runs.
+: > "$T/crontab"
+job 1 "$T/mark a" interval=1s
+job 2 "$T/mark rl" interval=1h maxruns=2
+printf '1=0:1\n2=1:%s\n' "$old" > "$T/hist"
+"$NCRON" -t "$T/crontab" -H "$T/hist" --catchup skip > "$T/log" 2>&1 &
+pid=$!
+sleep 1
+[ "$(runs_of rl)" = 0 ] || fail "the skipped job ran at startup"
+sed -i 's/^interval=1h$/interval=30m/' "$T/crontab"
+kill -HUP $pid
+sleep 1
+kill $pid
+wait $pid
+[ "$(runs_of rl)" = 1 ] || fail "the reloaded job was caught up: $(runs_of rl) runs"
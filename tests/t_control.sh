@@ -0,0 +1,46 @@
+# The control socket lists, shows, runs, pauses and resumes jobs, flushes
+# the history and changes the log level.
+. tests/lib.sh
+mark
+n=$(now)
+job 1 "$T/mark a" interval=1h
+job 2 "$T/mark b" interval=1h
+job 3 "$T/mark c" after=1
+printf '1=1:%s\n2=1:%s\n' "$n" "$n" > "$T/hist"
+"$NCRON" -t "$T/crontab" -H "$T/hist" -S "$T/sock" > "$T/log" 2>&1 &
+pid=$!
+i=0
+while [ ! -S "$T/sock" ] && [ $i -lt 50 ]; do sleep 0.1; i=$((i + 1)); done
+
+ctl "$T/sock" list > "$T/out"
+[ "$(cut -d' ' -f1 "$T/out" | tr '\n' ' ')" = "1 2 3 " ] || fail "list: $(cat "$T/out")"
+grep -q "^1 next $((n + 3600)) last $n runs 1 queued $T/mark" "$T/out" || fail "list: $(cat "$T/out")"
+grep -q "^3 next 0 last 0 runs 0 waiting" "$T/out" || fail "list: $(cat "$T/out")"
+
+ctl "$T/sock" "run 1" | grep -q "^1 next" || fail "run did not reply with the job"
+sleep 1
+[ "$(runs_of a)" = 1 ] || fail "run did not run job 1"
+[ "$(runs_of c)" = 1 ] || fail "the dependent of job 1 did not run"
+
+ctl "$T/sock" "pause 2" | grep -q "^2 next 0 .* paused" || fail "pause did not take job 2 out"
+ctl "$T/sock" "run 2" > /dev/null
+sleep 1
+[ "$(runs_of b)" = 1 ] || fail "a paused job was not run on request"
+ctl "$T/sock" "show 2" | grep -q " paused" || fail "a paused job did not stay paused"
+ctl "$T/sock" "resume 2" | grep -q "^2 next [1-9][0-9]* .* queued" || fail "resume did not queue job 2"
+
+ctl "$T/sock" "loglevel debug" | grep -q "^ok" || fail "loglevel debug was refused"
+ctl "$T/sock" "run 1" > /dev/null
+sleep 1
+grep -q "^DISPATCH 1 " "$T/log" || fail "loglevel did not turn on debug messages"
+ctl "$T/sock" "loglevel loud" | grep -q "^error: unknown log level 'loud'" \
+    || fail "a bad log level was accepted"
+
+ctl "$T/sock" "show 9" | grep -q "^error: no job '9'" || fail "show found a missing job"
+ctl "$T/sock" "frob 1" | grep -q "^error: unknown command 'frob'" || fail "a bad command was accepted"
+
+ctl "$T/sock" flush | grep -q "^ok" || fail "flush was refused"
+grep -q "^1=3:" "$T/hist" || fail "flush did not save the history"
+kill $pid
+wait $pid
+[ ! -e "$T/sock" ] || fail "the socket was left behind"
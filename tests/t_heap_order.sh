@@ -0,0 +1,38 @@
+# Jobs are dispatched in order of their due times, and each is requeued
+# after it runs.
+. tests/lib.sh
+mark
+n=$(now)
+# Jobs 4 to 1 come due a second apart, in reverse order of their ids.
+for i in 1 2 3 4; do
+    job $i "$T/mark o$i" interval=1h maxruns=2
+    printf '%s=1:%s\n' $i $((n - 3600 + 5 - i)) >> "$T/hist"
+done
+job 5 "$T/mark fast" interval=300ms
+job 6 "$T/mark slow" interval=700ms
+printf '5=0:1\n6=0:1\n' >> "$T/hist"
+run_ncron 6 -t "$T/crontab" -H "$T/hist"
+[ "$(grep '^o' "$T/runs" | cut -d' ' -f1 | tr '\n' ' ')" = "o4 o3 o2 o1 " ] \
+    || fail "the jobs ran out of order: $(grep '^o' "$T/runs")"
+awk '/^o/ { t[$1] = $2 } END { exit !(t["o1"] - t["o4"] > 2.5) }' "$T/runs" \
+    || fail "the jobs did not wait for their due times"
+# Each run is requeued one interval after the last was due; the first run
+# is due at the start of the second in which ncron started, so up to a
+# second more than the 6 s run falls inside the schedule.
+fast=$(runs_of fast)
+slow=$(runs_of slow)
+[ "$fast" -ge 15 ] && [ "$fast" -le 24 ] || fail "the 300 ms job ran $fast times"
+[ "$slow" -ge 7 ] && [ "$slow" -le 11 ] || fail "the 700 ms job ran $slow times"
+awk '$1 == "slow" { if (n++ > 1 && ($2 - p < 0.6 || $2 - p > 0.9)) bad = 1; p = $2 }
+     END { exit bad }' "$T/runs" || fail "the 700 ms job was not requeued on time"
+
+# The forecast runs the same queue.  With the last runs half an hour ago,
+# 24 + 12 + 8 runs fall within the next day.
+: > "$T/crontab"
+job 1 /bin/true interval=1h
+job 2 /bin/true interval=2h
+job 3 /bin/true interval=3h
+h=$(($(now) - 1800))
+printf '1=1:%s\n2=1:%s\n3=1:%s\n' "$h" "$h" "$h" > "$T/hist"
+"$NCRON" -t "$T/crontab" -H "$T/hist" -f 1 > "$T/log" 2>&1
+grep -q "Total dispatches: 44" "$T/log" || fail "the forecast requeued the jobs wrongly"
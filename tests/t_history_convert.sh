@@ -0,0 +1,22 @@
+# A journal record converted into a binary history supersedes the snapshot
+# record for the same job, and survives conversion back to text.
+. tests/lib.sh
+mark
+job 1 "$T/mark a" interval=1h
+job 2 "$T/mark b" interval=1h
+recent=$(($(now) - 60))
+printf '1=3:100\n2=1:200\n' > "$T/hist"
+printf '1=4:%s\n' "$recent" > "$T/hist.journal"
+
+"$NCRON" -t "$T/crontab" -H "$T/hist" -X binary > "$T/log" 2>&1 || fail "convert to binary failed"
+[ -e "$T/hist.journal" ] && fail "journal was not folded in"
+grep -q "Converted 2 history records" "$T/log" || fail "records were not merged by id"
+
+# Job 1 ran a minute ago, so only job 2 is due.
+run_ncron 2 -t "$T/crontab" -H "$T/hist"
+[ "$(runs_of a)" = 0 ] || fail "job 1 ran from its stale record"
+[ "$(runs_of b)" = 1 ] || fail "job 2 did not run"
+
+"$NCRON" -t "$T/crontab" -H "$T/hist" -X text > "$T/log" 2>&1 || fail "convert to text failed"
+grep -qx "1=4:$recent" "$T/hist" || fail "job 1 lost its journal record: $(cat "$T/hist")"
+[ "$(grep -c '^1=' "$T/hist")" = 1 ] || fail "job 1 has several records"
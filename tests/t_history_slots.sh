@@ -0,0 +1,23 @@
+# When a binary history holds several records for a job, the newest wins.
+. tests/lib.sh
+mark
+job 1 "$T/mark a" interval=1h
+recent=$(($(now) - 60))
+# Two slots for id 1, a stale one followed by a recent one; the layout
+# matches struct hist_rec in history.c.
+python3 - "$T/hist" "$recent" <<'PY' || fail "python3 is needed"
+import struct, sys
+def fnv(b):
+    h = 0xcbf29ce484222325
+    for c in b:
+        h = ((h ^ c) * 0x100000001b3) & 0xffffffffffffffff
+    return h & 0xffffffff
+def rec(i, n, t):
+    b = struct.pack('<iIqII', i, n, t, 0, 1)
+    return b + struct.pack('<II', fnv(b), 0)
+recs = [rec(1, 1, 100), rec(1, 2, int(sys.argv[2]))]
+with open(sys.argv[1], 'wb') as f:
+    f.write(b'NCRONHST' + struct.pack('<IIQ', 1, 32, len(recs)) + b''.join(recs))
+PY
+run_ncron 2 -t "$T/crontab" -H "$T/hist"
+[ "$(runs_of a)" = 0 ] || fail "job 1 ran from its stale record"
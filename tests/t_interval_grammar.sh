@@ -0,0 +1,16 @@
+# Times take the units ms (for interval= only), s, m, h, d and w.  When
+# several are given, only the last counts, as it always has.
+. tests/lib.sh
+job 1 /bin/true interval=250ms
+job 2 /bin/true interval=5m
+job 3 /bin/true interval=1h5m3s
+job 4 /bin/true interval=1500ms
+: > "$T/hist"
+run_ncron 1 -V -t "$T/crontab" -H "$T/hist"
+ivs=$(grep 'interval: ' "$T/log" | grep -v failure | awk '{ print $2 }' | tr '\n' ' ')
+[ "$ivs" = "0.250 300.000 3.000 1.500 " ] || fail "intervals parsed as: $ivs"
+
+: > "$T/crontab"
+job 1 /bin/true interval=1s timeout=500ms
+run_ncron 1 -t "$T/crontab" -H "$T/hist"
+grep -q "must be in whole seconds" "$T/log" || fail "a timeout in ms was accepted"
@@ -0,0 +1,24 @@
+# A burst of messages larger than the log ring is written out in full and
+# in order, and what is queued when the daemon exits is drained.
+. tests/lib.sh
+i=1
+while [ $i -le 600 ]; do
+    printf '!%s\ncommand=/bin/true\ninterval=1h\nmaxruns=1\n' $i >> "$T/crontab"
+    printf '%s=0:1\n' $i >> "$T/hist"
+    i=$((i + 1))
+done
+cp "$T/hist" "$T/hist0"
+run_ncron 20 -V -t "$T/crontab" -H "$T/hist"
+[ "$(grep -c '^DISPATCH [0-9]* (' "$T/log")" = 600 ] || fail "dispatch messages were lost"
+[ "$(grep '^DISPATCH' "$T/log" | cut -d' ' -f2 | sort -un | wc -l)" = 600 ] \
+    || fail "dispatch messages were repeated"
+[ "$(grep -c '^EXIT [0-9]* pid [0-9]* status 0 ' "$T/log")" = 600 ] || fail "exit messages were lost"
+grep -q "No jobs left to run" "$T/log" || fail "the daemon did not finish"
+[ "$(tail -n 1 "$T/log")" = "Exited." ] || fail "the messages at exit were not drained"
+
+# The same holds for structured messages, which are rendered by the writer.
+cp "$T/hist0" "$T/hist"
+run_ncron 20 -V --log-format json -t "$T/crontab" -H "$T/hist"
+[ "$(grep -c '"msg":"DISPATCH [0-9]* (' "$T/log")" = 600 ] || fail "json messages were lost"
+! grep -qv '^{.*}$' "$T/log" || fail "a json message was torn"
+tail -n 1 "$T/log" | grep -q '"msg":"Exited."' || fail "the json messages at exit were not drained"
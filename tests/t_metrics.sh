@@ -0,0 +1,75 @@
+# The metrics file is always a whole page, is replaced rather than rewritten
+# in place, and its histograms put a power-of-two latency in the bucket it
+# bounds.
+. tests/lib.sh
+${CC:-cc} -std=gnu99 -iquote . -o "$T/mb" tests/metrics_bucket.c || fail "metrics_bucket.c did not build"
+"$T/mb" || fail "a power-of-two latency was put in the wrong bucket"
+
+mark
+n=$(now)
+job 1 "$T/mark a" interval=300ms
+job 2 "$T/missing" interval=1h
+printf '1=1:%s\n2=1:%s\n' "$n" "$((n - 7200))" > "$T/hist"
+"$NCRON" -t "$T/crontab" -H "$T/hist" -m "$T/metrics" -M 1 -L > "$T/log" 2>&1 &
+pid=$!
+
+inodes=
+i=0
+while [ $i -lt 40 ]; do
+    if [ -f "$T/metrics" ]; then
+        cp "$T/metrics" "$T/seen"
+        head -n1 "$T/seen" | grep -q "^# HELP ncron_dispatches_total " \
+            || fail "a partial page was read: $(head -n1 "$T/seen")"
+        tail -n1 "$T/seen" | grep -q "^ncron_job_last_run_age_seconds{job=\"2\"} " \
+            || fail "a partial page was read: $(tail -n1 "$T/seen")"
+        ino=$(ls -i "$T/metrics" | cut -d' ' -f1)
+        case " $inodes " in *" $ino "*) ;; *) inodes="$inodes $ino" ;; esac
+    fi
+    sleep 0.1
+    i=$((i + 1))
+done
+kill "$pid"
+wait "$pid"
+
+[ "$(echo $inodes | wc -w)" -ge 2 ] || fail "the metrics file was rewritten in place"
+[ -e "$T/metrics~" ] && fail "the temporary metrics file was left behind"
+m=$T/metrics
+d=$(awk '$1 == "ncron_dispatches_total" { print $2 }' "$m")
+[ "${d:-0}" -ge 5 ] || fail "dispatches_total is '$d'"
+f=$(awk '$1 == "ncron_spawn_failures_total" { print $2 }' "$m")
+[ "${f:-0}" -ge 1 ] || fail "spawn_failures_total is '$f'"
+
+# Each histogram's le bounds start at 2^10 ns and double, its counts never
+# fall, and its +Inf count equals its _count.
+awk '
+$1 == "#" && $2 == "TYPE" && $4 == "histogram" { hist[$3] = 1; next }
+/_bucket\{/ {
+    s = $1; sub(/le="[^"]*"\}$/, "", s)
+    le = $1; sub(/.*le="/, "", le); sub(/"\}$/, "", le)
+    if (s != cur) { cur = s; want = 1.024e-06; last = 0 }
+    if (le == "+Inf") { inf[s] = $2 } else {
+        if (le + 0 < want * 0.999 || le + 0 > want * 1.001) { print "bad bound " $0; bad = 1 }
+        want *= 2
+    }
+    if ($2 + 0 < last) { print "falling count " $0; bad = 1 }
+    last = $2 + 0
+    next
+}
+/_count/ {
+    name = $1; sub(/_count.*/, "", name)
+    if (!(name in hist)) next
+    s = $1; sub(/_count/, "_bucket", s); sub(/\}$/, ",", s); sub(/_bucket$/, "_bucket{", s)
+    if (!(s in inf) || inf[s] != $2) { print "+Inf differs from " $0; bad = 1 }
+    n++
+}
+END { if (!n) { print "no histograms"; bad = 1 } exit bad }' "$m" || fail "$(cat "$m")"
+
+grep -q '^ncron_dispatch_lateness_seconds_count [1-9]' "$m" || fail "no dispatch lateness"
+grep -q '^ncron_spawn_seconds_count [1-9]' "$m" || fail "no spawn latency"
+grep -q '^ncron_job_dispatch_lateness_seconds_count{job="1"} [1-9]' "$m" \
+    || fail "no per-job lateness for job 1"
+grep -q '^ncron_job_spawn_seconds_bucket{job="1",le="+Inf"} [1-9]' "$m" \
+    || fail "no per-job spawn latency for job 1"
+grep -q '^ncron_queue_depth 2$' "$m" || fail "queue depth is not 2"
+grep -q '^ncron_job_last_run_age_seconds{job="1"} [0-9]' "$m" || fail "no last run age for job 1"
+exit 0
@@ -0,0 +1,31 @@
+# Output logs are rotated once they reach output_size, keeping three old
+# logs, and every byte written is counted in the job's stats.
+. tests/lib.sh
+cat > "$T/spew" <<'SPEW'
+#!/bin/sh
+head -c 600 /dev/zero | tr '\0' x
+SPEW
+chmod +x "$T/spew"
+job 1 "$T/spew" interval=300ms output="$T/out1" output_size=1
+job 2 "$T/spew" interval=300ms output="$T/out2" output_size=0
+printf '1=0:1\n2=0:1\n' > "$T/hist"
+run_ncron 4 -t "$T/crontab" -H "$T/hist"
+for f in out1 out1.1 out1.2 out1.3; do
+    [ -f "$T/$f" ] || fail "$f is missing"
+done
+[ ! -e "$T/out1.4" ] || fail "more than three old logs were kept"
+# A log is rotated before the run that finds it at 1 KiB or more, so each
+# old log holds two runs.
+for f in out1.1 out1.2 out1.3; do
+    [ "$(stat -c %s "$T/$f")" = 1200 ] || fail "$f has $(stat -c %s "$T/$f") bytes"
+done
+[ "$(stat -c %s "$T/out1")" -le 1200 ] || fail "the current log passed the limit"
+[ ! -e "$T/out2.1" ] || fail "a log with output_size=0 was rotated"
+# The second to last field of a stats line is the byte count.
+runs2=$(awk '$1 == 2 { print $2 }' "$T/hist.stats")
+bytes2=$(awk '$1 == 2 { print $(NF - 1) }' "$T/hist.stats")
+[ "$bytes2" = $((runs2 * 600)) ] || fail "job 2 was counted $bytes2 bytes for $runs2 runs"
+[ "$(stat -c %s "$T/out2")" = "$bytes2" ] || fail "the log of job 2 does not hold every run"
+bytes1=$(awk '$1 == 1 { print $(NF - 1) }' "$T/hist.stats")
+runs1=$(awk '$1 == 1 { print $2 }' "$T/hist.stats")
+[ "$bytes1" = $((runs1 * 600)) ] || fail "job 1 was counted $bytes1 bytes for $runs1 runs"
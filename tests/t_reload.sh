@@ -0,0 +1,29 @@
+# A reload keeps the jobs that remain queued, including the deadline of a
+# run that is going, and a crontab with errors leaves the jobs in place.
+. tests/lib.sh
+mark
+job 1 "$T/mark a" interval=1s
+job 2 "$T/mark b" interval=1h
+printf '#!/bin/sh\nexec sleep 30\n' > "$T/hang"
+chmod +x "$T/hang"
+job 3 "$T/hang" interval=1h maxruns=1 timeout=3s
+printf '1=0:1\n2=0:1\n3=0:1\n' > "$T/hist"
+"$NCRON" -t "$T/crontab" -H "$T/hist" > "$T/log" 2>&1 &
+pid=$!
+sleep 1.5
+job 4 "$T/mark d" after=1
+sed -i 's/^interval=1h$/interval=2h/' "$T/crontab"
+kill -HUP $pid
+sleep 1
+echo 'garbage' >> "$T/crontab"
+kill -HUP $pid
+sleep 2
+kill $pid
+wait $pid
+grep -q "Reloaded 4 jobs: 1 added, 2 changed, 0 removed" "$T/log" || fail "the reload was not applied"
+grep -q "keeping the current jobs" "$T/log" || fail "the bad crontab was not rejected"
+[ "$(runs_of a)" -ge 5 ] || fail "job 1 stopped running across the reloads"
+[ "$(runs_of b)" = 1 ] || fail "job 2 ran again after being changed"
+[ "$(runs_of d)" -ge 3 ] || fail "the added job did not run after job 1"
+grep -q "Job 3 (pid [0-9]*) exceeded its timeout" "$T/log" \
+    || fail "the deadline of job 3 was lost in the reload"
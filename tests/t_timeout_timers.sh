@@ -0,0 +1,16 @@
+# A run that outlives its timeout is terminated even when it is the last
+# one, and the deadlines of runs that exit in time don't pile up.
+. tests/lib.sh
+mark
+job 1 "$T/mark a" interval=1s timeout=1h
+printf '#!/bin/sh\nexec sleep 30\n' > "$T/hang"
+chmod +x "$T/hang"
+job 2 "$T/hang" interval=1h maxruns=1 timeout=1s
+printf '1=0:1\n2=0:1\n' > "$T/hist"
+run_ncron 4 -t "$T/crontab" -H "$T/hist" -V
+[ "$(runs_of a)" -ge 3 ] || fail "job 1 did not keep running"
+grep -q "exceeded its timeout" "$T/log" || fail "job 2 was not terminated"
+# The queue is printed after each batch of dispatches; by the last one,
+# at most the deadline of the run of job 1 that was just started remains.
+n=$(awk '/ts = .*front/ { n = 0 } /job 1 pid .* deadline/ { ++n } END { print n }' "$T/log")
+[ "$n" -le 1 ] || fail "$n deadlines are queued for job 1"
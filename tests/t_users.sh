@@ -0,0 +1,61 @@
+# With --users, two users may use the same ids, each after= stays within
+# its user, and a user whose crontab has errors is skipped on its own.
+. tests/lib.sh
+chmod 755 "$T"
+mark
+: > "$T/runs"
+chmod 666 "$T/runs"
+mkdir "$T/u" "$T/h"
+for u in root nobody; do
+    : > "$T/crontab"
+    job 1 "$T/mark $u-a" interval=1h journal
+    job 2 "$T/mark $u-b" after=1
+    mv "$T/crontab" "$T/u/$u"
+    printf '1=0:1\n' > "$T/h/$u"
+done
+job 1 "$T/mark daemon-a" interval=1h
+echo 'bogus=1' >> "$T/crontab"
+mv "$T/crontab" "$T/u/daemon"
+printf '1=0:1\n' > "$T/h/daemon"
+"$NCRON" -u "$T/u" -H "$T/h" > "$T/log" 2>&1 &
+pid=$!
+sleep 2
+# The records are left in the journal, which must tell the users apart.
+kill -9 $pid
+wait $pid
+for u in root nobody; do
+    [ "$(runs_of $u-a)" = 1 ] || fail "job 1 of $u did not run once"
+    [ "$(runs_of $u-b)" = 1 ] || fail "job 2 of $u did not run after its job 1"
+    grep -q "^$u:1=1:" "$T/h/.journal" || fail "the journal has no record for $u"
+done
+[ "$(runs_of daemon-a)" = 0 ] || fail "the broken crontab was run"
+grep -q "Crontab '$T/u/daemon' has errors; skipping it" "$T/log" \
+    || fail "the broken crontab was not reported"
+
+# Each user's record comes back from the journal, so nothing is due now,
+# while a job 3 that both users add runs for each of them.
+for u in root nobody; do
+    printf '!3\ncommand=%s\ninterval=1h\n' "$T/mark $u-c" >> "$T/u/$u"
+    printf '3=0:1\n' >> "$T/h/$u"
+done
+"$NCRON" -u "$T/u" -H "$T/h" > "$T/log" 2>&1 &
+pid=$!
+sleep 2
+kill $pid
+wait $pid
+for u in root nobody; do
+    [ "$(runs_of $u-a)" = 1 ] || fail "the journal record of $u was not applied to it"
+    [ "$(runs_of $u-c)" = 1 ] || fail "job 3 of $u did not run"
+    grep -q "^1=1:" "$T/h/$u" || fail "the history of $u was not saved"
+    grep -q "^$u:3 1 " "$T/h/.stats" || fail "the stats of $u were not saved"
+done
+
+# The stats are read back for the right users.
+"$NCRON" -u "$T/u" -H "$T/h" > "$T/log" 2>&1 &
+pid=$!
+sleep 1
+kill $pid
+wait $pid
+for u in root nobody; do
+    grep -q "^$u:3 1 " "$T/h/.stats" || fail "the stats of $u were lost"
+done
@@ -0,0 +1,39 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_TRACE_H_
+#define NCRON_TRACE_H_
+
+// USDT probes in the "ncron" provider, for use with bpftrace or perf.  A
+// disabled probe is a single nop in the code; the arguments are only
+// materialized in registers or on the stack, which the compiler may share
+// with the surrounding code.  Without <sys/sdt.h>, or with NCRON_NO_SDT
+// defined, the probes are compiled out.
+//
+//   dispatch(id, exectime, now)
+//   exec__start(id, now)                 exec__done(id, pid, next exectime)
+//   spawn__start(id, in_cgroup)          spawn__done(id, pid, err)
+//   constrain__entry(id, stime)          constrain__return(id, stime, result, iterations)
+//   save__start(njobs)                   save__done(njobs, ok)
+//
+// pid is 0 if the job could not be spawned.
+
+#if !defined(NCRON_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NCRON_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef NCRON_HAVE_SDT
+#define TRACE1(name, a) DTRACE_PROBE1(ncron, name, a)
+#define TRACE2(name, a, b) DTRACE_PROBE2(ncron, name, a, b)
+#define TRACE3(name, a, b, c) DTRACE_PROBE3(ncron, name, a, b, c)
+#define TRACE4(name, a, b, c, d) DTRACE_PROBE4(ncron, name, a, b, c, d)
+#else
+#define TRACE1(name, a) do { (void)(a); } while (0)
+#define TRACE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#define TRACE3(name, a, b, c) do { (void)(a); (void)(b); (void)(c); } while (0)
+#define TRACE4(name, a, b, c, d) do { (void)(a); (void)(b); (void)(c); (void)(d); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,202 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/fsuid.h>
+#include <sys/syscall.h>
+#include "nk/log.h"
+#include "users.h"
+
+// Users are looked up when the crontab directory is loaded and are never
+// freed while the daemon runs, so jobs, including retired ones with runs
+// still going, may hold on to them across reloads.
+
+static bool g_enabled;
+static unsigned g_max_jobs;
+static unsigned g_max_running;
+static struct User **g_users;
+static size_t g_nusers;
+
+void users_init(unsigned max_jobs, unsigned max_running)
+{
+    g_enabled = true;
+    g_max_jobs = max_jobs;
+    g_max_running = max_running;
+}
+
+bool users_enabled(void) { return g_enabled; }
+unsigned users_max_jobs(void) { return g_max_jobs; }
+
+static char *env_var(char const *name, char const *val)
+{
+    size_t nl = strlen(name), vl = strlen(val);
+    char *r = malloc(nl + vl + 2);
+    if (!r) abort();
+    memcpy(r, name, nl);
+    r[nl] = '=';
+    memcpy(r + nl + 1, val, vl + 1);
+    return r;
+}
+
+static void user_free_details(struct User *u)
+{
+    if (u->env) {
+        for (char **e = u->env; *e; ++e) free(*e);
+    }
+    free(u->env);
+    free(u->groups);
+    free(u->home);
+    u->env = NULL;
+    u->groups = NULL;
+    u->home = NULL;
+}
+
+// The environment of ncron is passed through, as for its own jobs, with
+// the variables that identify the user replaced.
+static void user_make_env(struct User *u)
+{
+    static char const *const own[] = { "HOME=", "USER=", "LOGNAME=" };
+    size_t n = 0;
+    for (char **e = environ; *e; ++e) ++n;
+    u->env = calloc(n + 4, sizeof *u->env);
+    if (!u->env) abort();
+    size_t k = 0;
+    for (char **e = environ; *e; ++e) {
+        bool skip = false;
+        for (size_t i = 0; i < sizeof own / sizeof *own; ++i) {
+            if (!strncmp(*e, own[i], strlen(own[i]))) skip = true;
+        }
+        if (skip) continue;
+        u->env[k] = strdup(*e);
+        if (!u->env[k++]) abort();
+    }
+    u->env[k++] = env_var("HOME", u->home);
+    u->env[k++] = env_var("USER", u->name);
+    u->env[k++] = env_var("LOGNAME", u->name);
+}
+
+static bool user_lookup(struct User *u)
+{
+    errno = 0;
+    struct passwd *pw = getpwnam(u->name);
+    if (!pw) {
+        if (errno)
+            log_line("Failed to look up user '%s': %s\n", u->name, strerror(errno));
+        return false;
+    }
+    user_free_details(u);
+    u->uid = pw->pw_uid;
+    u->gid = pw->pw_gid;
+    u->home = strdup(pw->pw_dir);
+    if (!u->home) abort();
+    int ng = 16;
+    for (;;) {
+        u->groups = realloc(u->groups, (size_t)ng * sizeof *u->groups);
+        if (!u->groups) abort();
+        int want = ng;
+        if (getgrouplist(u->name, u->gid, u->groups, &want) >= 0) {
+            u->ngroups = (size_t)want;
+            break;
+        }
+        ng = want > ng ? want : ng * 2;
+    }
+    user_make_env(u);
+    return true;
+}
+
+struct User *users_get(char const *name)
+{
+    struct User *u = NULL;
+    for (size_t i = 0; i < g_nusers; ++i) {
+        if (!strcmp(g_users[i]->name, name)) {
+            u = g_users[i];
+            break;
+        }
+    }
+    if (!u) {
+        u = calloc(1, sizeof *u);
+        if (!u) abort();
+        u->name = strdup(name);
+        if (!u->name) abort();
+        struct User **nu = realloc(g_users, (g_nusers + 1) * sizeof *nu);
+        if (!nu) abort();
+        g_users = nu;
+        g_users[g_nusers++] = u;
+    }
+    return user_lookup(u) ? u : NULL;
+}
+
+bool users_may_run(const struct User *user)
+{
+    return !g_max_running || user->running < g_max_running;
+}
+
+// The daemon's own supplementary groups, which users_fs_leave() restores.
+static gid_t *g_own_groups;
+static size_t g_own_ngroups;
+static bool g_have_own_groups;
+
+// The kernel keeps credentials per thread; unlike setgroups(), which glibc
+// applies to every thread, the raw system call changes only the caller's.
+static int thread_setgroups(size_t n, const gid_t *groups)
+{
+#ifdef SYS_setgroups32
+    return (int)syscall(SYS_setgroups32, n, groups);
+#else
+    return (int)syscall(SYS_setgroups, n, groups);
+#endif
+}
+
+// The fs ids and groups are per-thread, so this leaves the other threads
+// alone.
+bool users_fs_enter(const struct User *user)
+{
+    if (!g_have_own_groups) {
+        int n = getgroups(0, NULL);
+        if (n < 0) return false;
+        g_own_groups = malloc(((size_t)n + 1) * sizeof *g_own_groups);
+        if (!g_own_groups) abort();
+        n = getgroups(n, g_own_groups);
+        if (n < 0) return false;
+        g_own_ngroups = (size_t)n;
+        g_have_own_groups = true;
+    }
+    if (thread_setgroups(user->ngroups, user->groups)) return false;
+    setfsgid(user->gid);
+    setfsuid(user->uid);
+    if ((uid_t)setfsuid((uid_t)-1) != user->uid || (gid_t)setfsgid((gid_t)-1) != user->gid) {
+        users_fs_leave();
+        return false;
+    }
+    return true;
+}
+
+void users_fs_leave(void)
+{
+    setfsuid(geteuid());
+    setfsgid(getegid());
+    if (thread_setgroups(g_own_ngroups, g_own_groups))
+        log_line("Failed to restore the supplementary groups: %s\n", strerror(errno));
+}
+
+void users_destroy(void)
+{
+    for (size_t i = 0; i < g_nusers; ++i) {
+        user_free_details(g_users[i]);
+        free(g_users[i]->name);
+        free(g_users[i]);
+    }
+    free(g_users);
+    g_users = NULL;
+    g_nusers = 0;
+    free(g_own_groups);
+    g_own_groups = NULL;
+    g_own_ngroups = 0;
+    g_have_own_groups = false;
+}
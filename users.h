@@ -0,0 +1,40 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_USERS_H_
+#define NCRON_USERS_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// An account whose crontab is loaded by a daemon serving many users.
+struct User
+{
+    char *name;
+    char *home;
+    char **env;            // environment of the user's jobs
+    gid_t *groups;         // supplementary groups
+    size_t ngroups;
+    uid_t uid;
+    gid_t gid;
+    unsigned int running;  // processes of the user's jobs
+};
+
+// Turns on the multi-tenant mode, where each file of the crontab directory
+// is the crontab of the user that it is named for.  A user may have at
+// most max_jobs jobs and max_running processes, if nonzero.
+void users_init(unsigned max_jobs, unsigned max_running);
+bool users_enabled(void);
+unsigned users_max_jobs(void);
+// Returns the user named name, with the account details read afresh, or
+// NULL if there is no such account.  A name always maps to the same User,
+// which lives until users_destroy().  Not thread-safe.
+struct User *users_get(char const *name);
+// Returns true if another process may be started for user.
+bool users_may_run(const struct User *user);
+// Files are created and opened with the credentials of user, including its
+// supplementary groups, until users_fs_leave() is called.  Returns false if
+// they can't be taken on.
+bool users_fs_enter(const struct User *user);
+void users_fs_leave(void);
+void users_destroy(void);
+#endif
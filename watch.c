@@ -0,0 +1,119 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include "nk/log.h"
+#include "watch.h"
+
+extern int gflags_debug;
+
+// The directory that holds the crontab is watched rather than the file, so
+// that a crontab that is replaced by renaming a new file over it is seen.
+// Each change restarts a short timer and the reload happens when it
+// expires, so a burst of writes by an editor causes just one reload.
+
+static int g_ifd = -1;
+static int g_tfd = -1;
+static char *g_name; // crontab file name, or NULL if watching a crontab dir
+static bool g_armed;
+
+static void watch_close(void)
+{
+    if (g_ifd >= 0) close(g_ifd);
+    if (g_tfd >= 0) close(g_tfd);
+    g_ifd = g_tfd = -1;
+}
+
+void watch_init(char const *path, bool isdir, int epfd)
+{
+    char *dir;
+    if (isdir) {
+        dir = strdup(path);
+        if (!dir) abort();
+    } else {
+        char const *sl = strrchr(path, '/');
+        dir = sl ? strndup(path, sl == path ? 1 : (size_t)(sl - path)) : strdup(".");
+        g_name = strdup(sl ? sl + 1 : path);
+        if (!dir || !g_name) abort();
+    }
+    g_ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    g_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_ifd < 0 || g_tfd < 0) {
+        log_line("Failed to set up a watch on '%s': %s\n", path, strerror(errno));
+        goto fail;
+    }
+    if (inotify_add_watch(g_ifd, dir, IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE
+                          | IN_MOVED_TO | IN_MOVED_FROM | IN_ONLYDIR) < 0) {
+        log_line("Failed to watch '%s': %s\n", dir, strerror(errno));
+        goto fail;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = WATCH_EV_NOTIFY };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, g_ifd, &ev))
+        suicide("epoll_ctl failed: %s\n", strerror(errno));
+    ev.data.u64 = WATCH_EV_DEBOUNCE;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, g_tfd, &ev))
+        suicide("epoll_ctl failed: %s\n", strerror(errno));
+    free(dir);
+    return;
+fail:
+    free(dir);
+    watch_close();
+}
+
+// Returns true if the event concerns the crontab.
+static bool watch_relevant(const struct inotify_event *ie)
+{
+    if (ie->mask & IN_Q_OVERFLOW) return true;
+    if (ie->mask & IN_IGNORED) {
+        log_line("Crontab directory has gone away; it is no longer watched\n");
+        return false;
+    }
+    if (!ie->len) return false;
+    if (g_name) return !strcmp(ie->name, g_name);
+    // Skipped by the crontab directory parser as well.
+    size_t l = strlen(ie->name);
+    return ie->name[0] != '.' && ie->name[l - 1] != '~';
+}
+
+bool watch_event(uint64_t ev)
+{
+    if (ev == WATCH_EV_DEBOUNCE) {
+        uint64_t cnt;
+        if (read(g_tfd, &cnt, sizeof cnt) != (ssize_t)sizeof cnt) return false;
+        g_armed = false;
+        return true;
+    }
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    for (;;) {
+        ssize_t r = read(g_ifd, buf, sizeof buf);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN)
+                log_line("Failed to read inotify events: %s\n", strerror(errno));
+            break;
+        }
+        for (char *p = buf; p < buf + r;) {
+            const struct inotify_event *ie = (const struct inotify_event *)(void *)p;
+            if (watch_relevant(ie)) changed = true;
+            p += sizeof *ie + ie->len;
+        }
+    }
+    if (changed) {
+        if (gflags_debug && !g_armed) log_debug("Crontab changed; reloading in %d ms\n", WATCH_DEBOUNCE_MS);
+        struct itimerspec its = {
+            .it_value = { .tv_sec = WATCH_DEBOUNCE_MS / 1000,
+                          .tv_nsec = WATCH_DEBOUNCE_MS % 1000 * 1000000L },
+        };
+        if (timerfd_settime(g_tfd, 0, &its, NULL))
+            log_line("timerfd_settime failed: %s\n", strerror(errno));
+        g_armed = true;
+    }
+    return false;
+}
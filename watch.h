@@ -0,0 +1,21 @@
+// Copyright 2026 Nicholas J. Kain <njkain at gmail dot com>
+// SPDX-License-Identifier: MIT
+#ifndef NCRON_WATCH_H_
+#define NCRON_WATCH_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+// epoll data values of the watch descriptors; pids never get this large.
+#define WATCH_EV_NOTIFY UINT64_MAX
+#define WATCH_EV_DEBOUNCE (UINT64_MAX - 1)
+// A reload waits until the crontab has been left alone for this long.
+#define WATCH_DEBOUNCE_MS 500
+
+// Watches the crontab at path, or the crontab directory if isdir, and adds
+// the watch descriptors to epfd.  Failures are logged and leave the crontab
+// unwatched.
+void watch_init(char const *path, bool isdir, int epfd);
+// Handles an epoll event with data value ev.  Returns true once the
+// crontab has changed and the debounce window has passed.
+bool watch_event(uint64_t ev);
+#endif